@@ -0,0 +1,34 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "allocator.h"
+
+namespace gb {
+
+class MallocAllocator : public Allocator
+{
+public:
+    virtual void* Allocate(size_t size, size_t alignment)
+    {
+        // malloc is aligned for any scalar type, and some mallocs return null for 0 bytes.
+        void* ptr = malloc(size ? size : 1);
+        if (!ptr)
+        {
+            fprintf(stderr, "Error out of memory allocating %u bytes\n", (uint32_t)size);
+            abort();
+        }
+        return ptr;
+    }
+
+    virtual void Free(void* ptr)
+    {
+        free(ptr);
+    }
+};
+
+Allocator& GetDefaultAllocator()
+{
+    static MallocAllocator s_allocator;
+    return s_allocator;
+}
+
+} // namespace gb
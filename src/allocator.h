@@ -0,0 +1,99 @@
+#ifndef GB_ALLOCATOR_H
+#define GB_ALLOCATOR_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <new>
+#include <memory>
+#include <vector>
+#include <map>
+#include <string>
+#include <utility>
+#include <type_traits>
+
+namespace gb {
+
+// Where the memory of a Context comes from: glyphs, texture images, texts, the glyph maps and FreeType.
+// Must be thread-safe when the context is created with ContextOptionFlags_ThreadSafe.
+class Allocator
+{
+public:
+    virtual ~Allocator() {}
+
+    // alignment is a power of two, no larger than that of any scalar type.  never returns null.
+    virtual void* Allocate(size_t size, size_t alignment) = 0;
+    virtual void Free(void* ptr) = 0;
+};
+
+// malloc & free, for contexts created without an allocator.
+Allocator& GetDefaultAllocator();
+
+// Adapts an Allocator to the standard containers.  a default constructed one uses the default allocator.
+template <typename T>
+class StlAllocator
+{
+public:
+    typedef T value_type;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+
+    StlAllocator() : m_allocator(&GetDefaultAllocator()) {}
+    StlAllocator(Allocator& allocator) : m_allocator(&allocator) {}
+    template <typename U> StlAllocator(const StlAllocator<U>& rhs) : m_allocator(&rhs.GetAllocator()) {}
+
+    T* allocate(size_t n) { return (T*)m_allocator->Allocate(n * sizeof(T), alignof(T)); }
+    void deallocate(T* ptr, size_t) { m_allocator->Free(ptr); }
+
+    Allocator& GetAllocator() const { return *m_allocator; }
+    template <typename U> bool operator==(const StlAllocator<U>& rhs) const { return m_allocator == &rhs.GetAllocator(); }
+    template <typename U> bool operator!=(const StlAllocator<U>& rhs) const { return m_allocator != &rhs.GetAllocator(); }
+
+private:
+    Allocator* m_allocator;
+};
+
+template <typename T> using Vector = std::vector<T, StlAllocator<T>>;
+template <typename K, typename T> using Map = std::map<K, T, std::less<K>, StlAllocator<std::pair<const K, T>>>;
+typedef std::basic_string<char, std::char_traits<char>, StlAllocator<char>> String;
+
+// deleters for memory that came from an Allocator.
+struct AllocatorFree
+{
+    AllocatorFree() : allocator(nullptr) {}
+    AllocatorFree(Allocator* allocatorIn) : allocator(allocatorIn) {}
+    void operator()(void* ptr) const { allocator->Free(ptr); }
+    Allocator* allocator;
+};
+
+template <typename T>
+struct AllocatorDelete
+{
+    AllocatorDelete() : allocator(nullptr) {}
+    AllocatorDelete(Allocator* allocatorIn) : allocator(allocatorIn) {}
+    void operator()(T* ptr) const
+    {
+        ptr->~T();
+        allocator->Free(ptr);
+    }
+    Allocator* allocator;
+};
+
+// images & other raw bytes.
+typedef std::unique_ptr<uint8_t[], AllocatorFree> ByteBuffer;
+
+inline ByteBuffer AllocateBytes(Allocator& allocator, size_t size)
+{
+    return ByteBuffer((uint8_t*)allocator.Allocate(size, 1), AllocatorFree{&allocator});
+}
+
+// the Allocator equivalent of new T(args...).
+template <typename T, typename... Args>
+std::unique_ptr<T, AllocatorDelete<T>> AllocateUnique(Allocator& allocator, Args&&... args)
+{
+    void* ptr = allocator.Allocate(sizeof(T), alignof(T));
+    return std::unique_ptr<T, AllocatorDelete<T>>(new (ptr) T(std::forward<Args>(args)...), AllocatorDelete<T>{&allocator});
+}
+
+} // namespace gb
+
+#endif // GB_ALLOCATOR_H
@@ -0,0 +1,716 @@
+#include <algorithm>
+#include "bidi.h"
+
+namespace gb {
+
+#define L BidiClass_L
+#define R BidiClass_R
+#define AL BidiClass_AL
+#define EN BidiClass_EN
+#define ES BidiClass_ES
+#define ET BidiClass_ET
+#define AN BidiClass_AN
+#define CS BidiClass_CS
+#define NSM BidiClass_NSM
+#define BN BidiClass_BN
+#define B BidiClass_B
+#define S BidiClass_S
+#define WS BidiClass_WS
+#define ON BidiClass_ON
+#define LRE BidiClass_LRE
+#define LRO BidiClass_LRO
+#define RLE BidiClass_RLE
+#define RLO BidiClass_RLO
+#define PDF BidiClass_PDF
+#define LRI BidiClass_LRI
+#define RLI BidiClass_RLI
+#define FSI BidiClass_FSI
+#define PDI BidiClass_PDI
+
+static const uint8_t s_asciiClassTable[128] = {
+    BN, BN, BN, BN, BN, BN, BN, BN, BN, S, B, S, WS, B, BN, BN,
+    BN, BN, BN, BN, BN, BN, BN, BN, BN, BN, BN, BN, B, B, B, S,
+    WS, ON, ON, ET, ET, ET, ON, ON, ON, ON, ON, ES, CS, ES, CS, CS,
+    EN, EN, EN, EN, EN, EN, EN, EN, EN, EN, CS, ON, ON, ON, ON, ON,
+    ON, L, L, L, L, L, L, L, L, L, L, L, L, L, L, L,
+    L, L, L, L, L, L, L, L, L, L, L, ON, ON, ON, ON, ON,
+    ON, L, L, L, L, L, L, L, L, L, L, L, L, L, L, L,
+    L, L, L, L, L, L, L, L, L, L, L, ON, ON, ON, ON, BN,
+};
+
+struct BidiRange
+{
+    uint32_t first;
+    uint32_t last;
+    uint8_t bidiClass;
+};
+
+// sorted, generated from the bidi classes in UnicodeData.txt 14.0, with the defaults of
+// DerivedBidiClass.txt for unassigned code points.  code points not covered are L.
+static const BidiRange s_classRangeTable[] = {
+    {0x00080, 0x00084, BN}, {0x00085, 0x00085, B}, {0x00086, 0x0009f, BN}, {0x000a0, 0x000a0, CS},
+    {0x000a1, 0x000a1, ON}, {0x000a2, 0x000a5, ET}, {0x000a6, 0x000a9, ON}, {0x000ab, 0x000ac, ON},
+    {0x000ad, 0x000ad, BN}, {0x000ae, 0x000af, ON}, {0x000b0, 0x000b1, ET}, {0x000b2, 0x000b3, EN},
+    {0x000b4, 0x000b4, ON}, {0x000b6, 0x000b8, ON}, {0x000b9, 0x000b9, EN}, {0x000bb, 0x000bf, ON},
+    {0x000d7, 0x000d7, ON}, {0x000f7, 0x000f7, ON}, {0x002b9, 0x002ba, ON}, {0x002c2, 0x002cf, ON},
+    {0x002d2, 0x002df, ON}, {0x002e5, 0x002ed, ON}, {0x002ef, 0x002ff, ON}, {0x00300, 0x0036f, NSM},
+    {0x00374, 0x00375, ON}, {0x0037e, 0x0037e, ON}, {0x00384, 0x00385, ON}, {0x00387, 0x00387, ON},
+    {0x003f6, 0x003f6, ON}, {0x00483, 0x00489, NSM}, {0x0058a, 0x0058a, ON}, {0x0058d, 0x0058e, ON},
+    {0x0058f, 0x0058f, ET}, {0x00590, 0x00590, R}, {0x00591, 0x005bd, NSM}, {0x005be, 0x005be, R},
+    {0x005bf, 0x005bf, NSM}, {0x005c0, 0x005c0, R}, {0x005c1, 0x005c2, NSM}, {0x005c3, 0x005c3, R},
+    {0x005c4, 0x005c5, NSM}, {0x005c6, 0x005c6, R}, {0x005c7, 0x005c7, NSM}, {0x005c8, 0x005ff, R},
+    {0x00600, 0x00605, AN}, {0x00606, 0x00607, ON}, {0x00608, 0x00608, AL}, {0x00609, 0x0060a, ET},
+    {0x0060b, 0x0060b, AL}, {0x0060c, 0x0060c, CS}, {0x0060d, 0x0060d, AL}, {0x0060e, 0x0060f, ON},
+    {0x00610, 0x0061a, NSM}, {0x0061b, 0x0064a, AL}, {0x0064b, 0x0065f, NSM}, {0x00660, 0x00669, AN},
+    {0x0066a, 0x0066a, ET}, {0x0066b, 0x0066c, AN}, {0x0066d, 0x0066f, AL}, {0x00670, 0x00670, NSM},
+    {0x00671, 0x006d5, AL}, {0x006d6, 0x006dc, NSM}, {0x006dd, 0x006dd, AN}, {0x006de, 0x006de, ON},
+    {0x006df, 0x006e4, NSM}, {0x006e5, 0x006e6, AL}, {0x006e7, 0x006e8, NSM}, {0x006e9, 0x006e9, ON},
+    {0x006ea, 0x006ed, NSM}, {0x006ee, 0x006ef, AL}, {0x006f0, 0x006f9, EN}, {0x006fa, 0x00710, AL},
+    {0x00711, 0x00711, NSM}, {0x00712, 0x0072f, AL}, {0x00730, 0x0074a, NSM}, {0x0074b, 0x007a5, AL},
+    {0x007a6, 0x007b0, NSM}, {0x007b1, 0x007bf, AL}, {0x007c0, 0x007ea, R}, {0x007eb, 0x007f3, NSM},
+    {0x007f4, 0x007f5, R}, {0x007f6, 0x007f9, ON}, {0x007fa, 0x007fc, R}, {0x007fd, 0x007fd, NSM},
+    {0x007fe, 0x00815, R}, {0x00816, 0x00819, NSM}, {0x0081a, 0x0081a, R}, {0x0081b, 0x00823, NSM},
+    {0x00824, 0x00824, R}, {0x00825, 0x00827, NSM}, {0x00828, 0x00828, R}, {0x00829, 0x0082d, NSM},
+    {0x0082e, 0x00858, R}, {0x00859, 0x0085b, NSM}, {0x0085c, 0x0085f, R}, {0x00860, 0x0088f, AL},
+    {0x00890, 0x00891, AN}, {0x00892, 0x00897, AL}, {0x00898, 0x0089f, NSM}, {0x008a0, 0x008c9, AL},
+    {0x008ca, 0x008e1, NSM}, {0x008e2, 0x008e2, AN}, {0x008e3, 0x00902, NSM}, {0x0093a, 0x0093a, NSM},
+    {0x0093c, 0x0093c, NSM}, {0x00941, 0x00948, NSM}, {0x0094d, 0x0094d, NSM}, {0x00951, 0x00957, NSM},
+    {0x00962, 0x00963, NSM}, {0x00981, 0x00981, NSM}, {0x009bc, 0x009bc, NSM}, {0x009c1, 0x009c4, NSM},
+    {0x009cd, 0x009cd, NSM}, {0x009e2, 0x009e3, NSM}, {0x009f2, 0x009f3, ET}, {0x009fb, 0x009fb, ET},
+    {0x009fe, 0x009fe, NSM}, {0x00a01, 0x00a02, NSM}, {0x00a3c, 0x00a3c, NSM}, {0x00a41, 0x00a42, NSM},
+    {0x00a47, 0x00a48, NSM}, {0x00a4b, 0x00a4d, NSM}, {0x00a51, 0x00a51, NSM}, {0x00a70, 0x00a71, NSM},
+    {0x00a75, 0x00a75, NSM}, {0x00a81, 0x00a82, NSM}, {0x00abc, 0x00abc, NSM}, {0x00ac1, 0x00ac5, NSM},
+    {0x00ac7, 0x00ac8, NSM}, {0x00acd, 0x00acd, NSM}, {0x00ae2, 0x00ae3, NSM}, {0x00af1, 0x00af1, ET},
+    {0x00afa, 0x00aff, NSM}, {0x00b01, 0x00b01, NSM}, {0x00b3c, 0x00b3c, NSM}, {0x00b3f, 0x00b3f, NSM},
+    {0x00b41, 0x00b44, NSM}, {0x00b4d, 0x00b4d, NSM}, {0x00b55, 0x00b56, NSM}, {0x00b62, 0x00b63, NSM},
+    {0x00b82, 0x00b82, NSM}, {0x00bc0, 0x00bc0, NSM}, {0x00bcd, 0x00bcd, NSM}, {0x00bf3, 0x00bf8, ON},
+    {0x00bf9, 0x00bf9, ET}, {0x00bfa, 0x00bfa, ON}, {0x00c00, 0x00c00, NSM}, {0x00c04, 0x00c04, NSM},
+    {0x00c3c, 0x00c3c, NSM}, {0x00c3e, 0x00c40, NSM}, {0x00c46, 0x00c48, NSM}, {0x00c4a, 0x00c4d, NSM},
+    {0x00c55, 0x00c56, NSM}, {0x00c62, 0x00c63, NSM}, {0x00c78, 0x00c7e, ON}, {0x00c81, 0x00c81, NSM},
+    {0x00cbc, 0x00cbc, NSM}, {0x00ccc, 0x00ccd, NSM}, {0x00ce2, 0x00ce3, NSM}, {0x00d00, 0x00d01, NSM},
+    {0x00d3b, 0x00d3c, NSM}, {0x00d41, 0x00d44, NSM}, {0x00d4d, 0x00d4d, NSM}, {0x00d62, 0x00d63, NSM},
+    {0x00d81, 0x00d81, NSM}, {0x00dca, 0x00dca, NSM}, {0x00dd2, 0x00dd4, NSM}, {0x00dd6, 0x00dd6, NSM},
+    {0x00e31, 0x00e31, NSM}, {0x00e34, 0x00e3a, NSM}, {0x00e3f, 0x00e3f, ET}, {0x00e47, 0x00e4e, NSM},
+    {0x00eb1, 0x00eb1, NSM}, {0x00eb4, 0x00ebc, NSM}, {0x00ec8, 0x00ecd, NSM}, {0x00f18, 0x00f19, NSM},
+    {0x00f35, 0x00f35, NSM}, {0x00f37, 0x00f37, NSM}, {0x00f39, 0x00f39, NSM}, {0x00f3a, 0x00f3d, ON},
+    {0x00f71, 0x00f7e, NSM}, {0x00f80, 0x00f84, NSM}, {0x00f86, 0x00f87, NSM}, {0x00f8d, 0x00f97, NSM},
+    {0x00f99, 0x00fbc, NSM}, {0x00fc6, 0x00fc6, NSM}, {0x0102d, 0x01030, NSM}, {0x01032, 0x01037, NSM},
+    {0x01039, 0x0103a, NSM}, {0x0103d, 0x0103e, NSM}, {0x01058, 0x01059, NSM}, {0x0105e, 0x01060, NSM},
+    {0x01071, 0x01074, NSM}, {0x01082, 0x01082, NSM}, {0x01085, 0x01086, NSM}, {0x0108d, 0x0108d, NSM},
+    {0x0109d, 0x0109d, NSM}, {0x0135d, 0x0135f, NSM}, {0x01390, 0x01399, ON}, {0x01400, 0x01400, ON},
+    {0x01680, 0x01680, WS}, {0x0169b, 0x0169c, ON}, {0x01712, 0x01714, NSM}, {0x01732, 0x01733, NSM},
+    {0x01752, 0x01753, NSM}, {0x01772, 0x01773, NSM}, {0x017b4, 0x017b5, NSM}, {0x017b7, 0x017bd, NSM},
+    {0x017c6, 0x017c6, NSM}, {0x017c9, 0x017d3, NSM}, {0x017db, 0x017db, ET}, {0x017dd, 0x017dd, NSM},
+    {0x017f0, 0x017f9, ON}, {0x01800, 0x0180a, ON}, {0x0180b, 0x0180d, NSM}, {0x0180e, 0x0180e, BN},
+    {0x0180f, 0x0180f, NSM}, {0x01885, 0x01886, NSM}, {0x018a9, 0x018a9, NSM}, {0x01920, 0x01922, NSM},
+    {0x01927, 0x01928, NSM}, {0x01932, 0x01932, NSM}, {0x01939, 0x0193b, NSM}, {0x01940, 0x01940, ON},
+    {0x01944, 0x01945, ON}, {0x019de, 0x019ff, ON}, {0x01a17, 0x01a18, NSM}, {0x01a1b, 0x01a1b, NSM},
+    {0x01a56, 0x01a56, NSM}, {0x01a58, 0x01a5e, NSM}, {0x01a60, 0x01a60, NSM}, {0x01a62, 0x01a62, NSM},
+    {0x01a65, 0x01a6c, NSM}, {0x01a73, 0x01a7c, NSM}, {0x01a7f, 0x01a7f, NSM}, {0x01ab0, 0x01ace, NSM},
+    {0x01b00, 0x01b03, NSM}, {0x01b34, 0x01b34, NSM}, {0x01b36, 0x01b3a, NSM}, {0x01b3c, 0x01b3c, NSM},
+    {0x01b42, 0x01b42, NSM}, {0x01b6b, 0x01b73, NSM}, {0x01b80, 0x01b81, NSM}, {0x01ba2, 0x01ba5, NSM},
+    {0x01ba8, 0x01ba9, NSM}, {0x01bab, 0x01bad, NSM}, {0x01be6, 0x01be6, NSM}, {0x01be8, 0x01be9, NSM},
+    {0x01bed, 0x01bed, NSM}, {0x01bef, 0x01bf1, NSM}, {0x01c2c, 0x01c33, NSM}, {0x01c36, 0x01c37, NSM},
+    {0x01cd0, 0x01cd2, NSM}, {0x01cd4, 0x01ce0, NSM}, {0x01ce2, 0x01ce8, NSM}, {0x01ced, 0x01ced, NSM},
+    {0x01cf4, 0x01cf4, NSM}, {0x01cf8, 0x01cf9, NSM}, {0x01dc0, 0x01dff, NSM}, {0x01fbd, 0x01fbd, ON},
+    {0x01fbf, 0x01fc1, ON}, {0x01fcd, 0x01fcf, ON}, {0x01fdd, 0x01fdf, ON}, {0x01fed, 0x01fef, ON},
+    {0x01ffd, 0x01ffe, ON}, {0x02000, 0x0200a, WS}, {0x0200b, 0x0200d, BN}, {0x0200f, 0x0200f, R},
+    {0x02010, 0x02027, ON}, {0x02028, 0x02028, WS}, {0x02029, 0x02029, B}, {0x0202a, 0x0202a, LRE},
+    {0x0202b, 0x0202b, RLE}, {0x0202c, 0x0202c, PDF}, {0x0202d, 0x0202d, LRO}, {0x0202e, 0x0202e, RLO},
+    {0x0202f, 0x0202f, CS}, {0x02030, 0x02034, ET}, {0x02035, 0x02043, ON}, {0x02044, 0x02044, CS},
+    {0x02045, 0x0205e, ON}, {0x0205f, 0x0205f, WS}, {0x02060, 0x02065, BN}, {0x02066, 0x02066, LRI},
+    {0x02067, 0x02067, RLI}, {0x02068, 0x02068, FSI}, {0x02069, 0x02069, PDI}, {0x0206a, 0x0206f, BN},
+    {0x02070, 0x02070, EN}, {0x02074, 0x02079, EN}, {0x0207a, 0x0207b, ES}, {0x0207c, 0x0207e, ON},
+    {0x02080, 0x02089, EN}, {0x0208a, 0x0208b, ES}, {0x0208c, 0x0208e, ON}, {0x020a0, 0x020cf, ET},
+    {0x020d0, 0x020f0, NSM}, {0x02100, 0x02101, ON}, {0x02103, 0x02106, ON}, {0x02108, 0x02109, ON},
+    {0x02114, 0x02114, ON}, {0x02116, 0x02118, ON}, {0x0211e, 0x02123, ON}, {0x02125, 0x02125, ON},
+    {0x02127, 0x02127, ON}, {0x02129, 0x02129, ON}, {0x0212e, 0x0212e, ET}, {0x0213a, 0x0213b, ON},
+    {0x02140, 0x02144, ON}, {0x0214a, 0x0214d, ON}, {0x02150, 0x0215f, ON}, {0x02189, 0x0218b, ON},
+    {0x02190, 0x02211, ON}, {0x02212, 0x02212, ES}, {0x02213, 0x02213, ET}, {0x02214, 0x02335, ON},
+    {0x0237b, 0x02394, ON}, {0x02396, 0x02426, ON}, {0x02440, 0x0244a, ON}, {0x02460, 0x02487, ON},
+    {0x02488, 0x0249b, EN}, {0x024ea, 0x026ab, ON}, {0x026ad, 0x027ff, ON}, {0x02900, 0x02b73, ON},
+    {0x02b76, 0x02b95, ON}, {0x02b97, 0x02bff, ON}, {0x02ce5, 0x02cea, ON}, {0x02cef, 0x02cf1, NSM},
+    {0x02cf9, 0x02cff, ON}, {0x02d7f, 0x02d7f, NSM}, {0x02de0, 0x02dff, NSM}, {0x02e00, 0x02e5d, ON},
+    {0x02e80, 0x02e99, ON}, {0x02e9b, 0x02ef3, ON}, {0x02f00, 0x02fd5, ON}, {0x02ff0, 0x02ffb, ON},
+    {0x03000, 0x03000, WS}, {0x03001, 0x03004, ON}, {0x03008, 0x03020, ON}, {0x0302a, 0x0302d, NSM},
+    {0x03030, 0x03030, ON}, {0x03036, 0x03037, ON}, {0x0303d, 0x0303f, ON}, {0x03099, 0x0309a, NSM},
+    {0x0309b, 0x0309c, ON}, {0x030a0, 0x030a0, ON}, {0x030fb, 0x030fb, ON}, {0x031c0, 0x031e3, ON},
+    {0x0321d, 0x0321e, ON}, {0x03250, 0x0325f, ON}, {0x0327c, 0x0327e, ON}, {0x032b1, 0x032bf, ON},
+    {0x032cc, 0x032cf, ON}, {0x03377, 0x0337a, ON}, {0x033de, 0x033df, ON}, {0x033ff, 0x033ff, ON},
+    {0x04dc0, 0x04dff, ON}, {0x0a490, 0x0a4c6, ON}, {0x0a60d, 0x0a60f, ON}, {0x0a66f, 0x0a672, NSM},
+    {0x0a673, 0x0a673, ON}, {0x0a674, 0x0a67d, NSM}, {0x0a67e, 0x0a67f, ON}, {0x0a69e, 0x0a69f, NSM},
+    {0x0a6f0, 0x0a6f1, NSM}, {0x0a700, 0x0a721, ON}, {0x0a788, 0x0a788, ON}, {0x0a802, 0x0a802, NSM},
+    {0x0a806, 0x0a806, NSM}, {0x0a80b, 0x0a80b, NSM}, {0x0a825, 0x0a826, NSM}, {0x0a828, 0x0a82b, ON},
+    {0x0a82c, 0x0a82c, NSM}, {0x0a838, 0x0a839, ET}, {0x0a874, 0x0a877, ON}, {0x0a8c4, 0x0a8c5, NSM},
+    {0x0a8e0, 0x0a8f1, NSM}, {0x0a8ff, 0x0a8ff, NSM}, {0x0a926, 0x0a92d, NSM}, {0x0a947, 0x0a951, NSM},
+    {0x0a980, 0x0a982, NSM}, {0x0a9b3, 0x0a9b3, NSM}, {0x0a9b6, 0x0a9b9, NSM}, {0x0a9bc, 0x0a9bd, NSM},
+    {0x0a9e5, 0x0a9e5, NSM}, {0x0aa29, 0x0aa2e, NSM}, {0x0aa31, 0x0aa32, NSM}, {0x0aa35, 0x0aa36, NSM},
+    {0x0aa43, 0x0aa43, NSM}, {0x0aa4c, 0x0aa4c, NSM}, {0x0aa7c, 0x0aa7c, NSM}, {0x0aab0, 0x0aab0, NSM},
+    {0x0aab2, 0x0aab4, NSM}, {0x0aab7, 0x0aab8, NSM}, {0x0aabe, 0x0aabf, NSM}, {0x0aac1, 0x0aac1, NSM},
+    {0x0aaec, 0x0aaed, NSM}, {0x0aaf6, 0x0aaf6, NSM}, {0x0ab6a, 0x0ab6b, ON}, {0x0abe5, 0x0abe5, NSM},
+    {0x0abe8, 0x0abe8, NSM}, {0x0abed, 0x0abed, NSM}, {0x0fb1d, 0x0fb1d, R}, {0x0fb1e, 0x0fb1e, NSM},
+    {0x0fb1f, 0x0fb28, R}, {0x0fb29, 0x0fb29, ES}, {0x0fb2a, 0x0fb4f, R}, {0x0fb50, 0x0fd3d, AL},
+    {0x0fd3e, 0x0fd4f, ON}, {0x0fd50, 0x0fdce, AL}, {0x0fdcf, 0x0fdcf, ON}, {0x0fdd0, 0x0fdef, BN},
+    {0x0fdf0, 0x0fdfc, AL}, {0x0fdfd, 0x0fdff, ON}, {0x0fe00, 0x0fe0f, NSM}, {0x0fe10, 0x0fe19, ON},
+    {0x0fe20, 0x0fe2f, NSM}, {0x0fe30, 0x0fe4f, ON}, {0x0fe50, 0x0fe50, CS}, {0x0fe51, 0x0fe51, ON},
+    {0x0fe52, 0x0fe52, CS}, {0x0fe54, 0x0fe54, ON}, {0x0fe55, 0x0fe55, CS}, {0x0fe56, 0x0fe5e, ON},
+    {0x0fe5f, 0x0fe5f, ET}, {0x0fe60, 0x0fe61, ON}, {0x0fe62, 0x0fe63, ES}, {0x0fe64, 0x0fe66, ON},
+    {0x0fe68, 0x0fe68, ON}, {0x0fe69, 0x0fe6a, ET}, {0x0fe6b, 0x0fe6b, ON}, {0x0fe70, 0x0fefe, AL},
+    {0x0feff, 0x0feff, BN}, {0x0ff01, 0x0ff02, ON}, {0x0ff03, 0x0ff05, ET}, {0x0ff06, 0x0ff0a, ON},
+    {0x0ff0b, 0x0ff0b, ES}, {0x0ff0c, 0x0ff0c, CS}, {0x0ff0d, 0x0ff0d, ES}, {0x0ff0e, 0x0ff0f, CS},
+    {0x0ff10, 0x0ff19, EN}, {0x0ff1a, 0x0ff1a, CS}, {0x0ff1b, 0x0ff20, ON}, {0x0ff3b, 0x0ff40, ON},
+    {0x0ff5b, 0x0ff65, ON}, {0x0ffe0, 0x0ffe1, ET}, {0x0ffe2, 0x0ffe4, ON}, {0x0ffe5, 0x0ffe6, ET},
+    {0x0ffe8, 0x0ffee, ON}, {0x0fff0, 0x0fff8, BN}, {0x0fff9, 0x0fffd, ON}, {0x0fffe, 0x0ffff, BN},
+    {0x10101, 0x10101, ON}, {0x10140, 0x1018c, ON}, {0x10190, 0x1019c, ON}, {0x101a0, 0x101a0, ON},
+    {0x101fd, 0x101fd, NSM}, {0x102e0, 0x102e0, NSM}, {0x102e1, 0x102fb, EN}, {0x10376, 0x1037a, NSM},
+    {0x10800, 0x1091e, R}, {0x1091f, 0x1091f, ON}, {0x10920, 0x10a00, R}, {0x10a01, 0x10a03, NSM},
+    {0x10a04, 0x10a04, R}, {0x10a05, 0x10a06, NSM}, {0x10a07, 0x10a0b, R}, {0x10a0c, 0x10a0f, NSM},
+    {0x10a10, 0x10a37, R}, {0x10a38, 0x10a3a, NSM}, {0x10a3b, 0x10a3e, R}, {0x10a3f, 0x10a3f, NSM},
+    {0x10a40, 0x10ae4, R}, {0x10ae5, 0x10ae6, NSM}, {0x10ae7, 0x10b38, R}, {0x10b39, 0x10b3f, ON},
+    {0x10b40, 0x10cff, R}, {0x10d00, 0x10d23, AL}, {0x10d24, 0x10d27, NSM}, {0x10d28, 0x10d2f, AL},
+    {0x10d30, 0x10d39, AN}, {0x10d3a, 0x10d3f, AL}, {0x10d40, 0x10e5f, R}, {0x10e60, 0x10e7e, AN},
+    {0x10e7f, 0x10eaa, R}, {0x10eab, 0x10eac, NSM}, {0x10ead, 0x10ebf, R}, {0x10ec0, 0x10eff, AL},
+    {0x10f00, 0x10f2f, R}, {0x10f30, 0x10f45, AL}, {0x10f46, 0x10f50, NSM}, {0x10f51, 0x10f6f, AL},
+    {0x10f70, 0x10f81, R}, {0x10f82, 0x10f85, NSM}, {0x10f86, 0x10fff, R}, {0x11001, 0x11001, NSM},
+    {0x11038, 0x11046, NSM}, {0x11052, 0x11065, ON}, {0x11070, 0x11070, NSM}, {0x11073, 0x11074, NSM},
+    {0x1107f, 0x11081, NSM}, {0x110b3, 0x110b6, NSM}, {0x110b9, 0x110ba, NSM}, {0x110c2, 0x110c2, NSM},
+    {0x11100, 0x11102, NSM}, {0x11127, 0x1112b, NSM}, {0x1112d, 0x11134, NSM}, {0x11173, 0x11173, NSM},
+    {0x11180, 0x11181, NSM}, {0x111b6, 0x111be, NSM}, {0x111c9, 0x111cc, NSM}, {0x111cf, 0x111cf, NSM},
+    {0x1122f, 0x11231, NSM}, {0x11234, 0x11234, NSM}, {0x11236, 0x11237, NSM}, {0x1123e, 0x1123e, NSM},
+    {0x112df, 0x112df, NSM}, {0x112e3, 0x112ea, NSM}, {0x11300, 0x11301, NSM}, {0x1133b, 0x1133c, NSM},
+    {0x11340, 0x11340, NSM}, {0x11366, 0x1136c, NSM}, {0x11370, 0x11374, NSM}, {0x11438, 0x1143f, NSM},
+    {0x11442, 0x11444, NSM}, {0x11446, 0x11446, NSM}, {0x1145e, 0x1145e, NSM}, {0x114b3, 0x114b8, NSM},
+    {0x114ba, 0x114ba, NSM}, {0x114bf, 0x114c0, NSM}, {0x114c2, 0x114c3, NSM}, {0x115b2, 0x115b5, NSM},
+    {0x115bc, 0x115bd, NSM}, {0x115bf, 0x115c0, NSM}, {0x115dc, 0x115dd, NSM}, {0x11633, 0x1163a, NSM},
+    {0x1163d, 0x1163d, NSM}, {0x1163f, 0x11640, NSM}, {0x11660, 0x1166c, ON}, {0x116ab, 0x116ab, NSM},
+    {0x116ad, 0x116ad, NSM}, {0x116b0, 0x116b5, NSM}, {0x116b7, 0x116b7, NSM}, {0x1171d, 0x1171f, NSM},
+    {0x11722, 0x11725, NSM}, {0x11727, 0x1172b, NSM}, {0x1182f, 0x11837, NSM}, {0x11839, 0x1183a, NSM},
+    {0x1193b, 0x1193c, NSM}, {0x1193e, 0x1193e, NSM}, {0x11943, 0x11943, NSM}, {0x119d4, 0x119d7, NSM},
+    {0x119da, 0x119db, NSM}, {0x119e0, 0x119e0, NSM}, {0x11a01, 0x11a06, NSM}, {0x11a09, 0x11a0a, NSM},
+    {0x11a33, 0x11a38, NSM}, {0x11a3b, 0x11a3e, NSM}, {0x11a47, 0x11a47, NSM}, {0x11a51, 0x11a56, NSM},
+    {0x11a59, 0x11a5b, NSM}, {0x11a8a, 0x11a96, NSM}, {0x11a98, 0x11a99, NSM}, {0x11c30, 0x11c36, NSM},
+    {0x11c38, 0x11c3d, NSM}, {0x11c92, 0x11ca7, NSM}, {0x11caa, 0x11cb0, NSM}, {0x11cb2, 0x11cb3, NSM},
+    {0x11cb5, 0x11cb6, NSM}, {0x11d31, 0x11d36, NSM}, {0x11d3a, 0x11d3a, NSM}, {0x11d3c, 0x11d3d, NSM},
+    {0x11d3f, 0x11d45, NSM}, {0x11d47, 0x11d47, NSM}, {0x11d90, 0x11d91, NSM}, {0x11d95, 0x11d95, NSM},
+    {0x11d97, 0x11d97, NSM}, {0x11ef3, 0x11ef4, NSM}, {0x11fd5, 0x11fdc, ON}, {0x11fdd, 0x11fe0, ET},
+    {0x11fe1, 0x11ff1, ON}, {0x16af0, 0x16af4, NSM}, {0x16b30, 0x16b36, NSM}, {0x16f4f, 0x16f4f, NSM},
+    {0x16f8f, 0x16f92, NSM}, {0x16fe2, 0x16fe2, ON}, {0x16fe4, 0x16fe4, NSM}, {0x1bc9d, 0x1bc9e, NSM},
+    {0x1bca0, 0x1bca3, BN}, {0x1cf00, 0x1cf2d, NSM}, {0x1cf30, 0x1cf46, NSM}, {0x1d167, 0x1d169, NSM},
+    {0x1d173, 0x1d17a, BN}, {0x1d17b, 0x1d182, NSM}, {0x1d185, 0x1d18b, NSM}, {0x1d1aa, 0x1d1ad, NSM},
+    {0x1d1e9, 0x1d1ea, ON}, {0x1d200, 0x1d241, ON}, {0x1d242, 0x1d244, NSM}, {0x1d245, 0x1d245, ON},
+    {0x1d300, 0x1d356, ON}, {0x1d6db, 0x1d6db, ON}, {0x1d715, 0x1d715, ON}, {0x1d74f, 0x1d74f, ON},
+    {0x1d789, 0x1d789, ON}, {0x1d7c3, 0x1d7c3, ON}, {0x1d7ce, 0x1d7ff, EN}, {0x1da00, 0x1da36, NSM},
+    {0x1da3b, 0x1da6c, NSM}, {0x1da75, 0x1da75, NSM}, {0x1da84, 0x1da84, NSM}, {0x1da9b, 0x1da9f, NSM},
+    {0x1daa1, 0x1daaf, NSM}, {0x1e000, 0x1e006, NSM}, {0x1e008, 0x1e018, NSM}, {0x1e01b, 0x1e021, NSM},
+    {0x1e023, 0x1e024, NSM}, {0x1e026, 0x1e02a, NSM}, {0x1e130, 0x1e136, NSM}, {0x1e2ae, 0x1e2ae, NSM},
+    {0x1e2ec, 0x1e2ef, NSM}, {0x1e2ff, 0x1e2ff, ET}, {0x1e800, 0x1e8cf, R}, {0x1e8d0, 0x1e8d6, NSM},
+    {0x1e8d7, 0x1e943, R}, {0x1e944, 0x1e94a, NSM}, {0x1e94b, 0x1ec6f, R}, {0x1ec70, 0x1ecbf, AL},
+    {0x1ecc0, 0x1ecff, R}, {0x1ed00, 0x1ed4f, AL}, {0x1ed50, 0x1edff, R}, {0x1ee00, 0x1eeef, AL},
+    {0x1eef0, 0x1eef1, ON}, {0x1eef2, 0x1eeff, AL}, {0x1ef00, 0x1efff, R}, {0x1f000, 0x1f02b, ON},
+    {0x1f030, 0x1f093, ON}, {0x1f0a0, 0x1f0ae, ON}, {0x1f0b1, 0x1f0bf, ON}, {0x1f0c1, 0x1f0cf, ON},
+    {0x1f0d1, 0x1f0f5, ON}, {0x1f100, 0x1f10a, EN}, {0x1f10b, 0x1f10f, ON}, {0x1f12f, 0x1f12f, ON},
+    {0x1f16a, 0x1f16f, ON}, {0x1f1ad, 0x1f1ad, ON}, {0x1f260, 0x1f265, ON}, {0x1f300, 0x1f6d7, ON},
+    {0x1f6dd, 0x1f6ec, ON}, {0x1f6f0, 0x1f6fc, ON}, {0x1f700, 0x1f773, ON}, {0x1f780, 0x1f7d8, ON},
+    {0x1f7e0, 0x1f7eb, ON}, {0x1f7f0, 0x1f7f0, ON}, {0x1f800, 0x1f80b, ON}, {0x1f810, 0x1f847, ON},
+    {0x1f850, 0x1f859, ON}, {0x1f860, 0x1f887, ON}, {0x1f890, 0x1f8ad, ON}, {0x1f8b0, 0x1f8b1, ON},
+    {0x1f900, 0x1fa53, ON}, {0x1fa60, 0x1fa6d, ON}, {0x1fa70, 0x1fa74, ON}, {0x1fa78, 0x1fa7c, ON},
+    {0x1fa80, 0x1fa86, ON}, {0x1fa90, 0x1faac, ON}, {0x1fab0, 0x1faba, ON}, {0x1fac0, 0x1fac5, ON},
+    {0x1fad0, 0x1fad9, ON}, {0x1fae0, 0x1fae7, ON}, {0x1faf0, 0x1faf6, ON}, {0x1fb00, 0x1fb92, ON},
+    {0x1fb94, 0x1fbca, ON}, {0x1fbf0, 0x1fbf9, EN}, {0x1fffe, 0x1ffff, BN}, {0x2fffe, 0x2ffff, BN},
+    {0x3fffe, 0x3ffff, BN}, {0x4fffe, 0x4ffff, BN}, {0x5fffe, 0x5ffff, BN}, {0x6fffe, 0x6ffff, BN},
+    {0x7fffe, 0x7ffff, BN}, {0x8fffe, 0x8ffff, BN}, {0x9fffe, 0x9ffff, BN}, {0xafffe, 0xaffff, BN},
+    {0xbfffe, 0xbffff, BN}, {0xcfffe, 0xcffff, BN}, {0xdfffe, 0xe00ff, BN}, {0xe0100, 0xe01ef, NSM},
+    {0xe01f0, 0xe0fff, BN}, {0xefffe, 0xeffff, BN}, {0xffffe, 0xfffff, BN}, {0x10fffe, 0x10ffff, BN},
+};
+
+#undef L
+#undef R
+#undef AL
+#undef EN
+#undef ES
+#undef ET
+#undef AN
+#undef CS
+#undef NSM
+#undef BN
+#undef B
+#undef S
+#undef WS
+#undef ON
+#undef LRE
+#undef LRO
+#undef RLE
+#undef RLO
+#undef PDF
+#undef LRI
+#undef RLI
+#undef FSI
+#undef PDI
+
+BidiClass GetBidiClass(uint32_t codePoint)
+{
+    if (codePoint < 128)
+        return (BidiClass)s_asciiClassTable[codePoint];
+
+    const BidiRange* begin = s_classRangeTable;
+    const BidiRange* end = begin + sizeof(s_classRangeTable) / sizeof(s_classRangeTable[0]);
+    const BidiRange* iter = std::upper_bound(begin, end, codePoint, [](uint32_t cp, const BidiRange& range)
+    {
+        return cp < range.first;
+    });
+    if (iter != begin && codePoint <= (iter - 1)->last)
+        return (BidiClass)(iter - 1)->bidiClass;
+    return BidiClass_L;
+}
+
+static bool IsStrongOrExplicit(BidiClass bidiClass)
+{
+    return bidiClass == BidiClass_R || bidiClass == BidiClass_AL || bidiClass == BidiClass_AN ||
+           bidiClass >= BidiClass_LRE;
+}
+
+static bool IsIsolateInitiator(BidiClass bidiClass)
+{
+    return bidiClass == BidiClass_LRI || bidiClass == BidiClass_RLI || bidiClass == BidiClass_FSI;
+}
+
+// neutral & isolate formatting characters, resolved by N1 & N2.
+static bool IsNeutral(BidiClass bidiClass)
+{
+    return bidiClass == BidiClass_B || bidiClass == BidiClass_S || bidiClass == BidiClass_WS ||
+           bidiClass == BidiClass_ON || bidiClass >= BidiClass_LRI;
+}
+
+// strong direction for N1, numbers count as right-to-left.
+static BidiClass StrongDirection(BidiClass bidiClass)
+{
+    return bidiClass == BidiClass_L ? BidiClass_L : BidiClass_R;
+}
+
+// P2 & P3 for an FSI, the direction of the first strong character before the matching PDI.
+static bool IsFirstStrongRightToLeft(const Vector<uint8_t>& classVec, size_t start)
+{
+    int depth = 0;
+    for (size_t i = start; i < classVec.size(); i++)
+    {
+        const BidiClass bidiClass = (BidiClass)classVec[i];
+        if (IsIsolateInitiator(bidiClass))
+            depth++;
+        else if (bidiClass == BidiClass_PDI && depth-- == 0)
+            break;
+        else if (depth == 0 && (bidiClass == BidiClass_L || bidiClass == BidiClass_R || bidiClass == BidiClass_AL))
+            return bidiClass != BidiClass_L;
+    }
+    return false;
+}
+
+// explicit levels & directions, X1 to X8.
+// explicit embedding characters are turned into BN, which the later rules skip (X9).
+static void ResolveExplicitLevels(Vector<uint8_t>& classVec, uint8_t baseLevel, Vector<uint8_t>& levelVec)
+{
+    const uint8_t kMaxDepth = 125;
+    struct Status
+    {
+        uint8_t level;
+        uint8_t override;  // BidiClass_L, BidiClass_R or BidiClass_ON for none.
+        bool isolate;
+    };
+    Vector<Status> stack(levelVec.get_allocator());
+    stack.reserve(kMaxDepth + 2);
+    stack.push_back(Status{baseLevel, BidiClass_ON, false});
+    int overflowIsolates = 0;
+    int overflowEmbeddings = 0;
+    int validIsolates = 0;
+
+    for (size_t i = 0; i < classVec.size(); i++)
+    {
+        BidiClass bidiClass = (BidiClass)classVec[i];
+        const Status& top = stack.back();
+        switch (bidiClass)
+        {
+        case BidiClass_RLE:
+        case BidiClass_LRE:
+        case BidiClass_RLO:
+        case BidiClass_LRO:
+        {
+            levelVec[i] = top.level;
+            classVec[i] = BidiClass_BN;
+            const bool rtl = bidiClass == BidiClass_RLE || bidiClass == BidiClass_RLO;
+            const uint8_t level = rtl ? (top.level + 1) | 1 : (top.level + 2) & ~1;
+            if (level <= kMaxDepth && overflowIsolates == 0 && overflowEmbeddings == 0)
+            {
+                uint8_t override = BidiClass_ON;
+                if (bidiClass == BidiClass_RLO)
+                    override = BidiClass_R;
+                else if (bidiClass == BidiClass_LRO)
+                    override = BidiClass_L;
+                stack.push_back(Status{level, override, false});
+            }
+            else if (overflowIsolates == 0)
+            {
+                overflowEmbeddings++;
+            }
+            break;
+        }
+        case BidiClass_RLI:
+        case BidiClass_LRI:
+        case BidiClass_FSI:
+        {
+            levelVec[i] = top.level;
+            if (top.override != BidiClass_ON)
+                classVec[i] = top.override;
+            bool rtl = bidiClass == BidiClass_RLI;
+            if (bidiClass == BidiClass_FSI)
+                rtl = IsFirstStrongRightToLeft(classVec, i + 1);
+            const uint8_t level = rtl ? (top.level + 1) | 1 : (top.level + 2) & ~1;
+            if (level <= kMaxDepth && overflowIsolates == 0 && overflowEmbeddings == 0)
+            {
+                validIsolates++;
+                stack.push_back(Status{level, BidiClass_ON, true});
+            }
+            else
+            {
+                overflowIsolates++;
+            }
+            break;
+        }
+        case BidiClass_PDI:
+            if (overflowIsolates > 0)
+            {
+                overflowIsolates--;
+            }
+            else if (validIsolates > 0)
+            {
+                overflowEmbeddings = 0;
+                while (!stack.back().isolate)
+                    stack.pop_back();
+                stack.pop_back();
+                validIsolates--;
+            }
+            levelVec[i] = stack.back().level;
+            if (stack.back().override != BidiClass_ON)
+                classVec[i] = stack.back().override;
+            break;
+        case BidiClass_PDF:
+            if (overflowIsolates > 0)
+            {
+            }
+            else if (overflowEmbeddings > 0)
+            {
+                overflowEmbeddings--;
+            }
+            else if (!stack.back().isolate && stack.size() > 1)
+            {
+                stack.pop_back();
+            }
+            levelVec[i] = stack.back().level;
+            classVec[i] = BidiClass_BN;
+            break;
+        case BidiClass_B:
+            levelVec[i] = baseLevel;
+            break;
+        case BidiClass_BN:
+            levelVec[i] = top.level;
+            break;
+        default:
+            levelVec[i] = top.level;
+            if (top.override != BidiClass_ON)
+                classVec[i] = top.override;
+            break;
+        }
+    }
+}
+
+// W1 to W7, N1, N2, I1 & I2 on one level run.  indices lists the characters of the run, without BNs.
+static void ResolveRun(Vector<uint8_t>& classVec, Vector<uint8_t>& levelVec, const Vector<uint32_t>& indices,
+                       size_t start, size_t end, BidiClass sos, BidiClass eos)
+{
+    auto type = [&](size_t k) -> uint8_t& { return classVec[indices[k]]; };
+    const uint8_t level = levelVec[indices[start]];
+
+    // W1, marks take the type of the character before them.
+    for (size_t k = start; k < end; k++)
+    {
+        if (type(k) == BidiClass_NSM)
+        {
+            if (k == start)
+                type(k) = sos;
+            else
+                type(k) = IsIsolateInitiator((BidiClass)type(k - 1)) || type(k - 1) == BidiClass_PDI ? BidiClass_ON : type(k - 1);
+        }
+    }
+
+    // W2 & W3, european numbers after arabic letters are arabic numbers.
+    BidiClass strong = sos;
+    for (size_t k = start; k < end; k++)
+    {
+        const BidiClass bidiClass = (BidiClass)type(k);
+        if (bidiClass == BidiClass_L || bidiClass == BidiClass_R || bidiClass == BidiClass_AL)
+            strong = bidiClass;
+        else if (bidiClass == BidiClass_EN && strong == BidiClass_AL)
+            type(k) = BidiClass_AN;
+    }
+    for (size_t k = start; k < end; k++)
+    {
+        if (type(k) == BidiClass_AL)
+            type(k) = BidiClass_R;
+    }
+
+    // W4, a single separator between two numbers of the same type joins them.
+    for (size_t k = start + 1; k + 1 < end; k++)
+    {
+        const BidiClass before = (BidiClass)type(k - 1);
+        const BidiClass after = (BidiClass)type(k + 1);
+        if (type(k) == BidiClass_ES && before == BidiClass_EN && after == BidiClass_EN)
+            type(k) = BidiClass_EN;
+        else if (type(k) == BidiClass_CS && before == after && (before == BidiClass_EN || before == BidiClass_AN))
+            type(k) = before;
+    }
+
+    // W5, terminators next to european numbers.
+    for (size_t k = start; k < end; )
+    {
+        if (type(k) != BidiClass_ET)
+        {
+            k++;
+            continue;
+        }
+        size_t runEnd = k;
+        while (runEnd < end && type(runEnd) == BidiClass_ET)
+            runEnd++;
+        if ((k > start && type(k - 1) == BidiClass_EN) || (runEnd < end && type(runEnd) == BidiClass_EN))
+        {
+            for (size_t j = k; j < runEnd; j++)
+                type(j) = BidiClass_EN;
+        }
+        k = runEnd;
+    }
+
+    // W6 & W7
+    strong = sos;
+    for (size_t k = start; k < end; k++)
+    {
+        BidiClass bidiClass = (BidiClass)type(k);
+        if (bidiClass == BidiClass_ES || bidiClass == BidiClass_ET || bidiClass == BidiClass_CS)
+            type(k) = BidiClass_ON;
+        else if (bidiClass == BidiClass_L || bidiClass == BidiClass_R)
+            strong = bidiClass;
+        else if (bidiClass == BidiClass_EN && strong == BidiClass_L)
+            type(k) = BidiClass_L;
+    }
+
+    // N1 & N2, neutrals between characters of the same direction take it, others take the embedding direction.
+    const BidiClass embedding = (level & 1) ? BidiClass_R : BidiClass_L;
+    for (size_t k = start; k < end; )
+    {
+        if (!IsNeutral((BidiClass)type(k)))
+        {
+            k++;
+            continue;
+        }
+        size_t runEnd = k;
+        while (runEnd < end && IsNeutral((BidiClass)type(runEnd)))
+            runEnd++;
+        const BidiClass before = k > start ? StrongDirection((BidiClass)type(k - 1)) : sos;
+        const BidiClass after = runEnd < end ? StrongDirection((BidiClass)type(runEnd)) : eos;
+        const BidiClass resolved = before == after ? before : embedding;
+        for (size_t j = k; j < runEnd; j++)
+            type(j) = resolved;
+        k = runEnd;
+    }
+
+    // I1 & I2
+    for (size_t k = start; k < end; k++)
+    {
+        const BidiClass bidiClass = (BidiClass)type(k);
+        uint8_t& l = levelVec[indices[k]];
+        if ((l & 1) == 0)
+        {
+            if (bidiClass == BidiClass_R)
+                l += 1;
+            else if (bidiClass == BidiClass_AN || bidiClass == BidiClass_EN)
+                l += 2;
+        }
+        else if (bidiClass == BidiClass_L || bidiClass == BidiClass_EN || bidiClass == BidiClass_AN)
+        {
+            l += 1;
+        }
+    }
+}
+
+bool ResolveBidiLevels(const uint32_t* codePoints, size_t count, uint8_t baseLevel, Vector<uint8_t>& levelVecOut)
+{
+    // left-to-right text without any right-to-left characters or formatting stays at level 0.
+    if (baseLevel == 0)
+    {
+        size_t i = 0;
+        while (i < count && (codePoints[i] < 0x590 || !IsStrongOrExplicit(GetBidiClass(codePoints[i]))))
+            i++;
+        if (i == count)
+            return false;
+    }
+
+    Vector<uint8_t> classVec(count, 0, levelVecOut.get_allocator());
+    for (size_t i = 0; i < count; i++)
+        classVec[i] = GetBidiClass(codePoints[i]);
+    const Vector<uint8_t> originalClassVec = classVec;
+
+    levelVecOut.resize(count);
+    ResolveExplicitLevels(classVec, baseLevel, levelVecOut);
+
+    // X10, split into level runs, ignoring BNs.
+    Vector<uint32_t> indices(levelVecOut.get_allocator());
+    indices.reserve(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        if (classVec[i] != BidiClass_BN)
+            indices.push_back((uint32_t)i);
+    }
+    for (size_t start = 0; start < indices.size(); )
+    {
+        const uint8_t level = levelVecOut[indices[start]];
+        size_t end = start + 1;
+        while (end < indices.size() && levelVecOut[indices[end]] == level)
+            end++;
+
+        // the start & end of a run take the direction of the higher level on either side of it.
+        const uint8_t before = start > 0 ? levelVecOut[indices[start - 1]] : baseLevel;
+        uint8_t after = end < indices.size() ? levelVecOut[indices[end]] : baseLevel;
+        if (IsIsolateInitiator((BidiClass)originalClassVec[indices[end - 1]]))
+            after = baseLevel;
+        const BidiClass sos = (std::max(before, level) & 1) ? BidiClass_R : BidiClass_L;
+        const BidiClass eos = (std::max(after, level) & 1) ? BidiClass_R : BidiClass_L;
+        ResolveRun(classVec, levelVecOut, indices, start, end, sos, eos);
+        start = end;
+    }
+
+    // removed characters take the level of the character before them, so they do not split runs.
+    for (size_t i = 0; i < count; i++)
+    {
+        if (classVec[i] == BidiClass_BN)
+            levelVecOut[i] = i > 0 ? levelVecOut[i - 1] : baseLevel;
+    }
+
+    // L1, separators & whitespace before them or at the end of the paragraph go back to the paragraph level.
+    bool trailing = true;
+    for (size_t i = count; i-- > 0; )
+    {
+        const BidiClass bidiClass = (BidiClass)originalClassVec[i];
+        if (bidiClass == BidiClass_S || bidiClass == BidiClass_B)
+        {
+            levelVecOut[i] = baseLevel;
+            trailing = true;
+        }
+        else if (bidiClass == BidiClass_WS || bidiClass == BidiClass_BN || IsIsolateInitiator(bidiClass) ||
+                 bidiClass == BidiClass_PDI || (bidiClass >= BidiClass_LRE && bidiClass <= BidiClass_PDF))
+        {
+            if (trailing)
+                levelVecOut[i] = baseLevel;
+        }
+        else
+        {
+            trailing = false;
+        }
+    }
+    return true;
+}
+
+void ReorderBidiLine(const uint8_t* levels, size_t count, Vector<uint32_t>& visualVecOut)
+{
+    visualVecOut.resize(count);
+    uint8_t highest = 0;
+    uint8_t lowestOdd = 0xff;
+    for (size_t i = 0; i < count; i++)
+    {
+        visualVecOut[i] = (uint32_t)i;
+        highest = std::max(highest, levels[i]);
+        if (levels[i] & 1)
+            lowestOdd = std::min(lowestOdd, levels[i]);
+    }
+
+    // from the highest level down to the lowest odd level, reverse every run at that level or higher.
+    for (int level = highest; level >= lowestOdd; level--)
+    {
+        for (size_t i = 0; i < count; )
+        {
+            if (levels[visualVecOut[i]] < level)
+            {
+                i++;
+                continue;
+            }
+            size_t end = i;
+            while (end < count && levels[visualVecOut[end]] >= level)
+                end++;
+            std::reverse(visualVecOut.begin() + i, visualVecOut.begin() + end);
+            i = end;
+        }
+    }
+}
+
+BidiRunCache::BidiRunCache(Allocator& allocator, size_t maxParagraphs, bool threadSafe) :
+    m_allocator(allocator),
+    m_runMap(0, std::hash<uint64_t>(), std::equal_to<uint64_t>(), allocator),
+    m_maxParagraphs(maxParagraphs),
+    m_levelVec(allocator),
+    m_threadSafe(threadSafe)
+{
+}
+
+void BidiRunCache::GetRuns(const uint32_t* codePoints, size_t count, uint8_t baseLevel, Vector<BidiRun>& runVecOut)
+{
+    runVecOut.clear();
+    if (count == 0)
+        return;
+
+    // FNV-1a over the code points, seeded with the length & level.
+    const uint64_t kPrime = 0x100000001b3ULL;
+    uint64_t key = (0xcbf29ce484222325ULL ^ ((uint64_t)count << 8 | baseLevel)) * kPrime;
+    bool simple = baseLevel == 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        key = (key ^ codePoints[i]) * kPrime;
+        simple = simple && codePoints[i] < 0x590;
+    }
+    if (simple)
+    {
+        runVecOut.push_back(BidiRun{0, 0});
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(m_mutex, std::defer_lock);
+    if (m_threadSafe)
+        lock.lock();
+    auto iter = m_runMap.find(key);
+    if (iter != m_runMap.end())
+    {
+        runVecOut = iter->second;
+        return;
+    }
+
+    // in thread-safe mode the paragraph is resolved without the lock, into levels of its own.
+    Vector<uint8_t> threadLevelVec(m_allocator);
+    Vector<uint8_t>& levelVec = m_threadSafe ? threadLevelVec : m_levelVec;
+    if (m_threadSafe)
+        lock.unlock();
+
+    if (!ResolveBidiLevels(codePoints, count, baseLevel, levelVec))
+    {
+        runVecOut.push_back(BidiRun{0, 0});
+        return;
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+        if (i == 0 || levelVec[i] != levelVec[i - 1])
+            runVecOut.push_back(BidiRun{(uint32_t)i, levelVec[i]});
+    }
+
+    if (m_threadSafe)
+        lock.lock();
+
+    // forget everything once full, paragraphs in use are quickly resolved again.
+    if (m_runMap.size() >= m_maxParagraphs)
+        m_runMap.clear();
+    m_runMap.emplace(key, Vector<BidiRun>(runVecOut, m_allocator));
+}
+
+} // namespace gb
@@ -0,0 +1,92 @@
+#ifndef GB_BIDI_H
+#define GB_BIDI_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include "glyphblaster.h"
+#include "allocator.h"
+
+namespace gb {
+
+// Bidirectional character types from UAX #9, http://www.unicode.org/reports/tr9/
+enum BidiClass {
+    BidiClass_L = 0,  // left-to-right
+    BidiClass_R,  // right-to-left
+    BidiClass_AL,  // arabic letter
+    BidiClass_EN,  // european number
+    BidiClass_ES,  // european separator
+    BidiClass_ET,  // european terminator
+    BidiClass_AN,  // arabic number
+    BidiClass_CS,  // common separator
+    BidiClass_NSM,  // nonspacing mark
+    BidiClass_BN,  // boundary neutral
+    BidiClass_B,  // paragraph separator
+    BidiClass_S,  // segment separator
+    BidiClass_WS,  // whitespace
+    BidiClass_ON,  // other neutral
+    BidiClass_LRE,  // left-to-right embedding
+    BidiClass_LRO,  // left-to-right override
+    BidiClass_RLE,  // right-to-left embedding
+    BidiClass_RLO,  // right-to-left override
+    BidiClass_PDF,  // pop directional format
+    BidiClass_LRI,  // left-to-right isolate
+    BidiClass_RLI,  // right-to-left isolate
+    BidiClass_FSI,  // first strong isolate
+    BidiClass_PDI,  // pop directional isolate
+    BidiClass_Count
+};
+
+BidiClass GetBidiClass(uint32_t codePoint);
+
+// Resolves the embedding level of each code point in a single paragraph, following UAX #9.
+// baseLevel is 0 for a left-to-right paragraph and 1 for right-to-left.
+// Returns false without touching levelVecOut when every level would be zero, which is the common case.
+//
+// Not implemented: bracket pairs (N0), and isolating run sequences that continue past an isolate,
+// each level run is resolved on its own.  Trailing whitespace is only reset at the end of the paragraph,
+// callers reset it at the end of each line after wrapping (L1).
+// temporaries come from the allocator of levelVecOut.
+bool ResolveBidiLevels(const uint32_t* codePoints, size_t count, uint8_t baseLevel, Vector<uint8_t>& levelVecOut);
+
+// Reorders one line for display (L2), reversing every run at or above each odd level.
+// visualVecOut[i] is the logical index of the i'th character from the left.
+void ReorderBidiLine(const uint8_t* levels, size_t count, Vector<uint32_t>& visualVecOut);
+
+// characters [start, next run's start) share the same embedding level.
+struct BidiRun
+{
+    uint32_t start;
+    uint32_t level;
+};
+
+// Remembers the runs of recently resolved paragraphs, so text that is re-created with most of its
+// paragraphs unchanged, as in an editor or a Document, skips the bidi pass for them.
+class BidiRunCache
+{
+public:
+    // if threadSafe is true, GetRuns() can be called from any thread.
+    BidiRunCache(Allocator& allocator, size_t maxParagraphs, bool threadSafe = false);
+
+    // fills runVecOut with the runs of a paragraph, including its newline.
+    void GetRuns(const uint32_t* codePoints, size_t count, uint8_t baseLevel, Vector<BidiRun>& runVecOut);
+
+protected:
+    // paragraphs without right-to-left text are one run, and are never stored.
+    typedef std::unordered_map<uint64_t, Vector<BidiRun>, std::hash<uint64_t>, std::equal_to<uint64_t>,
+                               StlAllocator<std::pair<const uint64_t, Vector<BidiRun>>>> RunMap;
+    Allocator& m_allocator;
+    RunMap m_runMap;
+    size_t m_maxParagraphs;
+    Vector<uint8_t> m_levelVec;
+    bool m_threadSafe;
+    std::mutex m_mutex;
+
+    GB_NO_COPY(BidiRunCache)
+};
+
+} // namespace gb
+
+#endif // GB_BIDI_H
@@ -0,0 +1,162 @@
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include "bundle.h"
+#include "texture.h"
+
+namespace gb {
+
+static const uint32_t kBundleMagic = 0x42414247;  // "GBAB"
+static const uint32_t kBundleVersion = 1;
+
+struct BundleHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t textureSize;
+    uint32_t textureFormat;
+    uint32_t numSheets;
+    uint32_t numFonts;
+    uint32_t numGlyphs;
+    uint32_t reserved;
+};
+
+static bool GlyphLess(const BundleGlyph& a, const BundleGlyph& b)
+{
+    return a.font != b.font ? a.font < b.font : a.glyphIndex < b.glyphIndex;
+}
+
+Bundle::Bundle(Allocator& allocator, const std::string& filename, bool useGL) :
+    m_valid(false),
+    m_textureSize(0),
+    m_textureFormat(TextureFormat_Alpha),
+    m_fonts(nullptr),
+    m_numFonts(0),
+    m_glyphs(nullptr),
+    m_numGlyphs(0),
+    m_textureVec(allocator)
+{
+    if (!m_mappedFile.Open(filename.c_str()))
+    {
+        fprintf(stderr, "Error loading bundle \"%s\"\n", filename.c_str());
+        return;
+    }
+
+    const uint8_t* data = m_mappedFile.GetData();
+    const size_t size = m_mappedFile.GetSize();
+    BundleHeader header;
+    if (size < sizeof(header))
+    {
+        fprintf(stderr, "Error: bundle \"%s\" is truncated\n", filename.c_str());
+        return;
+    }
+    memcpy(&header, data, sizeof(header));
+    if (header.magic != kBundleMagic || header.version != kBundleVersion)
+    {
+        fprintf(stderr, "Error: \"%s\" is not a compatible bundle\n", filename.c_str());
+        return;
+    }
+
+    const uint32_t pixelSize = header.textureFormat == TextureFormat_Alpha ? 1 : 4;
+    const size_t sheetSize = (size_t)header.textureSize * header.textureSize * pixelSize;
+    const size_t fontOffset = sizeof(header);
+    const size_t glyphOffset = fontOffset + header.numFonts * sizeof(BundleFont);
+    const size_t sheetOffset = glyphOffset + header.numGlyphs * sizeof(BundleGlyph);
+    if (sheetOffset + header.numSheets * sheetSize > size)
+    {
+        fprintf(stderr, "Error: bundle \"%s\" is truncated\n", filename.c_str());
+        return;
+    }
+
+    m_textureSize = header.textureSize;
+    m_textureFormat = (TextureFormat)header.textureFormat;
+    m_fonts = (const BundleFont*)(data + fontOffset);
+    m_numFonts = header.numFonts;
+    m_glyphs = (const BundleGlyph*)(data + glyphOffset);
+    m_numGlyphs = header.numGlyphs;
+
+    // sheet pixels are uploaded straight from the mapping.
+    for (uint32_t i = 0; i < header.numSheets; i++)
+    {
+        m_textureVec.push_back(AllocateUnique<Texture>(allocator, m_textureFormat, m_textureSize,
+                                                       data + sheetOffset + i * sheetSize, useGL, false, &allocator));
+    }
+    m_valid = true;
+}
+
+Bundle::~Bundle()
+{
+    ;
+}
+
+int Bundle::FindFont(uint64_t contentHash, uint32_t pointSize, uint32_t paddingBorder,
+                     FontRenderOption renderOption, FontHintOption hintOption) const
+{
+    for (uint32_t i = 0; i < m_numFonts; i++)
+    {
+        const BundleFont& font = m_fonts[i];
+        if (font.contentHash == contentHash && font.pointSize == pointSize &&
+            font.paddingBorder == paddingBorder && font.renderOption == (uint8_t)renderOption &&
+            font.hintOption == (uint8_t)hintOption)
+        {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+const BundleGlyph* Bundle::FindGlyph(uint32_t font, uint32_t glyphIndex) const
+{
+    BundleGlyph key;
+    key.font = font;
+    key.glyphIndex = glyphIndex;
+    const BundleGlyph* end = m_glyphs + m_numGlyphs;
+    const BundleGlyph* iter = std::lower_bound(m_glyphs, end, key, GlyphLess);
+    if (iter != end && iter->font == font && iter->glyphIndex == glyphIndex)
+        return iter;
+    else
+        return nullptr;
+}
+
+uint32_t Bundle::GetTexObj(uint32_t sheet) const
+{
+    return sheet < m_textureVec.size() ? m_textureVec[sheet]->GetTexObj() : 0;
+}
+
+bool Bundle::Write(const std::string& filename, uint32_t textureSize, TextureFormat textureFormat,
+                   const std::vector<BundleFont>& fontVec, std::vector<BundleGlyph> glyphVec,
+                   const std::vector<const uint8_t*>& sheetImageVec)
+{
+    FILE* fp = fopen(filename.c_str(), "wb");
+    if (!fp)
+    {
+        fprintf(stderr, "Error writing bundle \"%s\"\n", filename.c_str());
+        return false;
+    }
+
+    // sorted so glyphs can be found with a binary search.
+    std::sort(glyphVec.begin(), glyphVec.end(), GlyphLess);
+
+    BundleHeader header = {kBundleMagic, kBundleVersion, textureSize, (uint32_t)textureFormat,
+                           (uint32_t)sheetImageVec.size(), (uint32_t)fontVec.size(),
+                           (uint32_t)glyphVec.size(), 0};
+    const uint32_t pixelSize = textureFormat == TextureFormat_Alpha ? 1 : 4;
+    const size_t sheetSize = (size_t)textureSize * textureSize * pixelSize;
+
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+    if (!fontVec.empty())
+        ok = ok && fwrite(fontVec.data(), sizeof(BundleFont), fontVec.size(), fp) == fontVec.size();
+    if (!glyphVec.empty())
+        ok = ok && fwrite(glyphVec.data(), sizeof(BundleGlyph), glyphVec.size(), fp) == glyphVec.size();
+    for (auto image : sheetImageVec)
+    {
+        ok = ok && fwrite(image, sheetSize, 1, fp) == 1;
+    }
+    fclose(fp);
+
+    if (!ok)
+        fprintf(stderr, "Error writing bundle \"%s\"\n", filename.c_str());
+    return ok;
+}
+
+} // namespace gb
@@ -0,0 +1,86 @@
+#ifndef GB_BUNDLE_H
+#define GB_BUNDLE_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include "glyphblaster.h"
+#include "allocator.h"
+#include "mappedfile.h"
+
+namespace gb {
+
+class Texture;
+
+// identifies a font within a bundle, see Face::GetContentHash()
+struct BundleFont
+{
+    uint64_t contentHash;
+    uint32_t pointSize;
+    uint32_t paddingBorder;
+    uint8_t renderOption;
+    uint8_t hintOption;
+    uint8_t reserved[6];
+};
+
+// location and metrics of a pre-rasterized glyph within the bundle sheets.
+struct BundleGlyph
+{
+    uint32_t font;  // index into the font table
+    uint32_t glyphIndex;
+    uint32_t sheet;
+    int32_t originX;
+    int32_t originY;
+    int32_t width;
+    int32_t height;
+    int32_t advance;
+    int32_t bearingX;
+    int32_t bearingY;
+};
+
+// A pre-baked texture atlas, written by an offline tool and mapped at startup.
+//
+// File layout: header, font table, glyph table sorted by (font, glyphIndex),
+// followed by the pixels of each sheet.  Uses native byte order.
+class Bundle
+{
+public:
+    // maps the file and creates a texture for each sheet, the textures come from allocator.
+    Bundle(Allocator& allocator, const std::string& filename, bool useGL);
+    ~Bundle();
+
+    bool IsValid() const { return m_valid; }
+    uint32_t GetTextureSize() const { return m_textureSize; }
+    TextureFormat GetTextureFormat() const { return m_textureFormat; }
+
+    // returns the index of the matching font or -1 if it is not in the bundle.
+    int FindFont(uint64_t contentHash, uint32_t pointSize, uint32_t paddingBorder,
+                 FontRenderOption renderOption, FontHintOption hintOption) const;
+
+    // returns nullptr if the glyph is not in the bundle.
+    const BundleGlyph* FindGlyph(uint32_t font, uint32_t glyphIndex) const;
+
+    uint32_t GetTexObj(uint32_t sheet) const;
+
+    static bool Write(const std::string& filename, uint32_t textureSize, TextureFormat textureFormat,
+                      const std::vector<BundleFont>& fontVec, std::vector<BundleGlyph> glyphVec,
+                      const std::vector<const uint8_t*>& sheetImageVec);
+
+protected:
+    MappedFile m_mappedFile;
+    bool m_valid;
+    uint32_t m_textureSize;
+    TextureFormat m_textureFormat;
+    const BundleFont* m_fonts;
+    uint32_t m_numFonts;
+    const BundleGlyph* m_glyphs;
+    uint32_t m_numGlyphs;
+    Vector<std::unique_ptr<Texture, AllocatorDelete<Texture>>> m_textureVec;
+
+    GB_NO_COPY(Bundle)
+};
+
+} // namespace gb
+
+#endif // GB_BUNDLE_H
@@ -6,30 +6,37 @@
 
 namespace gb {
 
-Cache::Sheet::Sheet(uint32_t textureSize, TextureFormat textureFormat) :
+Cache::Sheet::Sheet(Allocator& allocator, uint32_t textureSize, TextureFormat textureFormat, bool useGL, bool deferSubload,
+                    bool deferStorage) :
     m_textureSize(textureSize),
-    m_textureFormat(textureFormat)
+    m_textureFormat(textureFormat),
+    m_sheetLevelVec(allocator)
 {
+    if (deferStorage)
+    {
+        m_texture = AllocateUnique<Texture>(allocator, textureFormat, textureSize, nullptr, useGL, deferSubload, &allocator, true);
+        return;
+    }
+
 #ifndef NDEBUG
     // in debug fill image with 128.
     const uint32_t kPixelSize = textureFormat == TextureFormat_Alpha ? 1 : 4;
     const uint32_t kImageSize = textureSize * textureSize * kPixelSize;
-    std::unique_ptr<uint8_t> image(new uint8_t[kImageSize]);
+    ByteBuffer image = AllocateBytes(allocator, kImageSize);
     memset(image.get(), 0x80, kImageSize);
-    m_texture = std::unique_ptr<Texture>(new Texture(textureFormat, textureSize, image.get()));
+    m_texture = AllocateUnique<Texture>(allocator, textureFormat, textureSize, image.get(), useGL, deferSubload, &allocator);
 #else
-    m_texture = std::unique_ptr<Texture>(new Texture(textureFormat, textureSize, nullptr));
+    m_texture = AllocateUnique<Texture>(allocator, textureFormat, textureSize, nullptr, useGL, deferSubload, &allocator);
 #endif
 }
 
 bool Cache::Sheet::AddNewLevel(uint32_t height)
 {
-    SheetLevel* prevLevel = m_sheetLevelVec.empty() ? nullptr : m_sheetLevelVec.back().get();
+    SheetLevel* prevLevel = m_sheetLevelVec.empty() ? nullptr : &m_sheetLevelVec.back();
     uint32_t baseline = prevLevel ? prevLevel->GetBaseline() + prevLevel->GetHeight() : 0;
     if ((baseline + height) <= m_textureSize)
     {
-        std::unique_ptr<SheetLevel> sheetLevel(new SheetLevel(m_textureSize, baseline, height));
-        m_sheetLevelVec.push_back(std::move(sheetLevel));
+        m_sheetLevelVec.push_back(SheetLevel(m_textureSize, baseline, height));
         return true;
     }
     else
@@ -53,73 +60,87 @@ const Texture* Cache::Sheet::GetTexture() const
     return m_texture.get();
 }
 
-bool Cache::SheetLevel::Insert(std::shared_ptr<Glyph> glyph)
+Texture* Cache::Sheet::GetTexture()
 {
-    Glyph* prevGlyph = m_glyphVec.empty() ? nullptr : m_glyphVec.back().get();
-    if (prevGlyph)
-    {
-        if (prevGlyph && prevGlyph->GetOrigin().x + prevGlyph->GetSize().x + glyph->GetSize().x <= m_textureSize)
-        {
-            auto o = IntPoint{prevGlyph->GetOrigin().x + prevGlyph->GetSize().x, (int)m_baseline};
-            glyph->SetOrigin(o);
-            m_glyphVec.push_back(glyph);
-            return true;
-        }
-        else
-        {
-            // does not fit on this level
-            return false;
-        }
-    }
-    else if (glyph->GetSize().x <= m_textureSize)
+    return m_texture.get();
+}
+
+void Cache::Sheet::GetArea(uint32_t& glyphAreaOut, uint32_t& levelAreaOut) const
+{
+    for (auto &sheetLevel : m_sheetLevelVec)
     {
-        auto o = IntPoint{0, (int)m_baseline};
-        glyph->SetOrigin(o);
-        m_glyphVec.push_back(glyph);
-        return true;
+        glyphAreaOut += sheetLevel.GetGlyphArea();
+        levelAreaOut += sheetLevel.GetHeight() * m_textureSize;
     }
-    else
-    {
-        // very rare glyph is larger then the width of the texture
+}
+
+bool Cache::SheetLevel::Insert(Glyph& glyph)
+{
+    // a glyph larger than the width of the texture is very rare.
+    if (m_width + glyph.GetSize().x > m_textureSize)
         return false;
-    }
+
+    auto o = IntPoint{(int)m_width, (int)m_baseline};
+    glyph.SetOrigin(o);
+    m_width += glyph.GetSize().x;
+    m_glyphArea += glyph.GetSize().x * glyph.GetSize().y;
+    return true;
 }
 
-bool Cache::Sheet::Insert(std::shared_ptr<Glyph> glyph)
+bool Cache::Sheet::Insert(Glyph& glyph)
 {
     for (auto &sheetLevel : m_sheetLevelVec)
     {
-        if (glyph->GetSize().y <= sheetLevel->GetHeight() && sheetLevel->Insert(glyph))
+        if (glyph.GetSize().y <= sheetLevel.GetHeight() && sheetLevel.Insert(glyph))
         {
-            glyph->SetTexObj(m_texture->GetTexObj());
-            m_texture->Subload(glyph->GetOrigin(), glyph->GetSize(), glyph->GetImage());
+            glyph.SetTexObj(m_texture->GetTexObj());
+            m_texture->Subload(glyph.GetOrigin(), glyph.GetSize(), glyph.GetImage());
             return true;
         }
     }
 
     // need to add a new level
-    if (AddNewLevel(glyph->GetSize().y) && m_sheetLevelVec.back()->Insert(glyph))
+    if (AddNewLevel(glyph.GetSize().y) && m_sheetLevelVec.back().Insert(glyph))
     {
-        glyph->SetTexObj(m_texture->GetTexObj());
-        m_texture->Subload(glyph->GetOrigin(), glyph->GetSize(), glyph->GetImage());
+        glyph.SetTexObj(m_texture->GetTexObj());
+        m_texture->Subload(glyph.GetOrigin(), glyph.GetSize(), glyph.GetImage());
         return true;
     }
     else
     {
         // out of room
-        glyph->SetTexObj(0);
+        glyph.SetTexObj(0);
         return false;
     }
 }
 
-Cache::Cache(uint32_t textureSize, uint32_t numSheets, TextureFormat textureFormat) :
-    m_textureSize(textureSize)
+Cache::Cache(Context& context, uint32_t textureSize, uint32_t numSheets, TextureFormat textureFormat, bool useGL,
+             bool threadSafe) :
+    m_context(context),
+    m_sheetVec(context.GetAllocator()),
+    m_colorSheetVec(context.GetAllocator()),
+    m_textureSize(textureSize),
+    m_numSheets(numSheets),
+    m_textureFormat(textureFormat),
+    m_useGL(useGL),
+    m_threadSafe(threadSafe)
 {
     m_sheetVec.reserve(numSheets);
     for (uint32_t i = 0; i < numSheets; i++)
     {
-        std::unique_ptr<Sheet> sheet(new Sheet(textureSize, textureFormat));
-        m_sheetVec.push_back(std::move(sheet));
+        m_sheetVec.push_back(AllocateUnique<Sheet>(context.GetAllocator(), context.GetAllocator(), textureSize, textureFormat,
+                                                   useGL, threadSafe));
+    }
+
+    // the color sheets can not be created later, by a thread without the GL context.  only their texture names
+    // are, most applications never draw a color glyph.
+    if (threadSafe && useGL && textureFormat == TextureFormat_Alpha)
+    {
+        for (uint32_t i = 0; i < numSheets; i++)
+        {
+            m_colorSheetVec.push_back(AllocateUnique<Sheet>(context.GetAllocator(), context.GetAllocator(), textureSize,
+                                                             TextureFormat_RGBA, useGL, threadSafe, true));
+        }
     }
 }
 
@@ -128,8 +149,23 @@ Cache::~Cache()
     ;
 }
 
-bool Cache::InsertIntoSheets(std::shared_ptr<Glyph> glyph)
+bool Cache::InsertIntoSheets(Glyph& glyph)
 {
+    if (glyph.IsColor() && m_textureFormat == TextureFormat_Alpha)
+    {
+        for (auto &sheet : m_colorSheetVec)
+        {
+            if (sheet->Insert(glyph))
+                return true;
+        }
+        if (m_colorSheetVec.size() >= m_numSheets)
+            return false;
+
+        m_colorSheetVec.push_back(AllocateUnique<Sheet>(m_context.GetAllocator(), m_context.GetAllocator(), m_textureSize,
+                                                         TextureFormat_RGBA, m_useGL, m_threadSafe));
+        return m_colorSheetVec.back()->Insert(glyph);
+    }
+
     for (auto &sheet : m_sheetVec)
     {
         if (sheet->Insert(glyph))
@@ -142,29 +178,37 @@ void Cache::Compact()
 {
     printf("Cache::Compact()\n");
 
-    Context& context = Context::Get();
-
     // build a vector of all glyphs in the context.
-    std::vector<std::shared_ptr<Glyph>> glyphVec;
-    context.GetAllGlyphs(glyphVec);
+    Vector<Glyph*> glyphVec(m_context.GetAllocator());
+    m_context.GetAllGlyphs(glyphVec);
 
     // clear all sheets
     for (auto &sheet : m_sheetVec)
     {
         sheet->Clear();
     }
+    for (auto &sheet : m_colorSheetVec)
+    {
+        sheet->Clear();
+    }
+
+    // baked glyphs live in bundle textures, and are never moved.
+    glyphVec.erase(std::remove_if(glyphVec.begin(), glyphVec.end(), [](const Glyph* glyph)
+    {
+        return glyph->IsBaked();
+    }), glyphVec.end());
 
     // sort glyphs in decreasing height
-    std::sort(glyphVec.begin(), glyphVec.end(), [](const std::shared_ptr<Glyph>& a, const std::shared_ptr<Glyph>& b)
+    std::sort(glyphVec.begin(), glyphVec.end(), [](const Glyph* a, const Glyph* b)
     {
         return b->GetSize().y < a->GetSize().y;
     });
 
     // re-insert glyphs into the sheets in sorted order.
     // which should improve packing efficiency.
-    for (auto &glyph : glyphVec)
+    for (auto glyph : glyphVec)
     {
-        InsertIntoSheets(glyph);
+        InsertIntoSheets(*glyph);
     }
 }
 
@@ -175,6 +219,24 @@ void Cache::GetTextureObjects(std::vector<uint32_t>& texVec) const
     {
         texVec.push_back(sheet->GetTexObj());
     }
+    for (auto &sheet : m_colorSheetVec)
+    {
+        texVec.push_back(sheet->GetTexObj());
+    }
+}
+
+float Cache::GetPackingEfficiency() const
+{
+    uint32_t glyphArea = 0, levelArea = 0;
+    for (auto &sheet : m_sheetVec)
+    {
+        sheet->GetArea(glyphArea, levelArea);
+    }
+    for (auto &sheet : m_colorSheetVec)
+    {
+        sheet->GetArea(glyphArea, levelArea);
+    }
+    return levelArea ? (float)glyphArea / (float)levelArea : 0.0f;
 }
 
 void Cache::GenerateMipmap() const
@@ -183,6 +245,22 @@ void Cache::GenerateMipmap() const
     {
         sheet->GetTexture()->GenerateMipmap();
     }
+    for (auto &sheet : m_colorSheetVec)
+    {
+        sheet->GetTexture()->GenerateMipmap();
+    }
+}
+
+void Cache::Upload()
+{
+    for (auto &sheet : m_sheetVec)
+    {
+        sheet->GetTexture()->Upload();
+    }
+    for (auto &sheet : m_colorSheetVec)
+    {
+        sheet->GetTexture()->Upload();
+    }
 }
 
 } // namespace gb
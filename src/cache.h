@@ -6,66 +6,95 @@
 #include <vector>
 #include "glyphblaster.h"
 #include "glyph.h"
+#include "allocator.h"
 
 namespace gb {
 
+class Context;
 class Texture;
 
 class Cache
 {
     friend class Context;
 public:
-    Cache(uint32_t textureSize, uint32_t numSheets, TextureFormat textureFormat);
+    // if useGL is false, sheets are kept in system memory, see Texture.
+    // if threadSafe is true, sheets can be filled from any thread, their sub-loads are deferred until Upload(),
+    // and every sheet is created up front, so no other OpenGL call is made outside of Upload().
+    // color sheets then only get their memory, and their OpenGL storage, once a color glyph is inserted.
+    Cache(Context& context, uint32_t textureSize, uint32_t numSheets, TextureFormat textureFormat, bool useGL = true,
+          bool threadSafe = false);
     ~Cache();
     void Compact();
     uint32_t GetTextureSize() const { return m_textureSize; }
 
     // for debugging
-    // fills up texVec with the OpenGL GLuint texture handles for each sheet.
+    // fills up texVec with the OpenGL GLuint texture handles for each sheet, followed by the color sheets.
     void GetTextureObjects(std::vector<uint32_t>& texVec) const;
 
+    // for debugging
+    // fraction of the sheet area covered by levels that is occupied by glyph pixels.
+    float GetPackingEfficiency() const;
+
     void GenerateMipmap() const;
 
+    // sends deferred sub-loads to OpenGL, see threadSafe above.
+    void Upload();
+
 protected:
-    bool InsertIntoSheets(std::shared_ptr<Glyph> glyph);
+    bool InsertIntoSheets(Glyph& glyph);
 
     class SheetLevel
     {
     public:
-        SheetLevel(uint32_t textureSize, uint32_t baseline, uint32_t height) : m_textureSize(textureSize), m_baseline(baseline), m_height(height) {}
-        bool Insert(std::shared_ptr<Glyph> glyph);
+        SheetLevel(uint32_t textureSize, uint32_t baseline, uint32_t height) : m_textureSize(textureSize), m_baseline(baseline), m_height(height), m_width(0), m_glyphArea(0) {}
+        bool Insert(Glyph& glyph);
         uint32_t GetBaseline() const { return m_baseline; }
         uint32_t GetHeight() const { return m_height; }
+        uint32_t GetGlyphArea() const { return m_glyphArea; }
     protected:
-        std::vector<std::shared_ptr<Glyph>> m_glyphVec;
+        // glyphs are packed left to right, the level does not need to know them, only where the next one goes.
         uint32_t m_textureSize;
         uint32_t m_baseline;
         uint32_t m_height;
-
-        GB_NO_COPY(SheetLevel);
+        uint32_t m_width;
+        uint32_t m_glyphArea;
     };
 
     class Sheet
     {
     public:
-        Sheet(uint32_t textureSize, TextureFormat textureFormat);
-        bool Insert(std::shared_ptr<Glyph> glyph);
+        Sheet(Allocator& allocator, uint32_t textureSize, TextureFormat textureFormat, bool useGL, bool deferSubload,
+              bool deferStorage = false);
+        bool Insert(Glyph& glyph);
         void Clear();
         uint32_t GetTexObj() const;
         const Texture* GetTexture() const;
+        Texture* GetTexture();
+        void GetArea(uint32_t& glyphAreaOut, uint32_t& levelAreaOut) const;
     protected:
         bool AddNewLevel(uint32_t height);
 
-        std::unique_ptr<Texture> m_texture;
+        std::unique_ptr<Texture, AllocatorDelete<Texture>> m_texture;
         uint32_t m_textureSize;
         TextureFormat m_textureFormat;
-        std::vector<std::unique_ptr<SheetLevel>> m_sheetLevelVec;
+        Vector<SheetLevel> m_sheetLevelVec;
 
         GB_NO_COPY(Sheet);
     };
 
-    std::vector<std::unique_ptr<Sheet>> m_sheetVec;
+    // sheets, their levels & images come from the context's allocator.
+    typedef std::unique_ptr<Sheet, AllocatorDelete<Sheet>> SheetPtr;
+    Context& m_context;
+    Vector<SheetPtr> m_sheetVec;
+
+    // RGBA sheets for color glyphs, created as needed when the other sheets are TextureFormat_Alpha.
+    // with TextureFormat_RGBA color glyphs share m_sheetVec, so mixed text is a single batch.
+    Vector<SheetPtr> m_colorSheetVec;
     uint32_t m_textureSize;
+    uint32_t m_numSheets;
+    TextureFormat m_textureFormat;
+    bool m_useGL;
+    bool m_threadSafe;
 
     GB_NO_COPY(Cache);
 };
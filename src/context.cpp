@@ -1,25 +1,40 @@
 #include <assert.h>
+#include <string.h>
+#include <stddef.h>
+#include <algorithm>
 #include "context.h"
+#include FT_MODULE_H
+#include "bidi.h"
 #include "glyph.h"
 #include "cache.h"
+#include "diskcache.h"
+#include "bundle.h"
 #include "text.h"
 #include "font.h"
+#include "face.h"
 #include "texture.h"
+#include "taskscheduler.h"
 
 namespace gb {
 
 static Context* s_context;
 
-static Texture* CreateFallbackTexture()
+// FreeType expects blocks aligned like malloc's.
+static const size_t kFTAlignment = alignof(max_align_t);
+
+// glyphs per rasterization task, FreeType takes tens of microseconds for each.
+static const size_t kRasterizeGrain = 8;
+
+static std::unique_ptr<Texture, AllocatorDelete<Texture>> CreateFallbackTexture(Allocator& allocator, bool useGL)
 {
     const int textureSize = 16;
     const int imageSize = textureSize * textureSize;
-    std::unique_ptr<uint8_t> image(new uint8_t[imageSize]);
+    ByteBuffer image = AllocateBytes(allocator, imageSize);
 
     // fallback texture is gray
     memset(image.get(), 128, imageSize);
 
-    return new Texture(TextureFormat_Alpha, textureSize, image.get());
+    return AllocateUnique<Texture>(allocator, TextureFormat_Alpha, textureSize, image.get(), useGL, false, &allocator);
 }
 
 static void NullRenderFunc(const QuadVec& quadVec) {}
@@ -37,12 +52,13 @@ static int PowerOfTwoRoundUp(int x)
     return x + 1;
 }
 
-void Context::Init(uint32_t textureSize, uint32_t numSheets, TextureFormat textureFormat)
+void Context::Init(uint32_t textureSize, uint32_t numSheets, TextureFormat textureFormat,
+                   uint32_t optionFlags, Allocator* allocator)
 {
     assert(!s_context);
     if (!s_context)
     {
-        s_context = new Context(textureSize, numSheets, textureFormat);
+        s_context = new Context(textureSize, numSheets, textureFormat, optionFlags, allocator);
     }
 }
 
@@ -61,19 +77,46 @@ Context& Context::Get()
     return *s_context;
 }
 
-Context::Context(uint32_t textureSize, uint32_t numSheets, TextureFormat textureFormat) :
+Context::Context(uint32_t textureSize, uint32_t numSheets, TextureFormat textureFormat, uint32_t optionFlags,
+                 Allocator* allocator) :
+    m_allocator(allocator ? *allocator : GetDefaultAllocator()),
     m_ftLibrary(nullptr),
-    m_cache(new Cache(PowerOfTwoRoundUp(textureSize), numSheets, textureFormat)),
+    m_cache(AllocateUnique<Cache>(m_allocator, *this, PowerOfTwoRoundUp(textureSize), numSheets, textureFormat,
+                                  !(optionFlags & ContextOptionFlags_NoGL), (optionFlags & ContextOptionFlags_ThreadSafe) != 0)),
+    m_bidiRunCache(AllocateUnique<BidiRunCache>(m_allocator, m_allocator, 4096, (optionFlags & ContextOptionFlags_ThreadSafe) != 0)),
+    m_bundleFontMap(m_allocator),
+    m_glyphSlotMap(m_allocator),
+    m_pinnedGlyphVec(m_allocator),
+    m_fontMap(m_allocator),
+    m_faceMap(m_allocator),
+    m_memoryFaceMap(m_allocator),
     m_nextFontIndex(0),
-    m_fallbackTexture(CreateFallbackTexture()),
+    m_fallbackTexture(CreateFallbackTexture(m_allocator, !(optionFlags & ContextOptionFlags_NoGL))),
     m_renderFunc(NullRenderFunc),
-    m_textureFormat(textureFormat)
+    m_textureFormat(textureFormat),
+    m_optionFlags(optionFlags),
+    m_uploadPending(false)
 {
-    if (FT_Init_FreeType(&m_ftLibrary))
+    if (IsThreadSafe())
+        m_taskScheduler = std::make_shared<ThreadPool>();
+
+    for (auto &shard : m_glyphShards)
+        shard.glyphMap = GlyphMap(std::less<GlyphKey>(), m_allocator);
+
+    // the same as FT_Init_FreeType(), but FreeType allocates through m_ftMemory.
+    m_ftMemory.user = this;
+    m_ftMemory.alloc = FTAlloc;
+    m_ftMemory.free = FTFree;
+    m_ftMemory.realloc = FTRealloc;
+    if (FT_New_Library(&m_ftMemory, &m_ftLibrary))
     {
-        fprintf(stderr, "FT_Init_FreeType failed");
+        fprintf(stderr, "FT_New_Library failed");
         abort();
     }
+    FT_Add_Default_Modules(m_ftLibrary);
+#if FREETYPE_MAJOR > 2 || (FREETYPE_MAJOR == 2 && (FREETYPE_MINOR > 8 || (FREETYPE_MINOR == 8 && FREETYPE_PATCH >= 1)))
+    FT_Set_Default_Properties(m_ftLibrary);
+#endif
 
 #ifndef NDEBUG
     FT_Int major, minor, patch;
@@ -84,8 +127,34 @@ Context::Context(uint32_t textureSize, uint32_t numSheets, TextureFormat texture
 
 Context::~Context()
 {
+    // tasks still queued may be using the context.
+    m_taskScheduler.reset();
+
     if (m_ftLibrary)
-        FT_Done_FreeType(m_ftLibrary);
+        FT_Done_Library(m_ftLibrary);
+}
+
+void* Context::FTAlloc(FT_Memory memory, long size)
+{
+    return ((Context*)memory->user)->m_allocator.Allocate((size_t)size, kFTAlignment);
+}
+
+void Context::FTFree(FT_Memory memory, void* block)
+{
+    ((Context*)memory->user)->m_allocator.Free(block);
+}
+
+void* Context::FTRealloc(FT_Memory memory, long curSize, long newSize, void* block)
+{
+    // Allocator has no realloc, FreeType only grows a few tables this way.
+    Allocator& allocator = ((Context*)memory->user)->m_allocator;
+    void* newBlock = allocator.Allocate((size_t)newSize, kFTAlignment);
+    if (block)
+    {
+        memcpy(newBlock, block, (size_t)std::min(curSize, newSize));
+        allocator.Free(block);
+    }
+    return newBlock;
 }
 
 void Context::SetRenderFunc(RenderFunc renderFunc)
@@ -98,89 +167,491 @@ void Context::ClearRenderFunc()
     m_renderFunc = NullRenderFunc;
 }
 
+void Context::SetTaskScheduler(std::shared_ptr<TaskScheduler> taskScheduler)
+{
+    if (!IsThreadSafe())
+    {
+        fprintf(stderr, "Error Context::SetTaskScheduler requires ContextOptionFlags_ThreadSafe\n");
+        abort();
+    }
+    m_taskScheduler = taskScheduler ? taskScheduler : std::make_shared<ThreadPool>();
+}
+
 void Context::Compact()
 {
+    auto lock = Lock(m_cacheMutex);
+    ReclaimGlyphs();
     m_cache->Compact();
+    if (IsThreadSafe())
+        m_uploadPending.store(true, std::memory_order_release);
 }
 
-void Context::InsertIntoMap(std::shared_ptr<Glyph> glyph)
+void Context::UploadTextures()
 {
-    m_glyphMap[glyph->GetKey()] = glyph;
+    if (!m_uploadPending.load(std::memory_order_acquire))
+        return;
+
+    auto lock = Lock(m_cacheMutex);
+    m_uploadPending.store(false, std::memory_order_relaxed);
+    m_cache->Upload();
 }
 
-std::weak_ptr<Glyph> Context::FindInMap(GlyphKey key)
+void Context::EnableDiskCache(const std::string& filename)
 {
-    auto iter = m_glyphMap.find(key);
-    if (iter != m_glyphMap.end())
-        return iter->second;
+    auto diskCache = AllocateUnique<DiskCache>(m_allocator, m_allocator, filename);
+    if (diskCache->IsOpen())
+        m_diskCache = std::move(diskCache);
     else
-        return std::weak_ptr<Glyph>();
+        m_diskCache.reset();
+}
+
+void Context::DisableDiskCache()
+{
+    m_diskCache.reset();
+}
+
+bool Context::LoadBundle(const std::string& filename)
+{
+    auto bundle = AllocateUnique<Bundle>(m_allocator, m_allocator, filename, !(m_optionFlags & ContextOptionFlags_NoGL));
+    if (!bundle->IsValid())
+        return false;
+
+    if (bundle->GetTextureSize() != m_cache->GetTextureSize() || bundle->GetTextureFormat() != m_textureFormat)
+    {
+        fprintf(stderr, "Error: bundle \"%s\" does not match the context texture size or format\n", filename.c_str());
+        return false;
+    }
+
+    // baked glyphs point straight at the bundle's textures, so a loaded bundle is never replaced.
+    // CreateGlyph() reads the bundle & its font map from other threads, under m_fontMutex.
+    auto lock = Lock(m_fontMutex);
+    if (m_bundle)
+    {
+        fprintf(stderr, "Error: a bundle is already loaded, can not load \"%s\"\n", filename.c_str());
+        return false;
+    }
+    m_bundle = std::move(bundle);
+
+    // match up fonts that already exist.
+    m_bundleFontMap.clear();
+    for (auto kv : m_fontMap)
+    {
+        OnFontCreateBundle(kv.second);
+    }
+    return true;
+}
+
+bool Context::SaveBundle(const std::string& filename) const
+{
+    if (!(m_optionFlags & ContextOptionFlags_NoGL))
+    {
+        fprintf(stderr, "Error: Context::SaveBundle requires ContextOptionFlags_NoGL\n");
+        return false;
+    }
+
+    std::vector<const uint8_t*> sheetImageVec;
+    std::map<uint32_t, uint32_t> sheetMap;  // texObj to sheet index
+    for (auto &sheet : m_cache->m_sheetVec)
+    {
+        sheetMap[sheet->GetTexObj()] = (uint32_t)sheetImageVec.size();
+        sheetImageVec.push_back(sheet->GetTexture()->GetImage());
+    }
+
+    std::vector<BundleFont> fontVec;
+    std::map<uint32_t, uint32_t> fontMap;  // font index to bundle font index
+    for (auto kv : m_fontMap)
+    {
+        const Font* font = kv.second;
+        BundleFont bundleFont;
+        memset(&bundleFont, 0, sizeof(bundleFont));
+        bundleFont.contentHash = font->GetFace().GetContentHash();
+        bundleFont.pointSize = font->GetPointSize();
+        bundleFont.paddingBorder = font->GetPaddingBorder();
+        bundleFont.renderOption = (uint8_t)font->GetRenderOption();
+        bundleFont.hintOption = (uint8_t)font->GetHintOption();
+        fontMap[kv.first] = (uint32_t)fontVec.size();
+        fontVec.push_back(bundleFont);
+    }
+
+    Vector<Glyph*> glyphVec(m_allocator);
+    GetAllGlyphs(glyphVec);
+    std::vector<BundleGlyph> bundleGlyphVec;
+    bundleGlyphVec.reserve(glyphVec.size());
+    for (auto glyph : glyphVec)
+    {
+        // glyphs from a previously loaded bundle are not in the cache sheets.
+        // bundles have no color flag, color glyphs are rasterized when they are first used.
+        if (glyph->IsBaked() || glyph->IsColor())
+            continue;
+
+        auto fontIter = fontMap.find(glyph->GetKey().GetFontIndex());
+        auto sheetIter = sheetMap.find(glyph->GetTexObj());
+        if (fontIter == fontMap.end() || sheetIter == sheetMap.end())
+        {
+            // did not fit in the cache
+            fprintf(stderr, "Warning: glyph %u is not in the cache, it will not be saved\n", glyph->GetKey().GetGlyphIndex());
+            continue;
+        }
+
+        BundleGlyph bundleGlyph;
+        bundleGlyph.font = fontIter->second;
+        bundleGlyph.glyphIndex = glyph->GetKey().GetGlyphIndex();
+        bundleGlyph.sheet = sheetIter->second;
+        bundleGlyph.originX = glyph->GetOrigin().x;
+        bundleGlyph.originY = glyph->GetOrigin().y;
+        bundleGlyph.width = glyph->GetSize().x;
+        bundleGlyph.height = glyph->GetSize().y;
+        bundleGlyph.advance = glyph->GetAdvance();
+        bundleGlyph.bearingX = glyph->GetBearing().x;
+        bundleGlyph.bearingY = glyph->GetBearing().y;
+        bundleGlyphVec.push_back(bundleGlyph);
+    }
+
+    return Bundle::Write(filename, m_cache->GetTextureSize(), m_textureFormat,
+                         fontVec, bundleGlyphVec, sheetImageVec);
+}
+
+GlyphHandle Context::FindInMap(GlyphKey key)
+{
+    // referenced under the shard lock, so ReclaimGlyphs() can not free the glyph in between.
+    GlyphShard& shard = GetGlyphShard(key);
+    auto lock = Lock(shard.mutex);
+    auto iter = shard.glyphMap.find(key);
+    if (iter == shard.glyphMap.end())
+        return 0;
+    m_glyphSlotMap.AddRef(iter->second);
+    return iter->second;
+}
+
+void Context::ReclaimGlyphs()
+{
+    for (auto &shard : m_glyphShards)
+    {
+        auto lock = Lock(shard.mutex);
+        for (auto iter = shard.glyphMap.begin(); iter != shard.glyphMap.end(); )
+        {
+            if (m_glyphSlotMap.GetRefCount(iter->second) == 0)
+            {
+                m_glyphSlotMap.Free(iter->second);
+                iter = shard.glyphMap.erase(iter);
+            }
+            else
+            {
+                ++iter;
+            }
+        }
+    }
+}
+
+void Context::ReleaseGlyphs(const Vector<GlyphHandle>& handleVec)
+{
+    // unreferenced glyphs stay in the cache, for the next Text that needs them, until ReclaimGlyphs().
+    for (auto handle : handleVec)
+        m_glyphSlotMap.Release(handle);
+}
+
+std::shared_ptr<Face> Context::GetFace(const std::string& filename)
+{
+    auto lock = Lock(m_fontMutex);
+
+    // re-use the face if another font already has this file open.
+    const String key(filename.data(), filename.size(), m_allocator);
+    auto iter = m_faceMap.find(key);
+    if (iter != m_faceMap.end() && !iter->second.expired())
+        return iter->second.lock();
+
+    auto face = std::allocate_shared<Face>(StlAllocator<Face>(m_allocator), m_allocator, m_ftLibrary, filename);
+    m_faceMap[key] = face;
+    return face;
+}
+
+std::shared_ptr<Face> Context::GetFace(const uint8_t* data, size_t size)
+{
+    auto lock = Lock(m_fontMutex);
+    auto iter = m_memoryFaceMap.find(data);
+    if (iter != m_memoryFaceMap.end() && !iter->second.expired())
+        return iter->second.lock();
+
+    auto face = std::allocate_shared<Face>(StlAllocator<Face>(m_allocator), m_allocator, m_ftLibrary, data, size);
+    m_memoryFaceMap[data] = face;
+    return face;
 }
 
 void Context::OnFontCreate(Font* font)
 {
+    auto lock = Lock(m_fontMutex);
     font->m_index = m_nextFontIndex++;
     m_fontMap[font->m_index] = font;
+
+    if (m_bundle)
+        OnFontCreateBundle(font);
+}
+
+void Context::OnFontCreateBundle(Font* font)
+{
+    int bundleFont = m_bundle->FindFont(font->GetFace().GetContentHash(), font->GetPointSize(),
+                                        font->GetPaddingBorder(), font->GetRenderOption(),
+                                        font->GetHintOption());
+    if (bundleFont >= 0)
+        m_bundleFontMap[font->m_index] = (uint32_t)bundleFont;
 }
 
 void Context::OnFontDestroy(Font* font)
 {
+    auto lock = Lock(m_fontMutex);
     m_fontMap.erase(font->m_index);
+    m_bundleFontMap.erase(font->m_index);
+
+    // release pinned glyphs, the font can no longer be used to draw them.
+    const uint32_t fontIndex = font->m_index;
+    auto pinnedEnd = std::partition(m_pinnedGlyphVec.begin(), m_pinnedGlyphVec.end(), [this, fontIndex](GlyphHandle handle)
+    {
+        return m_glyphSlotMap.Get(handle)->GetKey().GetFontIndex() != fontIndex;
+    });
+    for (auto iter = pinnedEnd; iter != m_pinnedGlyphVec.end(); ++iter)
+        m_glyphSlotMap.Release(*iter);
+    m_pinnedGlyphVec.erase(pinnedEnd, m_pinnedGlyphVec.end());
 }
 
-void Context::RasterizeAndSubloadGlyphs(const std::vector<GlyphKey>& keyVecIn,
-                                        std::vector<std::shared_ptr<Glyph>>& glyphVecOut)
+void Context::RasterizeAndSubloadGlyphs(const Vector<GlyphKey>& keyVecIn, Vector<const Glyph*>& glyphVecOut,
+                                        Vector<GlyphHandle>& handleVecOut, GlyphBatchScratch& scratch)
 {
-    bool cacheIsFull = false;
+    // each unique glyph is looked up and referenced once, however often it is drawn.
+    Vector<GlyphKey>& uniqueKeyVec = scratch.uniqueKeyVec;
+    uniqueKeyVec.assign(keyVecIn.begin(), keyVecIn.end());
+    std::sort(uniqueKeyVec.begin(), uniqueKeyVec.end());
+    uniqueKeyVec.erase(std::unique(uniqueKeyVec.begin(), uniqueKeyVec.end(), [](const GlyphKey& a, const GlyphKey& b)
+    {
+        return a.value == b.value;
+    }), uniqueKeyVec.end());
 
-    // TODO: sort glyphs in decreasing height, to improve texture atlas packing.
-    for (auto key : keyVecIn)
+    // glyphs that already exist are used as is, the missing ones are left empty and filled in at the end.
+    Vector<const Glyph*>& uniqueGlyphVec = scratch.uniqueGlyphVec;
+    Vector<size_t>& missingVec = scratch.missingVec;
+    uniqueGlyphVec.assign(uniqueKeyVec.size(), nullptr);
+    missingVec.clear();
+    handleVecOut.reserve(handleVecOut.size() + uniqueKeyVec.size());
+    for (size_t i = 0; i < uniqueKeyVec.size(); i++)
     {
-        // check to see if this glyph already exists.
-        auto glyph = FindInMap(key);
-        if (glyph.expired())
+        GlyphHandle handle = FindInMap(uniqueKeyVec[i]);
+        if (handle)
         {
-            // look up font by index.
-            auto iter = m_fontMap.find(key.GetFontIndex());
-            Font* font = iter != m_fontMap.end() ? iter->second : nullptr;
-            assert(font);
+            uniqueGlyphVec[i] = m_glyphSlotMap.Get(handle);
+            handleVecOut.push_back(handle);
+        }
+        else
+        {
+            missingVec.push_back(i);
+        }
+    }
 
-            // will rasterize and initialize glyph
-            auto glyph = std::make_shared<Glyph>(key.GetGlyphIndex(), *font);
+    if (!missingVec.empty())
+    {
+        // look up fonts by index.
+        Vector<Font*> fontVec(m_allocator);
+        fontVec.reserve(missingVec.size());
+        {
+            auto lock = Lock(m_fontMutex);
+            for (auto i : missingVec)
+            {
+                auto iter = m_fontMap.find(uniqueKeyVec[i].GetFontIndex());
+                fontVec.push_back(iter != m_fontMap.end() ? iter->second : nullptr);
+            }
+        }
 
-            // will subload glyph into texture atlas
-            if (!cacheIsFull && !m_cache->InsertIntoSheets(glyph))
+        // rasterize without holding a lock, in thread-safe mode each thread has its own FreeType faces,
+        // so big batches are split across the task scheduler.
+        Vector<GlyphPtr> newGlyphVec(m_allocator);
+        newGlyphVec.resize(missingVec.size());
+        ParallelFor(m_taskScheduler.get(), missingVec.size(), kRasterizeGrain, [&](size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; i++)
             {
-                // compact and try again.
-                m_cache->Compact();
-
-                if (!m_cache->InsertIntoSheets(glyph))
-                {
-                    cacheIsFull = true;
-                    fprintf(stderr, "Warning: glyphblaster texture cache is full\n");
-                }
+                assert(fontVec[i]);
+                newGlyphVec[i] = CreateGlyph(uniqueKeyVec[missingVec[i]].GetGlyphIndex(), *fontVec[i]);
             }
+        });
+
+        AddGlyphs(missingVec, newGlyphVec, uniqueGlyphVec, handleVecOut);
+    }
+
+    // the unique keys are sorted, so each key finds its glyph with a binary search.
+    glyphVecOut.reserve(glyphVecOut.size() + keyVecIn.size());
+    for (auto key : keyVecIn)
+    {
+        auto iter = std::lower_bound(uniqueKeyVec.begin(), uniqueKeyVec.end(), key);
+        glyphVecOut.push_back(uniqueGlyphVec[iter - uniqueKeyVec.begin()]);
+    }
+}
+
+void Context::AddGlyphs(const Vector<size_t>& missingVec, Vector<GlyphPtr>& newGlyphVec,
+                        Vector<const Glyph*>& uniqueGlyphVec, Vector<GlyphHandle>& handleVecOut)
+{
+    auto lock = Lock(m_cacheMutex);
 
-            InsertIntoMap(glyph);
-            glyphVecOut.push_back(glyph);
+    // another thread may have created some of the same glyphs meanwhile, use those instead.
+    Vector<GlyphHandle> newHandleVec(m_allocator);
+    Vector<Glyph*> subloadGlyphVec(m_allocator);
+    for (size_t i = 0; i < newGlyphVec.size(); i++)
+    {
+        GlyphHandle handle = FindInMap(newGlyphVec[i]->GetKey());
+        if (handle)
+        {
+            uniqueGlyphVec[missingVec[i]] = m_glyphSlotMap.Get(handle);
         }
         else
         {
-            glyphVecOut.push_back(glyph.lock());
+            const bool baked = newGlyphVec[i]->IsBaked();  // baked glyphs are already in a texture.
+            handle = m_glyphSlotMap.Insert(std::move(newGlyphVec[i]));
+            Glyph* glyph = m_glyphSlotMap.Get(handle);
+            uniqueGlyphVec[missingVec[i]] = glyph;
+            newHandleVec.push_back(handle);
+            if (!baked)
+                subloadGlyphVec.push_back(glyph);
         }
+        handleVecOut.push_back(handle);
     }
+
+    // subload the whole batch in decreasing height, to improve texture atlas packing.
+    // glyphs of the same height stay in key order, as std::stable_sort would keep them, without its buffer.
+    std::sort(subloadGlyphVec.begin(), subloadGlyphVec.end(), [](const Glyph* a, const Glyph* b)
+    {
+        return a->GetSize().y != b->GetSize().y ? b->GetSize().y < a->GetSize().y : a->GetKey() < b->GetKey();
+    });
+    bool dropped = false;
+    for (size_t i = 0; i < subloadGlyphVec.size(); i++)
+    {
+        if (m_cache->InsertIntoSheets(*subloadGlyphVec[i]))
+            continue;
+
+        // other threads may be drawing the glyphs in thread-safe mode, so they are never moved.
+        // the rest of the batch is still tried, shorter glyphs often fit on the existing levels.
+        if (IsThreadSafe())
+        {
+            dropped = true;
+            continue;
+        }
+
+        // compact and try again, this frees unreferenced glyphs and repacks every live one,
+        // including the rest of this batch, which is referenced by the caller.
+        for (auto handle : newHandleVec)
+            InsertIntoMap(handle);
+        ReclaimGlyphs();
+        m_cache->Compact();
+        for (size_t j = i; j < subloadGlyphVec.size(); j++)
+        {
+            if (subloadGlyphVec[j]->GetTexObj() == 0)
+                dropped = true;
+        }
+        break;
+    }
+    if (dropped)
+        fprintf(stderr, "Warning: glyphblaster texture cache is full\n");
+
+    // other threads only find a glyph once it has its place in a sheet.
+    for (auto handle : newHandleVec)
+        InsertIntoMap(handle);
+
     m_cache->GenerateMipmap();
+    if (IsThreadSafe() && !subloadGlyphVec.empty())
+        m_uploadPending.store(true, std::memory_order_release);
+
+    if (m_diskCache)
+        m_diskCache->Flush();
+}
+
+void Context::InsertIntoMap(GlyphHandle handle)
+{
+    const GlyphKey key = m_glyphSlotMap.Get(handle)->GetKey();
+    GlyphShard& shard = GetGlyphShard(key);
+    auto lock = Lock(shard.mutex);
+    shard.glyphMap[key] = handle;
 }
 
-void Context::GetAllGlyphs(std::vector<std::shared_ptr<Glyph>>& glyphVecOut) const
+void Context::PinGlyphs(const Vector<GlyphHandle>& handleVec)
 {
-    for (auto kv : m_glyphMap)
+    auto lock = Lock(m_fontMutex);
+    m_pinnedGlyphVec.insert(m_pinnedGlyphVec.end(), handleVec.begin(), handleVec.end());
+}
+
+GlyphPtr Context::CreateGlyph(uint32_t index, const Font& font)
+{
+    // check for a pre-baked glyph first.
+    const BundleGlyph* bundleGlyph = nullptr;
+    uint32_t bundleTexObj = 0;
+    {
+        auto lock = Lock(m_fontMutex);
+        auto bundleFontIter = m_bundleFontMap.find(font.GetIndex());
+        if (bundleFontIter != m_bundleFontMap.end())
+            bundleGlyph = m_bundle->FindGlyph(bundleFontIter->second, index);
+        if (bundleGlyph)
+            bundleTexObj = m_bundle->GetTexObj(bundleGlyph->sheet);
+    }
+    if (bundleGlyph)
+    {
+        return AllocateUnique<Glyph>(m_allocator, index, font, bundleGlyph->advance,
+                                     IntPoint{bundleGlyph->bearingX, bundleGlyph->bearingY},
+                                     IntPoint{bundleGlyph->width, bundleGlyph->height},
+                                     IntPoint{bundleGlyph->originX, bundleGlyph->originY},
+                                     bundleTexObj);
+    }
+
+    if (!m_diskCache)
+        return AllocateUnique<Glyph>(m_allocator, index, font);
+
+    DiskCacheKey key;
+    memset(&key, 0, sizeof(key));
+    key.contentHash = font.GetFace().GetContentHash();
+    key.pointSize = font.GetPointSize();
+    key.paddingBorder = font.GetPaddingBorder();
+    key.glyphIndex = index;
+    key.renderOption = (uint8_t)font.GetRenderOption();
+    key.hintOption = (uint8_t)font.GetHintOption();
+    key.textureFormat = (uint8_t)m_textureFormat;
+
+    DiskCacheRecord record;
     {
-        if (!kv.second.expired())
+        // the image is copied before another thread can grow the file.
+        auto lock = Lock(m_cacheMutex);
+        const uint8_t* image;
+        if (m_diskCache->Find(key, record, &image))
         {
-            glyphVecOut.push_back(kv.second.lock());
+            return AllocateUnique<Glyph>(m_allocator, index, font, record.advance,
+                                         IntPoint{record.bearingX, record.bearingY},
+                                         IntPoint{record.width, record.height},
+                                         image, record.imageSize, record.color != 0);
         }
     }
+
+    GlyphPtr glyph = AllocateUnique<Glyph>(m_allocator, index, font);
+    const uint32_t pixelSize = (m_textureFormat == TextureFormat_Alpha && !glyph->IsColor()) ? 1 : 4;
+    const IntPoint size = glyph->GetSize();
+    record.advance = glyph->GetAdvance();
+    record.bearingX = glyph->GetBearing().x;
+    record.bearingY = glyph->GetBearing().y;
+    record.width = size.x;
+    record.height = size.y;
+    record.imageSize = glyph->GetImage() ? size.x * size.y * pixelSize : 0;
+    record.color = glyph->IsColor() ? 1 : 0;
+    auto lock = Lock(m_cacheMutex);
+    m_diskCache->Insert(key, record, glyph->GetImage());
+    return glyph;
+}
+
+TextWorkspace& Context::GetTextWorkspace()
+{
+    assert(!IsThreadSafe());
+    if (!m_textWorkspace)
+        m_textWorkspace = AllocateUnique<TextWorkspace>(m_allocator, *this);
+    return *m_textWorkspace;
+}
+
+void Context::GetAllGlyphs(Vector<Glyph*>& glyphVecOut) const
+{
+    m_glyphSlotMap.ForEach([&glyphVecOut](GlyphHandle handle, Glyph& glyph)
+    {
+        glyphVecOut.push_back(&glyph);
+    });
 }
 
 } // namespace gb
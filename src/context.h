@@ -5,74 +5,219 @@
 #include <memory>
 #include <vector>
 #include <map>
+#include <string>
 #include <functional>
+#include <mutex>
+#include <atomic>
 #include <ft2build.h>
 #include FT_FREETYPE_H
+#include FT_SYSTEM_H
 
 #include "glyphblaster.h"
+#include "allocator.h"
 #include "texture.h"
 #include "glyph.h"
+#include "glyphslotmap.h"
 
 namespace gb {
 
+class BidiRunCache;
+class Bundle;
 class Cache;
+class DiskCache;
+class Face;
 class Font;
+class QuadSnapshot;
+class TaskScheduler;
+class TextWorkspace;
 
-typedef std::vector<Quad> QuadVec;
+typedef Vector<Quad> QuadVec;
 typedef std::function<void (const QuadVec&)> RenderFunc;
 
+// buffers kept between calls to Context::RasterizeAndSubloadGlyphs(), see TextWorkspace.
+struct GlyphBatchScratch
+{
+    explicit GlyphBatchScratch(Allocator& allocator) : uniqueKeyVec(allocator), uniqueGlyphVec(allocator), missingVec(allocator) {}
+    Vector<GlyphKey> uniqueKeyVec;
+    Vector<const Glyph*> uniqueGlyphVec;
+    Vector<size_t> missingVec;
+};
+
+enum ContextOptionFlags {
+    ContextOptionFlags_None = 0,
+    ContextOptionFlags_NoGL = 0x01,  // keep texture sheets in system memory and never call OpenGL, for offline tools.
+    ContextOptionFlags_ThreadSafe = 0x02  // fonts and texts can be created from any thread, see below.
+};
+
+// Owns a glyph cache and everything it depends on: the FreeType library, font files, texture sheets
+// and the glyphs in them.  Contexts share no state, so each one can be used from its own thread,
+// for example one per window, per GL context or per worker.
+// Fonts belong to the context they were created with, and so does any Text using them.
+//
+// With ContextOptionFlags_ThreadSafe, Fonts and Texts of the same context can be created and destroyed
+// on any number of threads at once, and a Font can be shared by all of them.  Each thread gets its own
+// FreeType faces, glyphs are found in a sharded map, and only new glyphs wait on each other, to be packed.
+// Texture uploads are left to the GL thread, in Draw() or UploadTextures().  The cache is not compacted
+// when it fills up, call Compact() when no other thread is building a Text.  Set up the render function,
+// disk cache and bundles before other threads start using the context.
+// Long texts, big batches of new glyphs and Text::CreateBatch() are split into tasks, run on the
+// context's TaskScheduler, a ThreadPool unless SetTaskScheduler() says otherwise.
+//
+// Glyphs, their images, texture sheets in system memory, the glyph maps, the containers of each Text
+// and FreeType's own allocations all come from the context's Allocator, so they can be pooled or counted.
 class Context
 {
     friend class Cache;
+    friend class Document;
     friend class Font;
+    friend class QuadSnapshot;
     friend class Text;
 public:
-    static void Init(uint32_t textureSize, uint32_t numSheets, TextureFormat textureFormat);
+    // the default context, used by the Font constructors that take no context.
+    static void Init(uint32_t textureSize, uint32_t numSheets, TextureFormat textureFormat,
+                     uint32_t optionFlags = ContextOptionFlags_None, Allocator* allocator = nullptr);
     static void Shutdown();
     static Context& Get();
 
-protected:
-    Context(uint32_t textureSize, uint32_t numSheets, TextureFormat textureFormat);
+    // fonts created with the context must be destroyed before it, and so must the allocator outlive it.
+    // a null allocator uses malloc & free.
+    Context(uint32_t textureSize, uint32_t numSheets, TextureFormat textureFormat,
+            uint32_t optionFlags = ContextOptionFlags_None, Allocator* allocator = nullptr);
     ~Context();
 
-public:
     TextureFormat GetTextureFormat() const { return m_textureFormat; }
+    bool IsThreadSafe() const { return (m_optionFlags & ContextOptionFlags_ThreadSafe) != 0; }
+    Allocator& GetAllocator() const { return m_allocator; }
     void SetRenderFunc(RenderFunc renderFunc);
     void ClearRenderFunc();
     void Compact();
     const Cache& GetCache() { return *(m_cache.get()); }
 
+    // sends glyphs rasterized by other threads to OpenGL, only needed with ContextOptionFlags_ThreadSafe.
+    // called by Text::Draw(), call it before drawing quads some other way.  must run on the GL thread.
+    void UploadTextures();
+
+    // where the parallel work of a thread-safe context runs, for example on the application's own job system.
+    // null restores the default.  set it before other threads start using the context.
+    // contexts that are not thread-safe have none, and do all their work on the calling thread.
+    void SetTaskScheduler(std::shared_ptr<TaskScheduler> taskScheduler);
+    TaskScheduler* GetTaskScheduler() const { return m_taskScheduler.get(); }
+
+    // Optional persistent cache of rasterized glyphs, consulted before rasterizing with FreeType.
+    // The file is created if it does not exist.
+    void EnableDiskCache(const std::string& filename);
+    void DisableDiskCache();
+
+    // Registers a pre-baked atlas, glyphs found in the bundle are never rasterized.
+    // The bundle must use the same texture size and format as the context.
+    // Call it once at startup, before any Text is built.  A context holds at most one bundle,
+    // a second call fails and leaves the first one loaded.
+    bool LoadBundle(const std::string& filename);
+
+    // Writes every glyph in the cache into a bundle, requires ContextOptionFlags_NoGL.
+    bool SaveBundle(const std::string& filename) const;
+
 protected:
     // Used by Font objects
     FT_Library GetFTLibrary() const { return m_ftLibrary; }
+    std::shared_ptr<Face> GetFace(const std::string& filename);
+    std::shared_ptr<Face> GetFace(const uint8_t* data, size_t size);
     void OnFontCreate(Font* font);
+    void OnFontCreateBundle(Font* font);
     void OnFontDestroy(Font* font);
 
     // Used by Text instances.
-    void RasterizeAndSubloadGlyphs(const std::vector<GlyphKey>& keyVecIn,
-                                   std::vector<std::shared_ptr<Glyph>>& glyphVecOut);
+    // glyphVecOut gets the glyph for each key, handleVecOut a referenced handle for each unique glyph.
+    // the glyphs stay valid until the handles are released.
+    void RasterizeAndSubloadGlyphs(const Vector<GlyphKey>& keyVecIn, Vector<const Glyph*>& glyphVecOut,
+                                   Vector<GlyphHandle>& handleVecOut, GlyphBatchScratch& scratch);
+    void ReleaseGlyphs(const Vector<GlyphHandle>& handleVec);
 
-    void GetAllGlyphs(std::vector<std::shared_ptr<Glyph>>& glyphVecOut) const;
+    // keeps glyphs alive without a Text referencing them, see Font::Preload().  takes over the references.
+    void PinGlyphs(const Vector<GlyphHandle>& handleVec);
+
+    void GetAllGlyphs(Vector<Glyph*>& glyphVecOut) const;
+
+    // rasterizes a glyph, or loads it from the disk cache.
+    GlyphPtr CreateGlyph(uint32_t index, const Font& font);
 
-    void InsertIntoMap(std::shared_ptr<Glyph> glyph);
     const Texture& GetFallbackTexture() { return *(m_fallbackTexture.get()); }
+    BidiRunCache& GetBidiRunCache() { return *(m_bidiRunCache.get()); }
 
-    // Used to avoid creating multiple copies of the same glyph.
-    std::weak_ptr<Glyph> FindInMap(GlyphKey key);
+    // used by Texts that are not given a workspace, only in a context that is not thread-safe.
+    TextWorkspace& GetTextWorkspace();
 
-    FT_Library m_ftLibrary;
-    std::unique_ptr<Cache> m_cache;
+    // Used to avoid creating multiple copies of the same glyph.  the handle found is referenced, 0 if none.
+    GlyphHandle FindInMap(GlyphKey key);
+
+    // puts new glyphs in the slot map, the sheets and the glyph map, under m_cacheMutex.
+    void AddGlyphs(const Vector<size_t>& missingVec, Vector<GlyphPtr>& newGlyphVec,
+                   Vector<const Glyph*>& uniqueGlyphVec, Vector<GlyphHandle>& handleVecOut);
+    void InsertIntoMap(GlyphHandle handle);
+
+    // frees the glyphs no Text references, with their slots & map entries.  needs m_cacheMutex.
+    void ReclaimGlyphs();
+
+    // locks the mutex only in thread-safe mode.
+    std::unique_lock<std::mutex> Lock(std::mutex& mutex) const
+    {
+        return IsThreadSafe() ? std::unique_lock<std::mutex>(mutex) : std::unique_lock<std::mutex>(mutex, std::defer_lock);
+    }
 
-    // holds all glyph instances
-    std::map<GlyphKey, std::weak_ptr<Glyph>> m_glyphMap;
+    // FreeType callbacks, they allocate from m_allocator.
+    static void* FTAlloc(FT_Memory memory, long size);
+    static void FTFree(FT_Memory memory, void* block);
+    static void* FTRealloc(FT_Memory memory, long curSize, long newSize, void* block);
+
+    Allocator& m_allocator;
+    FT_MemoryRec_ m_ftMemory;
+    FT_Library m_ftLibrary;
+    std::unique_ptr<Cache, AllocatorDelete<Cache>> m_cache;
+    std::unique_ptr<DiskCache, AllocatorDelete<DiskCache>> m_diskCache;
+    std::unique_ptr<Bundle, AllocatorDelete<Bundle>> m_bundle;
+    std::unique_ptr<BidiRunCache, AllocatorDelete<BidiRunCache>> m_bidiRunCache;
+    std::unique_ptr<TextWorkspace, AllocatorDelete<TextWorkspace>> m_textWorkspace;  // created on first use.
+
+    // maps font index to font index within m_bundle.
+    Map<uint32_t, uint32_t> m_bundleFontMap;
+
+    // owns all glyph instances, see GlyphSlotMap.  new glyphs are inserted with m_cacheMutex held.
+    GlyphSlotMap m_glyphSlotMap;
+
+    // finds glyphs by key, split by key so threads looking up different glyphs rarely meet.
+    enum { kNumGlyphShards = 16 };
+    typedef Map<GlyphKey, GlyphHandle> GlyphMap;
+    struct GlyphShard
+    {
+        mutable std::mutex mutex;
+        GlyphMap glyphMap;
+    };
+    GlyphShard& GetGlyphShard(GlyphKey key) { return m_glyphShards[((key.value * 0x9e3779b97f4a7c15ULL) >> 32) % kNumGlyphShards]; }
+    GlyphShard m_glyphShards[kNumGlyphShards];
+
+    // glyphs preloaded with pin set, released when their font is destroyed.
+    Vector<GlyphHandle> m_pinnedGlyphVec;
 
     // holds all font instances
-    std::map<uint32_t, Font*> m_fontMap;
+    Map<uint32_t, Font*> m_fontMap;
+
+    // holds all font files, shared between fonts of different sizes
+    Map<String, std::weak_ptr<Face>> m_faceMap;
+    Map<const uint8_t*, std::weak_ptr<Face>> m_memoryFaceMap;
 
     uint32_t m_nextFontIndex;
-    std::unique_ptr<Texture> m_fallbackTexture;
+    std::unique_ptr<Texture, AllocatorDelete<Texture>> m_fallbackTexture;
     RenderFunc m_renderFunc;
     TextureFormat m_textureFormat;
+    uint32_t m_optionFlags;
+
+    // in thread-safe mode, m_fontMutex guards the font & face maps, pinned glyphs and every FT_Library call.
+    // m_cacheMutex guards the sheets and the disk cache, it is taken before any glyph shard mutex.
+    std::mutex m_fontMutex;
+    std::mutex m_cacheMutex;
+    std::atomic<bool> m_uploadPending;
+
+    std::shared_ptr<TaskScheduler> m_taskScheduler;
 
     GB_NO_COPY(Context)
 };
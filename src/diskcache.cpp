@@ -0,0 +1,181 @@
+#include "diskcache.h"
+
+namespace gb {
+
+static const uint32_t kDiskCacheMagic = 0x43444247;  // "GBDC"
+static const uint32_t kDiskCacheVersion = 2;
+
+// larger than any glyph a texture sheet can hold.
+static const int32_t kMaxGlyphSize = 16384;
+
+struct DiskCacheHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t keySize;
+    uint32_t recordSize;
+};
+
+// entries are padded so that keys and records stay 4 byte aligned within the mapping.
+static size_t EntrySize(uint32_t imageSize)
+{
+    return sizeof(DiskCacheKey) + sizeof(DiskCacheRecord) + ((imageSize + 3) & ~3);
+}
+
+// the image must be exactly what Texture::Subload will read, a stale or damaged file must not cause an over-read.
+// glyphs without an image have no size.
+static bool IsValidEntry(const DiskCacheKey& key, const DiskCacheRecord& record)
+{
+    if (record.width < 0 || record.height < 0 || record.width > kMaxGlyphSize || record.height > kMaxGlyphSize ||
+        key.textureFormat > TextureFormat_RGBA || record.color > 1)
+        return false;
+    const uint64_t pixelSize = (key.textureFormat == TextureFormat_Alpha && !record.color) ? 1 : 4;
+    return record.imageSize == (uint64_t)record.width * record.height * pixelSize;
+}
+
+DiskCache::DiskCache(Allocator& allocator, const std::string& filename) :
+    m_filename(filename.data(), filename.size(), allocator),
+    m_file(nullptr),
+    m_offsetMap(allocator),
+    m_fileSize(0),
+    m_dirty(false)
+{
+    // index the existing entries
+    size_t validSize = 0;
+    if (m_mappedFile.Open(filename.c_str()))
+    {
+        const uint8_t* data = m_mappedFile.GetData();
+        const size_t size = m_mappedFile.GetSize();
+
+        DiskCacheHeader header;
+        if (size >= sizeof(header))
+        {
+            memcpy(&header, data, sizeof(header));
+            if (header.magic == kDiskCacheMagic && header.version == kDiskCacheVersion &&
+                header.keySize == sizeof(DiskCacheKey) && header.recordSize == sizeof(DiskCacheRecord))
+            {
+                size_t offset = sizeof(header);
+                while (offset + sizeof(DiskCacheKey) + sizeof(DiskCacheRecord) <= size)
+                {
+                    DiskCacheKey key;
+                    DiskCacheRecord record;
+                    memcpy(&key, data + offset, sizeof(key));
+                    memcpy(&record, data + offset + sizeof(key), sizeof(record));
+                    const size_t end = offset + EntrySize(record.imageSize);
+                    if (end > size || !IsValidEntry(key, record))
+                        break;
+                    m_offsetMap[key] = offset;
+                    offset = end;
+                }
+
+                // a partial entry at the end means an earlier write was interrupted, start over.
+                // so does a damaged one, the entries after it can not be found.
+                if (offset == size)
+                    validSize = size;
+            }
+        }
+    }
+
+    if (validSize)
+    {
+        m_file = fopen(filename.c_str(), "ab");
+        m_fileSize = validSize;
+    }
+    else
+    {
+        // missing, incompatible or damaged file.
+        m_mappedFile.Close();
+        m_offsetMap.clear();
+        m_file = fopen(filename.c_str(), "wb");
+        if (m_file)
+        {
+            DiskCacheHeader header = {kDiskCacheMagic, kDiskCacheVersion,
+                                      (uint32_t)sizeof(DiskCacheKey), (uint32_t)sizeof(DiskCacheRecord)};
+            fwrite(&header, sizeof(header), 1, m_file);
+            m_fileSize = sizeof(header);
+            m_dirty = true;
+        }
+    }
+
+    if (!m_file)
+    {
+        fprintf(stderr, "Warning: could not open glyph disk cache \"%s\"\n", filename.c_str());
+        m_mappedFile.Close();
+        m_offsetMap.clear();
+    }
+}
+
+DiskCache::~DiskCache()
+{
+    if (m_file)
+        fclose(m_file);
+}
+
+bool DiskCache::Find(const DiskCacheKey& key, DiskCacheRecord& recordOut, const uint8_t** imageOut)
+{
+    auto iter = m_offsetMap.find(key);
+    if (iter == m_offsetMap.end())
+        return false;
+
+    // entry was appended after the file was mapped.
+    const size_t offset = iter->second;
+    if (offset + sizeof(DiskCacheKey) + sizeof(DiskCacheRecord) > m_mappedFile.GetSize())
+        Flush();
+
+    // the file may have been changed or truncated since it was indexed.  such entries are dropped,
+    // so the glyph is rasterized again and appended.
+    const uint8_t* data = m_mappedFile.GetData();
+    const size_t mappedSize = m_mappedFile.GetSize();
+    bool valid = data && offset + sizeof(DiskCacheKey) + sizeof(DiskCacheRecord) <= mappedSize;
+    if (valid)
+    {
+        DiskCacheKey fileKey;
+        memcpy(&fileKey, data + offset, sizeof(DiskCacheKey));
+        memcpy(&recordOut, data + offset + sizeof(DiskCacheKey), sizeof(DiskCacheRecord));
+        valid = memcmp(&fileKey, &key, sizeof(DiskCacheKey)) == 0 && IsValidEntry(key, recordOut) &&
+                offset + EntrySize(recordOut.imageSize) <= mappedSize;
+    }
+    if (!valid)
+    {
+        m_offsetMap.erase(iter);
+        return false;
+    }
+    *imageOut = recordOut.imageSize ? data + offset + sizeof(DiskCacheKey) + sizeof(DiskCacheRecord) : nullptr;
+    return true;
+}
+
+void DiskCache::Insert(const DiskCacheKey& key, const DiskCacheRecord& record, const uint8_t* image)
+{
+    if (!m_file || m_offsetMap.find(key) != m_offsetMap.end())
+        return;
+
+    static const uint8_t zeros[4] = {0, 0, 0, 0};
+    const uint32_t padding = ((record.imageSize + 3) & ~3) - record.imageSize;
+    fwrite(&key, sizeof(key), 1, m_file);
+    fwrite(&record, sizeof(record), 1, m_file);
+    if (record.imageSize)
+        fwrite(image, record.imageSize, 1, m_file);
+    if (padding)
+        fwrite(zeros, padding, 1, m_file);
+
+    m_offsetMap[key] = m_fileSize;
+    m_fileSize += EntrySize(record.imageSize);
+    m_dirty = true;
+}
+
+void DiskCache::Flush()
+{
+    if (m_file && m_dirty)
+    {
+        fflush(m_file);
+        Remap();
+        m_dirty = false;
+    }
+}
+
+void DiskCache::Remap()
+{
+    m_mappedFile.Open(m_filename.c_str());
+}
+
+} // namespace gb
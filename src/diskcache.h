@@ -0,0 +1,82 @@
+#ifndef GB_DISKCACHE_H
+#define GB_DISKCACHE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include "glyphblaster.h"
+#include "allocator.h"
+#include "mappedfile.h"
+
+namespace gb {
+
+// identifies a rasterized glyph across runs of the program.
+struct DiskCacheKey
+{
+    uint64_t contentHash;  // Face::GetContentHash()
+    uint32_t pointSize;
+    uint32_t paddingBorder;
+    uint32_t glyphIndex;
+    uint8_t renderOption;
+    uint8_t hintOption;
+    uint8_t textureFormat;
+    uint8_t reserved;
+
+    bool operator<(const DiskCacheKey& rhs) const { return memcmp(this, &rhs, sizeof(DiskCacheKey)) < 0; }
+};
+
+// glyph metrics and image size, as produced by Glyph::InitImageAndSize.
+struct DiskCacheRecord
+{
+    int32_t advance;
+    int32_t bearingX;
+    int32_t bearingY;
+    int32_t width;
+    int32_t height;
+    uint32_t imageSize;  // in bytes, the image immediately follows the record in the file.
+    uint32_t color;  // 1 for color glyphs, which are RGBA in any texture format.
+};
+
+// Persistent cache of rasterized glyph bitmaps.
+//
+// The file is append-only: a header followed by (key, record, image) entries.
+// Existing entries are read directly from a memory mapping of the file,
+// new entries are appended and become visible after the next Flush.
+// The file uses native byte order and is not safe to share between processes writing at the same time.
+class DiskCache
+{
+public:
+    // the file name & index come from allocator.
+    DiskCache(Allocator& allocator, const std::string& filename);
+    ~DiskCache();
+
+    bool IsOpen() const { return m_file != nullptr; }
+
+    // returns false if the glyph is not in the cache, or its entry is damaged.
+    // imageOut points into the mapping and is only valid until the next Insert or Flush.
+    bool Find(const DiskCacheKey& key, DiskCacheRecord& recordOut, const uint8_t** imageOut);
+
+    void Insert(const DiskCacheKey& key, const DiskCacheRecord& record, const uint8_t* image);
+
+    // writes pending entries to disk, and re-maps the file if necessary.
+    void Flush();
+
+protected:
+    void Remap();
+
+    String m_filename;
+    FILE* m_file;
+    MappedFile m_mappedFile;
+
+    // offset of each record within the file.
+    Map<DiskCacheKey, size_t> m_offsetMap;
+    size_t m_fileSize;
+    bool m_dirty;
+
+    GB_NO_COPY(DiskCache)
+};
+
+} // namespace gb
+
+#endif // GB_DISKCACHE_H
@@ -0,0 +1,194 @@
+#include <assert.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include "document.h"
+#include "context.h"
+#include "font.h"
+
+namespace gb {
+
+Document::Document(const std::string& string, std::shared_ptr<Font> font, void* userData,
+                   IntPoint origin, IntPoint size, TextHorizontalAlign horizontalAlign,
+                   uint32_t optionFlags, const char* script) :
+    m_font(font),
+    m_string(string.data(), string.size(), font->GetContext().GetAllocator()),
+    m_script(script ? script : "", font->GetContext().GetAllocator()),
+    m_userData(userData, free, StlAllocator<char>(font->GetContext().GetAllocator())),
+    m_origin(origin),
+    m_size(size),
+    m_horizontalAlign(horizontalAlign),
+    m_optionFlags(optionFlags),
+    m_scrollY(0),
+    m_paragraphStartVec(font->GetContext().GetAllocator()),
+    m_lineCountVec(font->GetContext().GetAllocator()),
+    m_lineTree(font->GetContext().GetAllocator()),
+    m_textMap(font->GetContext().GetAllocator())
+{
+    // split into paragraphs, a trailing newline starts an empty last paragraph.
+    const char* begin = m_string.data();
+    const char* end = begin + m_string.size();
+    m_paragraphStartVec.push_back(0);
+    for (const char* p = begin; p < end; p++)
+    {
+        p = (const char*)memchr(p, '\n', end - p);
+        if (!p)
+            break;
+        m_paragraphStartVec.push_back(p + 1 - begin);
+    }
+    m_paragraphStartVec.push_back(m_string.size());
+
+    // estimate the height of each paragraph from its size in bytes,
+    // it is replaced by the real height once the paragraph is laid out.
+    int64_t advance = m_font->GetAdvance(m_font->GetGlyphIndex('n'));
+    if (advance <= 0)
+        advance = std::max(1, m_font->GetLineHeight() / 2);
+    const size_t numParagraphs = m_paragraphStartVec.size() - 1;
+    m_lineCountVec.resize(numParagraphs);
+    for (size_t i = 0; i < numParagraphs; i++)
+    {
+        int64_t width = (m_paragraphStartVec[i + 1] - m_paragraphStartVec[i]) * advance;
+        int64_t lines = m_size.x > 0 ? (width + m_size.x - 1) / m_size.x : 1;
+        m_lineCountVec[i] = (uint32_t)std::max<int64_t>(1, lines);
+    }
+
+    // build the fenwick tree in place, in O(n).
+    m_lineTree.resize(numParagraphs + 1, 0);
+    for (size_t i = 1; i <= numParagraphs; i++)
+    {
+        m_lineTree[i] += m_lineCountVec[i - 1];
+        size_t parent = i + (i & (0 - i));
+        if (parent <= numParagraphs)
+            m_lineTree[parent] += m_lineTree[i];
+    }
+
+    SetScrollY(0);
+}
+
+Document::~Document()
+{
+}
+
+int Document::GetHeight() const
+{
+    return (int)GetLinesBefore(m_lineCountVec.size()) * m_font->GetLineHeight();
+}
+
+void Document::SetScrollY(int scrollY)
+{
+    m_scrollY = scrollY;
+
+    // the last snapshot is reused, unless a render thread still holds it.
+    // the fence pairs with the release of the render thread's reference, before its last read.
+    if (!m_snapshot || m_snapshot.use_count() > 1)
+        m_snapshot = QuadSnapshot::Create(m_font->GetContext(), m_userData);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    QuadVec& quadVec = m_snapshot->m_quadVec;
+    quadVec.clear();
+    m_snapshot->m_sourceVec.clear();
+
+    const int lineHeight = m_font->GetLineHeight();
+    const size_t numParagraphs = m_lineCountVec.size();
+    const size_t first = FindParagraph(scrollY > 0 ? scrollY / lineHeight : 0);
+    size_t last = first;
+    for (size_t i = first; i < numParagraphs; i++)
+    {
+        // laying out a paragraph can change its height, so position it afterwards.
+        const Text& text = LayoutParagraph(i);
+        int y = (int)GetLinesBefore(i) * lineHeight - scrollY;
+        if (y >= m_size.y)
+            break;
+        last = i;
+
+        // clip to the viewport, in the coordinates of the paragraph.
+        size_t quadStart = quadVec.size();
+        text.ClipQuads(IntPoint{0, -y}, m_size, quadVec);
+        if (quadVec.size() > quadStart)
+            m_snapshot->m_sourceVec.push_back(text.GetQuadSnapshot());
+        for (size_t j = quadStart; j < quadVec.size(); j++)
+        {
+            Quad& q = quadVec[j];
+            q.pen.x += m_origin.x;
+            q.pen.y += m_origin.y + y;
+            q.origin.x += m_origin.x;
+            q.origin.y += m_origin.y + y;
+            q.userData = m_userData.get();
+        }
+    }
+
+    // keep about a screen of paragraphs above and below the viewport, for scrolling back & forth.
+    const size_t margin = std::max<size_t>(last - first + 1, 16);
+    m_textMap.erase(m_textMap.begin(), m_textMap.lower_bound(first > margin ? first - margin : 0));
+    m_textMap.erase(m_textMap.upper_bound(last + margin), m_textMap.end());
+}
+
+void Document::Draw()
+{
+    Context& context = m_font->GetContext();
+    context.UploadTextures();
+    context.m_renderFunc(m_snapshot->m_quadVec);
+}
+
+void Document::AddLines(size_t paragraph, int delta)
+{
+    for (size_t i = paragraph + 1; i < m_lineTree.size(); i += i & (0 - i))
+        m_lineTree[i] += delta;
+}
+
+uint32_t Document::GetLinesBefore(size_t paragraph) const
+{
+    uint32_t lines = 0;
+    for (size_t i = paragraph; i > 0; i -= i & (0 - i))
+        lines += m_lineTree[i];
+    return lines;
+}
+
+// returns the paragraph containing the given line, or the last paragraph if past the end.
+size_t Document::FindParagraph(uint32_t line) const
+{
+    const size_t numParagraphs = m_lineCountVec.size();
+    size_t step = 1;
+    while (step * 2 <= numParagraphs)
+        step *= 2;
+
+    size_t pos = 0;
+    for (; step > 0; step /= 2)
+    {
+        if (pos + step <= numParagraphs && m_lineTree[pos + step] <= line)
+        {
+            pos += step;
+            line -= m_lineTree[pos];
+        }
+    }
+    return std::min(pos, numParagraphs - 1);
+}
+
+const Text& Document::LayoutParagraph(size_t paragraph)
+{
+    auto iter = m_textMap.find(paragraph);
+    if (iter != m_textMap.end())
+        return *iter->second;
+
+    size_t start = m_paragraphStartVec[paragraph];
+    size_t end = m_paragraphStartVec[paragraph + 1];
+    if (end > start && m_string[end - 1] == '\n')
+        end--;
+    if (end > start && m_string[end - 1] == '\r')
+        end--;
+
+    // the document owns the user data, the text gets none and is positioned at the origin.
+    TextPtr& text = m_textMap[paragraph];
+    text = AllocateUnique<Text>(m_font->GetContext().GetAllocator(), m_string.data() + start, end - start, m_font,
+                                nullptr, IntPoint{0, 0}, m_size, m_horizontalAlign, TextVerticalAlign_Top,
+                                m_optionFlags, m_script.empty() ? nullptr : m_script.c_str());
+
+    uint32_t numLines = (uint32_t)text->GetNumLines();
+    if (numLines != m_lineCountVec[paragraph])
+    {
+        AddLines(paragraph, (int)numLines - (int)m_lineCountVec[paragraph]);
+        m_lineCountVec[paragraph] = numLines;
+    }
+    return *text;
+}
+
+} // namespace gb
@@ -0,0 +1,84 @@
+#ifndef GB_DOCUMENT_H
+#define GB_DOCUMENT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include "glyphblaster.h"
+#include "context.h"
+#include "text.h"
+
+namespace gb {
+
+class Font;
+
+// A large utf8 document, such as a log, laid out one paragraph at a time.
+//
+// Paragraphs are found up front by scanning for '\n', but each one is only shaped, wrapped
+// and rasterized when it scrolls into view.  Quads are only generated for the viewport,
+// so the cost of a scroll is proportional to what is on screen, not to the size of the document.
+//
+// Paragraphs that have never been laid out are assumed to fill an estimated number of lines,
+// the content below them may move when they are first seen.
+class Document
+{
+public:
+    // origin & size - the viewport, lines are wrapped to size.x.
+    // userData is attached to every quad, and is freed by the last snapshot of the document, like Text.
+    Document(const std::string& string, std::shared_ptr<Font> font, void* userData,
+             IntPoint origin, IntPoint size, TextHorizontalAlign horizontalAlign,
+             uint32_t optionFlags = TextOptionFlags_None, const char* script = nullptr);
+    ~Document();
+
+    size_t GetNumParagraphs() const { return m_lineCountVec.size(); }
+
+    // height of the whole document in pixels, including estimated paragraphs.
+    int GetHeight() const;
+
+    // lays out the paragraphs between scrollY and scrollY + size.y, and regenerates the quads.
+    // quads are clipped to the viewport.
+    void SetScrollY(int scrollY);
+    int GetScrollY() const { return m_scrollY; }
+
+    void Draw();
+    const QuadVec& GetQuadVec() const { return m_snapshot->m_quadVec; }
+
+    // the quads for the current scroll position, see QuadSnapshot.
+    std::shared_ptr<const QuadSnapshot> GetQuadSnapshot() const { return m_snapshot; }
+
+protected:
+    // fenwick tree over m_lineCountVec, to map between lines & paragraphs in O(log n).
+    void AddLines(size_t paragraph, int delta);
+    uint32_t GetLinesBefore(size_t paragraph) const;
+    size_t FindParagraph(uint32_t line) const;
+
+    const Text& LayoutParagraph(size_t paragraph);
+
+    std::shared_ptr<Font> m_font;
+    String m_string; // utf8 encoding.
+    String m_script;
+    std::shared_ptr<void> m_userData;
+    IntPoint m_origin;
+    IntPoint m_size;
+    TextHorizontalAlign m_horizontalAlign;
+    uint32_t m_optionFlags;
+    int m_scrollY;
+
+    // byte offset of each paragraph, followed by the size of the string.
+    Vector<size_t> m_paragraphStartVec;
+    Vector<uint32_t> m_lineCountVec;
+    Vector<uint32_t> m_lineTree;
+
+    // paragraphs that are laid out, only those near the viewport are kept.
+    typedef std::unique_ptr<Text, AllocatorDelete<Text>> TextPtr;
+    Map<size_t, TextPtr> m_textMap;
+    std::shared_ptr<QuadSnapshot> m_snapshot;
+
+    GB_NO_COPY(Document)
+};
+
+} // namespace gb
+
+#endif // GB_DOCUMENT_H
@@ -0,0 +1,241 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#ifdef GB_USE_HARFBUZZ
+#include <harfbuzz/hb.h>
+#include <harfbuzz/hb-ot.h>
+#endif
+#include <ft2build.h>
+#include FT_SIZES_H
+#include "face.h"
+
+namespace gb {
+
+Face::Face(Allocator& allocator, FT_Library ftLibrary, const std::string& filename) :
+    m_filename(filename.data(), filename.size(), allocator),
+    m_data(nullptr),
+    m_dataSize(0),
+    m_contentHash(0),
+    m_ftFace(nullptr),
+    m_threadFaceTable(allocator),
+    m_releasedFTSizeVec(allocator),
+    m_coverageVec(allocator),
+    m_coverageBuilt(false)
+#ifdef GB_USE_HARFBUZZ
+    , m_hbFace(nullptr)
+    , m_substitutedGlyphVec(allocator)
+    , m_substitutedGlyphsBuilt(false)
+#endif
+{
+    if (!m_mappedFile.Open(filename.c_str()))
+    {
+        fprintf(stderr, "Error mapping font \"%s\"\n", filename.c_str());
+        abort();
+    }
+    m_data = m_mappedFile.GetData();
+    m_dataSize = m_mappedFile.GetSize();
+    Init(ftLibrary);
+}
+
+Face::Face(Allocator& allocator, FT_Library ftLibrary, const uint8_t* data, size_t size) :
+    m_filename(allocator),
+    m_data(data),
+    m_dataSize(size),
+    m_contentHash(0),
+    m_ftFace(nullptr),
+    m_threadFaceTable(allocator),
+    m_releasedFTSizeVec(allocator),
+    m_coverageVec(allocator),
+    m_coverageBuilt(false)
+#ifdef GB_USE_HARFBUZZ
+    , m_hbFace(nullptr)
+    , m_substitutedGlyphVec(allocator)
+    , m_substitutedGlyphsBuilt(false)
+#endif
+{
+    Init(ftLibrary);
+}
+
+Face::~Face()
+{
+#ifdef GB_USE_HARFBUZZ
+    // must be released before the memory it references.
+    if (m_hbFace)
+        hb_face_destroy(m_hbFace);
+#endif
+
+    // the thread faces free the sizes still on them, released or not.
+    m_threadFaceTable.ForEach([](uint32_t, ThreadFace& threadFace)
+    {
+        FT_Face ftFace = threadFace.ftFace.load(std::memory_order_relaxed);
+        if (ftFace)
+            FT_Done_Face(ftFace);
+    });
+
+    // the mapping is released after this, by m_mappedFile.
+    if (m_ftFace)
+        FT_Done_Face(m_ftFace);
+}
+
+FT_Face Face::GetThreadFTFace(uint32_t slot, FT_Library ftLibrary, std::mutex& ftLibraryMutex) const
+{
+    ThreadFace& threadFace = m_threadFaceTable.Get(slot);
+    FT_Face ftFace = threadFace.ftFace.load(std::memory_order_relaxed);
+    if (!ftFace)
+    {
+        // a face of its own, reading from the same memory as the shared one.
+        {
+            std::lock_guard<std::mutex> lock(ftLibraryMutex);
+            FT_New_Memory_Face(ftLibrary, m_data, (FT_Long)m_dataSize, 0, &ftFace);
+        }
+        if (!ftFace)
+        {
+            fprintf(stderr, "Error loading font \"%s\"\n", m_filename.c_str());
+            abort();
+        }
+        threadFace.ftFace.store(ftFace, std::memory_order_relaxed);
+    }
+    else if (threadFace.numReleasedFTSizes.load(std::memory_order_relaxed))
+    {
+        // sizes of fonts destroyed since this thread last used the face.
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (size_t i = 0; i < m_releasedFTSizeVec.size();)
+        {
+            if (m_releasedFTSizeVec[i].first == slot)
+            {
+                FT_Done_Size(m_releasedFTSizeVec[i].second);
+                m_releasedFTSizeVec[i] = m_releasedFTSizeVec.back();
+                m_releasedFTSizeVec.pop_back();
+            }
+            else
+            {
+                i++;
+            }
+        }
+        threadFace.numReleasedFTSizes.store(0, std::memory_order_relaxed);
+    }
+    return ftFace;
+}
+
+void Face::ReleaseThreadFTSize(uint32_t slot, FT_Size ftSize) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_releasedFTSizeVec.push_back(std::make_pair(slot, ftSize));
+    m_threadFaceTable.Get(slot).numReleasedFTSizes.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Face::Init(FT_Library ftLibrary)
+{
+    FT_New_Memory_Face(ftLibrary, m_data, (FT_Long)m_dataSize, 0, &m_ftFace);
+    if (!m_ftFace)
+    {
+        fprintf(stderr, "Error loading font \"%s\"\n", m_filename.c_str());
+        abort();
+    }
+
+#ifdef GB_USE_HARFBUZZ
+    // the harfbuzz face only depends on the font tables, so it is shared by every size.
+    // the blob points directly at the font data, harfbuzz will not copy the tables.
+    hb_blob_t* blob = hb_blob_create((const char*)m_data, (unsigned int)m_dataSize,
+                                     HB_MEMORY_MODE_READONLY, nullptr, nullptr);
+    m_hbFace = hb_face_create(blob, 0);
+    hb_blob_destroy(blob);
+#endif
+}
+
+void Face::BuildCoverage() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_coverageBuilt.load(std::memory_order_relaxed))
+        return;
+
+    // walk the cmap once, instead of a lookup per code point.
+    Vector<uint32_t> codePointVec(m_coverageVec.get_allocator());
+    FT_UInt index;
+    FT_ULong codePoint = FT_Get_First_Char(m_ftFace, &index);
+    while (index != 0)
+    {
+        codePointVec.push_back((uint32_t)codePoint);
+        codePoint = FT_Get_Next_Char(m_ftFace, codePoint, &index);
+    }
+
+    // always at least one word, so the bitset is only built once.
+    const uint32_t maxCodePoint = codePointVec.empty() ? 0 : *std::max_element(codePointVec.begin(), codePointVec.end());
+    m_coverageVec.assign(maxCodePoint / 64 + 1, 0);
+    for (auto cp : codePointVec)
+        m_coverageVec[cp >> 6] |= 1ull << (cp & 63);
+    m_coverageBuilt.store(true, std::memory_order_release);
+}
+
+#ifdef GB_USE_HARFBUZZ
+bool Face::IsSubstitutedGlyph(uint32_t glyphIndex) const
+{
+    if (!m_substitutedGlyphsBuilt.load(std::memory_order_acquire))
+        BuildSubstitutedGlyphs();
+    return glyphIndex < m_substitutedGlyphVec.size() ? m_substitutedGlyphVec[glyphIndex] : true;
+}
+
+void Face::BuildSubstitutedGlyphs() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_substitutedGlyphsBuilt.load(std::memory_order_relaxed))
+        return;
+
+    m_substitutedGlyphVec.resize(m_ftFace->num_glyphs + 1, false);
+
+    // GSUB features harfbuzz applies to horizontal text without being asked, in any script.
+    // GPOS is not listed, positions come from the kern table during word wrapping.
+    const hb_tag_t features[] = {
+        HB_TAG('c','c','m','p'), HB_TAG('l','o','c','l'), HB_TAG('r','l','i','g'),
+        HB_TAG('l','i','g','a'), HB_TAG('c','l','i','g'), HB_TAG('c','a','l','t'),
+        HB_TAG('r','c','l','t'), HB_TAG_NONE
+    };
+    hb_set_t* lookups = hb_set_create();
+    hb_set_t* glyphs = hb_set_create();
+    hb_ot_layout_collect_lookups(m_hbFace, HB_OT_TAG_GSUB, nullptr, nullptr, features, lookups);
+    hb_codepoint_t lookup = HB_SET_VALUE_INVALID;
+    while (hb_set_next(lookups, &lookup))
+    {
+        // context glyphs count too, they change what the input glyphs become.
+        hb_ot_layout_lookup_collect_glyphs(m_hbFace, HB_OT_TAG_GSUB, lookup, glyphs, glyphs, glyphs, nullptr);
+    }
+    hb_codepoint_t glyph = HB_SET_VALUE_INVALID;
+    while (hb_set_next(glyphs, &glyph))
+    {
+        if (glyph < m_substitutedGlyphVec.size())
+            m_substitutedGlyphVec[glyph] = true;
+    }
+    hb_set_destroy(glyphs);
+    hb_set_destroy(lookups);
+    m_substitutedGlyphsBuilt.store(true, std::memory_order_release);
+}
+#endif
+
+uint64_t Face::GetContentHash() const
+{
+    // threads racing to hash the same data store the same value.
+    if (m_contentHash.load(std::memory_order_relaxed) == 0)
+    {
+        // FNV-1a style, but consuming 8 bytes per step.
+        const uint64_t kPrime = 0x100000001b3ULL;
+        uint64_t hash = 0xcbf29ce484222325ULL ^ (uint64_t)m_dataSize;
+        const size_t numWords = m_dataSize / 8;
+        for (size_t i = 0; i < numWords; i++)
+        {
+            uint64_t word;
+            memcpy(&word, m_data + i * 8, 8);
+            hash = (hash ^ word) * kPrime;
+        }
+        for (size_t i = numWords * 8; i < m_dataSize; i++)
+        {
+            hash = (hash ^ m_data[i]) * kPrime;
+        }
+
+        // zero is reserved for "not computed yet"
+        m_contentHash.store(hash ? hash : 1, std::memory_order_relaxed);
+    }
+    return m_contentHash.load(std::memory_order_relaxed);
+}
+
+} // namespace gb
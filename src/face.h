@@ -0,0 +1,119 @@
+#ifndef GB_FACE_H
+#define GB_FACE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include <utility>
+#include <mutex>
+#include <atomic>
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#ifdef GB_USE_HARFBUZZ
+#include <harfbuzz/hb.h>
+#endif
+#include "glyphblaster.h"
+#include "mappedfile.h"
+#include "allocator.h"
+#include "threadslot.h"
+
+namespace gb {
+
+// A single parsed font file.
+// Faces are shared by every Font created from the same file, regardless of point size.
+// Each Font owns an FT_Size object and must activate it before using the FT_Face.
+// In a thread-safe Context each thread gets an FT_Face of its own, shared by every size the same way.
+//
+// The font data is never copied, FreeType and HarfBuzz both read from the same memory,
+// which is either a read-only mapping of the file or a buffer owned by the caller.
+//
+// The tables built on first use are safe to build from several threads at once.
+// The shared FT_Face is not, hold GetMutex() while using it from a thread-safe Context.
+class Face
+{
+public:
+    // maps the file into memory.  the tables come from allocator, see Context::GetAllocator().
+    Face(Allocator& allocator, FT_Library ftLibrary, const std::string& filename);
+
+    // data must remain valid for the lifetime of the face.
+    Face(Allocator& allocator, FT_Library ftLibrary, const uint8_t* data, size_t size);
+    ~Face();
+
+    const String& GetFilename() const { return m_filename; }
+    const uint8_t* GetData() const { return m_data; }
+    size_t GetDataSize() const { return m_dataSize; }
+    FT_Face GetFTFace() const { return m_ftFace; }
+    std::mutex& GetMutex() const { return m_mutex; }
+
+    // the FT_Face of the thread in slot, created on first use.  only that thread may use it.
+    // ftLibraryMutex serializes the FT_Library calls, see Context.
+    FT_Face GetThreadFTFace(uint32_t slot, FT_Library ftLibrary, std::mutex& ftLibraryMutex) const;
+
+    // a Font's FT_Size on the FT_Face of slot, which the font no longer uses.  only the thread in slot
+    // may change its face, so the size is freed by GetThreadFTFace() on that thread, or with the face.
+    void ReleaseThreadFTSize(uint32_t slot, FT_Size ftSize) const;
+#ifdef GB_USE_HARFBUZZ
+    hb_face_t* GetHarfBuzzFace() const { return m_hbFace; }
+
+    // true if any GSUB lookup enabled by default when shaping (ligatures, contextual alternates,
+    // composition...) references the glyph.  text made only of other glyphs can skip HarfBuzz.
+    bool IsSubstitutedGlyph(uint32_t glyphIndex) const;
+#endif
+
+    // true if the cmap maps the code point, a bit test in a coverage bitset built on first use.
+    bool HasCodePoint(uint32_t codePoint) const
+    {
+        if (!m_coverageBuilt.load(std::memory_order_acquire))
+            BuildCoverage();
+        const uint32_t word = codePoint >> 6;
+        return word < m_coverageVec.size() && ((m_coverageVec[word] >> (codePoint & 63)) & 1) != 0;
+    }
+
+    // hash of the font data, used to identify the font in persistent caches.
+    // computed on first use.
+    uint64_t GetContentHash() const;
+
+protected:
+    void Init(FT_Library ftLibrary);
+    void BuildCoverage() const;
+#ifdef GB_USE_HARFBUZZ
+    void BuildSubstitutedGlyphs() const;
+#endif
+
+    String m_filename;
+    MappedFile m_mappedFile;
+    const uint8_t* m_data;
+    size_t m_dataSize;
+    mutable std::atomic<uint64_t> m_contentHash;
+    FT_Face m_ftFace;
+    mutable std::mutex m_mutex;
+
+    // per-thread faces, only used in thread-safe contexts.
+    struct ThreadFace
+    {
+        std::atomic<FT_Face> ftFace;
+        std::atomic<uint32_t> numReleasedFTSizes;
+    };
+    mutable ThreadSlotTable<ThreadFace> m_threadFaceTable;
+
+    // sizes waiting for the thread of their slot, guarded by m_mutex.
+    mutable Vector<std::pair<uint32_t, FT_Size>> m_releasedFTSizeVec;
+
+    // one bit per code point, up to the highest one in the cmap.
+    mutable Vector<uint64_t> m_coverageVec;
+    mutable std::atomic<bool> m_coverageBuilt;
+#ifdef GB_USE_HARFBUZZ
+    hb_face_t* m_hbFace;
+
+    // indexed by glyph index, built on first use.
+    mutable Vector<bool> m_substitutedGlyphVec;
+    mutable std::atomic<bool> m_substitutedGlyphsBuilt;
+#endif
+
+    GB_NO_COPY(Face)
+};
+
+} // namespace gb
+
+#endif // GB_FACE_H
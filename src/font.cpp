@@ -1,74 +1,494 @@
+#include <algorithm>
+#include <vector>
+#include <mutex>
 #ifdef GB_USE_HARFBUZZ
 #include <harfbuzz/hb.h>
-#include <harfbuzz/hb-ft.h>
+#include <harfbuzz/hb-ot.h>
 #endif
+#include <ft2build.h>
+#include FT_SIZES_H
 #include "font.h"
 #include "context.h"
+#include "face.h"
 #include "glyph.h"
 #include "cache.h"
-#include "font.h"
+#include "utf8.h"
 
 // 26.6 fixed to int (truncates)
 #define FIXED_TO_INT(n) (uint32_t)(n >> 6)
 
 namespace gb {
 
-Font::Font(const std::string filename, uint32_t pointSize, uint32_t paddingBorder,
+// small ids for the threads using thread-safe contexts, a slot is reused once its thread exits.
+class ThreadSlot
+{
+public:
+    ThreadSlot()
+    {
+        std::lock_guard<std::mutex> lock(s_mutex);
+        if (!s_freeSlotVec.empty())
+        {
+            m_slot = s_freeSlotVec.back();
+            s_freeSlotVec.pop_back();
+        }
+        else
+        {
+            m_slot = s_numSlots++;
+        }
+    }
+    ~ThreadSlot()
+    {
+        std::lock_guard<std::mutex> lock(s_mutex);
+        s_freeSlotVec.push_back(m_slot);
+    }
+    uint32_t GetSlot() const { return m_slot; }
+protected:
+    uint32_t m_slot;
+    static std::mutex s_mutex;
+    static std::vector<uint32_t> s_freeSlotVec;
+    static uint32_t s_numSlots;
+};
+
+std::mutex ThreadSlot::s_mutex;
+std::vector<uint32_t> ThreadSlot::s_freeSlotVec;
+uint32_t ThreadSlot::s_numSlots = 0;
+
+// sets the size of the active FT_Size, returns how much bitmaps from the selected strike must be scaled.
+static float SetFTFaceSize(FT_Face ftFace, uint32_t pointSize)
+{
+    if (!FT_IS_SCALABLE(ftFace) && FT_HAS_FIXED_SIZES(ftFace))
+    {
+        // the smallest strike at least as large as the point size, the largest one otherwise.
+        int strike = 0;
+        for (int i = 1; i < ftFace->num_fixed_sizes; i++)
+        {
+            const FT_Pos best = ftFace->available_sizes[strike].y_ppem;
+            const FT_Pos ppem = ftFace->available_sizes[i].y_ppem;
+            const FT_Pos wanted = (FT_Pos)pointSize * 64;
+            if (best < wanted ? ppem > best : (ppem >= wanted && ppem < best))
+                strike = i;
+        }
+        FT_Select_Size(ftFace, strike);
+        return (float)pointSize * 64.0f / (float)ftFace->available_sizes[strike].y_ppem;
+    }
+
+    FT_Set_Char_Size(ftFace, (int)(pointSize * 64), 0, 72, 72);
+    return 1.0f;
+}
+
+Font::Font(Context& context, const std::string filename, uint32_t pointSize, uint32_t paddingBorder,
+           FontRenderOption renderOption, FontHintOption hintOption) :
+    m_context(context),
+    m_ftSize(nullptr),
+#ifdef GB_USE_HARFBUZZ
+    m_hbFont(nullptr),
+#endif
+    m_pointSize(pointSize),
+    m_bitmapScale(1.0f),
+    m_paddingBorder(paddingBorder),
+    m_renderOption(renderOption),
+    m_hintOption(hintOption),
+    m_threadFTSizeTable(context.GetAllocator()),
+    m_cmapPageTable(nullptr),
+    m_glyphMetricsVec(context.GetAllocator())
+{
+    // font files are only mapped once, each point size gets its own FT_Size.
+    m_face = context.GetFace(filename);
+    Init(pointSize);
+
+    // notify context
+    context.OnFontCreate(this);
+}
+
+Font::Font(Context& context, const uint8_t* data, size_t size, uint32_t pointSize, uint32_t paddingBorder,
            FontRenderOption renderOption, FontHintOption hintOption) :
-    m_ftFace(nullptr),
+    m_context(context),
+    m_ftSize(nullptr),
 #ifdef GB_USE_HARFBUZZ
     m_hbFont(nullptr),
 #endif
+    m_pointSize(pointSize),
+    m_bitmapScale(1.0f),
     m_paddingBorder(paddingBorder),
     m_renderOption(renderOption),
-    m_hintOption(hintOption)
+    m_hintOption(hintOption),
+    m_threadFTSizeTable(context.GetAllocator()),
+    m_cmapPageTable(nullptr),
+    m_glyphMetricsVec(context.GetAllocator())
+{
+    // buffers are shared the same way as files, keyed by address.
+    m_face = context.GetFace(data, size);
+    Init(pointSize);
+
+    // notify context
+    context.OnFontCreate(this);
+}
+
+Font::Font(const std::string filename, uint32_t pointSize, uint32_t paddingBorder,
+           FontRenderOption renderOption, FontHintOption hintOption) :
+    Font(Context::Get(), filename, pointSize, paddingBorder, renderOption, hintOption)
 {
-    Context& context = Context::Get();
+}
 
-    FT_New_Face(context.GetFTLibrary(), filename.c_str(), 0, &m_ftFace);
-    if (!m_ftFace)
+Font::Font(const uint8_t* data, size_t size, uint32_t pointSize, uint32_t paddingBorder,
+           FontRenderOption renderOption, FontHintOption hintOption) :
+    Font(Context::Get(), data, size, pointSize, paddingBorder, renderOption, hintOption)
+{
+}
+
+void Font::Init(uint32_t pointSize)
+{
+    for (int i = 0; i < kCmapPageSize; i++)
     {
-        fprintf(stderr, "Error loading font \"%s\"\n", filename.c_str());
+        m_latin1Cmap[i].store(kUnmappedGlyphIndex, std::memory_order_relaxed);
+    }
+
+    FT_Face ftFace = m_face->GetFTFace();
+    std::unique_lock<std::mutex> faceLock(m_face->GetMutex());
+    if (FT_New_Size(ftFace, &m_ftSize))
+    {
+        fprintf(stderr, "Error creating size for font \"%s\"\n", m_face->GetFilename().c_str());
         abort();
     }
 
     // set point size
-    FT_Set_Char_Size(m_ftFace, (int)(pointSize * 64), 0, 72, 72);
+    FT_Activate_Size(m_ftSize);
+    m_bitmapScale = SetFTFaceSize(ftFace, pointSize);
+    faceLock.unlock();
+
+    // at least one entry, for the missing glyph.
+    const size_t numGlyphs = std::max<FT_Long>(ftFace->num_glyphs, 1);
+    Allocator& allocator = m_context.GetAllocator();
+    m_glyphMetricsVec.resize(numGlyphs);
+    m_glyphMetricsLoadedVec = std::unique_ptr<std::atomic<bool>[], AllocatorFree>(
+        (std::atomic<bool>*)allocator.Allocate(numGlyphs * sizeof(std::atomic<bool>), alignof(std::atomic<bool>)),
+        AllocatorFree{&allocator});
+    for (size_t i = 0; i < numGlyphs; i++)
+    {
+        new (&m_glyphMetricsLoadedVec[i]) std::atomic<bool>(false);
+    }
 
 #ifdef GB_USE_HARFBUZZ
-    // create harfbuzz font
-    m_hbFont = hb_ft_font_create(m_ftFace, 0);
-    hb_ft_font_set_funcs(m_hbFont);
-#endif
+    // create harfbuzz font on top of the shared harfbuzz face.
+    // use the OpenType funcs, the FreeType ones would read from whichever FT_Size is active.
+    m_hbFont = hb_font_create(m_face->GetHarfBuzzFace());
+    hb_ot_font_set_funcs(m_hbFont);
 
-    // notify context
-    context.OnFontCreate(this);
+    // scale the same way hb_ft_font_create does.
+    const FT_Size_Metrics& metrics = m_ftSize->metrics;
+    hb_font_set_scale(m_hbFont,
+                      (int)(((uint64_t)metrics.x_scale * (uint64_t)ftFace->units_per_EM + (1u << 15)) >> 16),
+                      (int)(((uint64_t)metrics.y_scale * (uint64_t)ftFace->units_per_EM + (1u << 15)) >> 16));
+    hb_font_set_ppem(m_hbFont, metrics.x_ppem, metrics.y_ppem);
+#endif
 }
 
 Font::~Font()
 {
-    Context& context = Context::Get();
-
     // notify context
-    context.OnFontDestroy(this);
-
-    if (m_ftFace)
-        FT_Done_Face(m_ftFace);
+    m_context.OnFontDestroy(this);
 
 #ifdef GB_USE_HARFBUZZ
     if (m_hbFont)
         hb_font_destroy(m_hbFont);
 #endif
+
+    if (m_ftSize)
+    {
+        std::lock_guard<std::mutex> faceLock(m_face->GetMutex());
+        FT_Done_Size(m_ftSize);
+    }
+
+    CmapPagePtr* pageTable = m_cmapPageTable.load(std::memory_order_relaxed);
+    if (pageTable)
+    {
+        for (int i = 0; i < kNumCmapPages; i++)
+        {
+            CmapEntry* cmapPage = pageTable[i].load(std::memory_order_relaxed);
+            if (cmapPage)
+                m_context.GetAllocator().Free(cmapPage);
+        }
+        m_context.GetAllocator().Free(pageTable);
+    }
+
+    // the thread faces belong to their threads, which free the sizes on them.
+    m_threadFTSizeTable.ForEach([this](uint32_t slot, std::atomic<FT_Size>& threadFTSize)
+    {
+        FT_Size ftSize = threadFTSize.load(std::memory_order_relaxed);
+        if (ftSize)
+            m_face->ReleaseThreadFTSize(slot, ftSize);
+    });
+
+    // FT_Library calls are serialized by the context, including the release of the face itself,
+    // which happens here when the last font using it goes away.
+    auto lock = m_context.Lock(m_context.m_fontMutex);
+    m_face.reset();
+}
+
+FT_Face Font::GetFTFace() const
+{
+    if (m_context.IsThreadSafe())
+    {
+        static thread_local ThreadSlot s_threadSlot;
+        const uint32_t slot = s_threadSlot.GetSlot();
+        FT_Face ftFace = m_face->GetThreadFTFace(slot, m_context.GetFTLibrary(), m_context.m_fontMutex);
+        std::atomic<FT_Size>& threadFTSize = m_threadFTSizeTable.Get(slot);
+        FT_Size ftSize = threadFTSize.load(std::memory_order_relaxed);
+        if (!ftSize)
+        {
+            ftSize = CreateThreadFTSize(ftFace);
+            threadFTSize.store(ftSize, std::memory_order_relaxed);
+        }
+        else
+        {
+            FT_Activate_Size(ftSize);
+        }
+        return ftFace;
+    }
+
+    FT_Activate_Size(m_ftSize);
+    return m_face->GetFTFace();
+}
+
+FT_Size Font::CreateThreadFTSize(FT_Face ftFace) const
+{
+    FT_Size ftSize = nullptr;
+    if (FT_New_Size(ftFace, &ftSize))
+    {
+        fprintf(stderr, "Error creating size for font \"%s\"\n", m_face->GetFilename().c_str());
+        abort();
+    }
+    FT_Activate_Size(ftSize);
+    SetFTFaceSize(ftFace, m_pointSize);
+    return ftSize;
+}
+
+uint32_t Font::GetGlyphIndex(uint32_t codePoint) const
+{
+    CmapEntry* cmapPage;
+    if (codePoint < kCmapPageSize)
+        cmapPage = m_latin1Cmap;
+    else if (codePoint / kCmapPageSize < kNumCmapPages)
+        cmapPage = GetCmapPage(codePoint / kCmapPageSize);
+    else
+        return 0;
+
+    // threads racing to fill the same entry store the same index.
+    CmapEntry& entry = cmapPage[codePoint % kCmapPageSize];
+    uint32_t index = entry.load(std::memory_order_relaxed);
+    if (index == kUnmappedGlyphIndex)
+    {
+        index = LookupGlyphIndex(codePoint);
+        entry.store((uint16_t)index, std::memory_order_relaxed);
+    }
+    return index;
+}
+
+Font::CmapEntry* Font::GetCmapPage(uint32_t page) const
+{
+    CmapPagePtr* pageTable = m_cmapPageTable.load(std::memory_order_acquire);
+    CmapEntry* cmapPage = pageTable ? pageTable[page].load(std::memory_order_acquire) : nullptr;
+    if (cmapPage)
+        return cmapPage;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    pageTable = m_cmapPageTable.load(std::memory_order_relaxed);
+    if (!pageTable)
+    {
+        pageTable = (CmapPagePtr*)m_context.GetAllocator().Allocate(kNumCmapPages * sizeof(CmapPagePtr), alignof(CmapPagePtr));
+        for (int i = 0; i < kNumCmapPages; i++)
+        {
+            new (pageTable + i) CmapPagePtr(nullptr);
+        }
+        m_cmapPageTable.store(pageTable, std::memory_order_release);
+    }
+
+    cmapPage = pageTable[page].load(std::memory_order_relaxed);
+    if (!cmapPage)
+    {
+        cmapPage = (CmapEntry*)m_context.GetAllocator().Allocate(kCmapPageSize * sizeof(CmapEntry), alignof(CmapEntry));
+        for (int i = 0; i < kCmapPageSize; i++)
+        {
+            new (cmapPage + i) CmapEntry(kUnmappedGlyphIndex);
+        }
+        pageTable[page].store(cmapPage, std::memory_order_release);
+    }
+    return cmapPage;
+}
+
+bool Font::HasCodePoint(uint32_t codePoint) const
+{
+    return m_face->HasCodePoint(codePoint);
+}
+
+uint32_t Font::LookupGlyphIndex(uint32_t codePoint) const
+{
+    // glyph indices are 16 bit in both TrueType & CFF, so 0xffff can never be a real glyph.
+    FT_UInt index = FT_Get_Char_Index(GetFTFace(), codePoint);
+    return index < kUnmappedGlyphIndex ? index : 0;
+}
+
+uint32_t Font::GetFTLoadFlags() const
+{
+    uint32_t ftLoadFlags;
+
+    switch (m_hintOption)
+    {
+    default:
+    case FontHintOption_Default:
+        ftLoadFlags = FT_LOAD_DEFAULT;
+        break;
+    case FontHintOption_ForceAuto:
+        ftLoadFlags = FT_LOAD_FORCE_AUTOHINT;
+        break;
+    case FontHintOption_NoAuto:
+        ftLoadFlags = FT_LOAD_NO_AUTOHINT;
+        break;
+    case FontHintOption_None:
+        ftLoadFlags = FT_LOAD_NO_HINTING;
+        break;
+    }
+
+    switch (m_renderOption)
+    {
+    default:
+    case FontRenderOption_Normal:
+        ftLoadFlags |= FT_LOAD_TARGET_NORMAL;
+        break;
+    case FontRenderOption_Light:
+        ftLoadFlags |= FT_LOAD_TARGET_LIGHT;
+        break;
+    case FontRenderOption_Mono:
+        ftLoadFlags |= FT_LOAD_TARGET_MONO;
+        break;
+    case FontRenderOption_LCD_RGB:
+    case FontRenderOption_LCD_BGR:
+        // Only do sub-pixel anti-aliasing if we are using RGBA textures.
+        if (m_context.GetTextureFormat() == TextureFormat_RGBA)
+            ftLoadFlags |= FT_LOAD_TARGET_LCD;
+        break;
+    case FontRenderOption_LCD_RGB_V:
+    case FontRenderOption_LCD_BGR_V:
+        // Only do sub-pixel anti-aliasing if we are using RGBA textures.
+        if (m_context.GetTextureFormat() == TextureFormat_RGBA)
+            ftLoadFlags |= FT_LOAD_TARGET_LCD_V;
+        break;
+    }
+
+    // color bitmaps and layers, rendered to BGRA.
+    if (FT_HAS_COLOR(m_face->GetFTFace()))
+        ftLoadFlags |= FT_LOAD_COLOR;
+
+    return ftLoadFlags;
+}
+
+const GlyphMetrics& Font::GetGlyphMetrics(uint32_t glyphIndex) const
+{
+    // out of range indices use the missing glyph.
+    if (glyphIndex >= m_glyphMetricsVec.size())
+        glyphIndex = 0;
+
+    GlyphMetrics& metrics = m_glyphMetricsVec[glyphIndex];
+    if (!m_glyphMetricsLoadedVec[glyphIndex].load(std::memory_order_acquire))
+    {
+        // hinting changes the advance, so load with the same flags used for rasterization.
+        // embedded bitmaps are only skipped when the face has none, their metrics can differ from the outlines.
+        FT_Face ftFace = GetFTFace();
+        uint32_t ftLoadFlags = GetFTLoadFlags();
+        if (!FT_HAS_FIXED_SIZES(ftFace))
+            ftLoadFlags |= FT_LOAD_NO_BITMAP;
+
+        GlyphMetrics loadedMetrics = {0, 0, 0, 0, 0};
+        if (FT_Load_Glyph(ftFace, glyphIndex, ftLoadFlags) == 0)
+        {
+            const FT_Glyph_Metrics& ftMetrics = ftFace->glyph->metrics;
+            const float s = m_bitmapScale;
+            loadedMetrics = GlyphMetrics{(int32_t)(ftMetrics.horiAdvance * s), (int32_t)(ftMetrics.horiBearingX * s),
+                                         (int32_t)(ftMetrics.horiBearingY * s), (int32_t)(ftMetrics.width * s),
+                                         (int32_t)(ftMetrics.height * s)};
+        }
+
+        // another thread may have loaded the same glyph meanwhile, only one of them stores it.
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_glyphMetricsLoadedVec[glyphIndex].load(std::memory_order_relaxed))
+        {
+            metrics = loadedMetrics;
+            m_glyphMetricsLoadedVec[glyphIndex].store(true, std::memory_order_release);
+        }
+    }
+    return metrics;
+}
+
+int Font::GetAdvance(uint32_t glyphIndex) const
+{
+    return FIXED_TO_INT(GetGlyphMetrics(glyphIndex).advance);
 }
 
 int Font::GetMaxAdvance() const
 {
-    return FIXED_TO_INT(m_ftFace->size->metrics.max_advance);
+    return FIXED_TO_INT((FT_Pos)(m_ftSize->metrics.max_advance * m_bitmapScale));
 }
 
 int Font::GetLineHeight() const
 {
-    return FIXED_TO_INT(m_ftFace->size->metrics.height);
+    return FIXED_TO_INT((FT_Pos)(m_ftSize->metrics.height * m_bitmapScale));
+}
+
+void Font::Preload(const std::vector<CodePointRange>& rangeVec, bool pin)
+{
+    FT_Face ftFace = GetFTFace();
+    std::vector<uint32_t> glyphIndexVec;
+    for (auto &range : rangeVec)
+    {
+        // walk the cmap instead of probing every code point, ranges can be sparse.
+        FT_UInt index;
+        FT_ULong codePoint = range.first ? FT_Get_Next_Char(ftFace, range.first - 1, &index)
+                                         : FT_Get_First_Char(ftFace, &index);
+        while (index != 0 && codePoint <= range.last)
+        {
+            glyphIndexVec.push_back(index);
+            codePoint = FT_Get_Next_Char(ftFace, codePoint, &index);
+        }
+    }
+    Preload(glyphIndexVec, pin);
+}
+
+void Font::Preload(const std::string& sample, bool pin)
+{
+    Vector<uint32_t> codePointVec(m_context.GetAllocator()), clusterVec(m_context.GetAllocator());
+    DecodeUTF8(sample.c_str(), sample.size(), codePointVec, clusterVec);
+
+    std::vector<uint32_t> glyphIndexVec;
+    glyphIndexVec.reserve(codePointVec.size());
+    for (auto codePoint : codePointVec)
+    {
+        glyphIndexVec.push_back(GetGlyphIndex(codePoint));
+    }
+    Preload(glyphIndexVec, pin);
+}
+
+void Font::Preload(std::vector<uint32_t>& glyphIndexVec, bool pin)
+{
+    std::sort(glyphIndexVec.begin(), glyphIndexVec.end());
+    glyphIndexVec.erase(std::unique(glyphIndexVec.begin(), glyphIndexVec.end()), glyphIndexVec.end());
+
+    Vector<GlyphKey> keyVec(m_context.GetAllocator());
+    keyVec.reserve(glyphIndexVec.size());
+    for (auto index : glyphIndexVec)
+    {
+        // index 0 is the missing glyph.
+        if (index != 0)
+            keyVec.push_back(GlyphKey(index, m_index));
+    }
+
+    Vector<const Glyph*> glyphVec(m_context.GetAllocator());
+    Vector<GlyphHandle> handleVec(m_context.GetAllocator());
+    GlyphBatchScratch scratch(m_context.GetAllocator());
+    m_context.RasterizeAndSubloadGlyphs(keyVec, glyphVec, handleVec, scratch);
+    if (pin)
+        m_context.PinGlyphs(handleVec);
+    else
+        m_context.ReleaseGlyphs(handleVec);
 }
 
 } // namespace gb
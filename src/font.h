@@ -2,54 +2,149 @@
 #define GB_FONT_H
 
 #include <stdint.h>
+#include <stddef.h>
 #include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
 #include <ft2build.h>
 #include FT_FREETYPE_H
 #ifdef GB_USE_HARFBUZZ
 #include <harfbuzz/hb.h>
 #endif
 #include "glyphblaster.h"
+#include "threadslot.h"
+#include "allocator.h"
 
 namespace gb {
 
 class Context;
+class Face;
+
+// layout metrics of a single glyph, all values are 26.6 fixed point.
+struct GlyphMetrics
+{
+    int32_t advance;
+    int32_t bearingX;
+    int32_t bearingY;
+    int32_t width;
+    int32_t height;
+};
 
 class Font
 {
     friend class Context;
+    friend class FontFamily;
     friend class Glyph;
     friend class Text;
 public:
+    // context - owns the glyphs, the font must be destroyed before it.
     // filename - ttf or otf font
     // pointSize - pixels per em
     // paddingBorder - border around each glyph in pixels
     // renderOption - controls how anti-aliasing is preformed during glyph rendering.
     // hintOption - controls which hinting algorithm is chosen during glyph rendering.
+    Font(Context& context, const std::string filename, uint32_t pointSize, uint32_t paddingBorder,
+         FontRenderOption renderOption, FontHintOption hintOption);
+
+    // data - ttf or otf font in memory, must remain valid for the lifetime of the font.
+    Font(Context& context, const uint8_t* data, size_t size, uint32_t pointSize, uint32_t paddingBorder,
+         FontRenderOption renderOption, FontHintOption hintOption);
+
+    // same as above, in the default context, see Context::Init().
     Font(const std::string filename, uint32_t pointSize, uint32_t paddingBorder,
          FontRenderOption renderOption, FontHintOption hintOption);
+    Font(const uint8_t* data, size_t size, uint32_t pointSize, uint32_t paddingBorder,
+         FontRenderOption renderOption, FontHintOption hintOption);
     ~Font();
 
+    Context& GetContext() const { return m_context; }
+
+    uint32_t GetPointSize() const { return m_pointSize; }
     uint32_t GetPaddingBorder() const { return m_paddingBorder; }
     FontRenderOption GetRenderOption() const { return m_renderOption; }
     FontHintOption GetHintOption() const { return m_hintOption; }
     int GetMaxAdvance() const;
     int GetLineHeight() const;
 
+    // maps a unicode code point to a glyph index, 0 if the font has no glyph for it.
+    uint32_t GetGlyphIndex(uint32_t codePoint) const;
+
+    // true if the font has a glyph for the code point, shared by every size of the same file.
+    bool HasCodePoint(uint32_t codePoint) const;
+
+    // layout metrics for a glyph, loaded on first use without rendering a bitmap.
+    const GlyphMetrics& GetGlyphMetrics(uint32_t glyphIndex) const;
+
+    // advance in pixels, matches Glyph::GetAdvance().
+    int GetAdvance(uint32_t glyphIndex) const;
+
+    // Rasterizes and subloads every glyph the font maps from the given code points in one batch,
+    // sorted by height for tighter atlas packing.  Code points missing from the font are skipped.
+    // pin - keep the glyphs resident even when no Text is using them, until the font is destroyed.
+    void Preload(const std::vector<CodePointRange>& rangeVec, bool pin = false);
+
+    // same as above, using every code point in a utf8 sample string.
+    void Preload(const std::string& sample, bool pin = false);
+
 protected:
+    void Init(uint32_t pointSize);
     uint32_t GetIndex() const { return m_index; }
-    FT_Face GetFTFace() const { return m_ftFace; }
+    const Face& GetFace() const { return *(m_face.get()); }
+    void Preload(std::vector<uint32_t>& glyphIndexVec, bool pin);
+
+    // The FT_Face is shared with every other Font using the same file,
+    // so this activates this font's FT_Size before returning it.
+    // In a thread-safe context each thread gets the face's FT_Face for that thread instead,
+    // with an FT_Size of this font's on it, activated the same way.
+    FT_Face GetFTFace() const;
+    FT_Size CreateThreadFTSize(FT_Face ftFace) const;
+
+    // FT_Load_Glyph flags for this font's hint & render options.
+    uint32_t GetFTLoadFlags() const;
+
+    // bitmap-only faces, such as color emoji, come in fixed strikes that are scaled to the point size.
+    // 1 for scalable faces.
+    float GetBitmapScale() const { return m_bitmapScale; }
 #ifdef GB_USE_HARFBUZZ
     hb_font_t* GetHarfBuzzFont() const { return m_hbFont; }
 #endif
 
+    Context& m_context;
     uint32_t m_index;
-    FT_Face m_ftFace;
+    std::shared_ptr<Face> m_face;
+    FT_Size m_ftSize;
 #ifdef GB_USE_HARFBUZZ
     hb_font_t* m_hbFont;
 #endif
+    uint32_t m_pointSize;
+    float m_bitmapScale;
     uint32_t m_paddingBorder;
     FontRenderOption m_renderOption;
     FontHintOption m_hintOption;
+
+    // this font's sizes on the per-thread faces of m_face, indexed by thread slot, only used in thread-safe contexts.
+    mutable ThreadSlotTable<std::atomic<FT_Size>> m_threadFTSizeTable;
+
+    // guards the lazily filled tables below, lookups that hit never take it.
+    mutable std::mutex m_mutex;
+
+    uint32_t LookupGlyphIndex(uint32_t codePoint) const;
+
+    // two level cmap cache, filled on demand.  page 0 (latin-1) is flat,
+    // the rest of unicode is split into 256 code point pages allocated on first use, which never move.
+    // kUnmappedGlyphIndex marks entries that have not been looked up yet.
+    enum { kCmapPageSize = 256, kNumCmapPages = 0x110000 / kCmapPageSize, kUnmappedGlyphIndex = 0xffff };
+    typedef std::atomic<uint16_t> CmapEntry;
+    typedef std::atomic<CmapEntry*> CmapPagePtr;
+    CmapEntry* GetCmapPage(uint32_t page) const;
+    mutable CmapEntry m_latin1Cmap[kCmapPageSize];
+    mutable std::atomic<CmapPagePtr*> m_cmapPageTable;
+
+    // dense table indexed by glyph index, sized in Init() and filled lazily.
+    mutable Vector<GlyphMetrics> m_glyphMetricsVec;
+    std::unique_ptr<std::atomic<bool>[], AllocatorFree> m_glyphMetricsLoadedVec;
 };
 
 } // namespace gb
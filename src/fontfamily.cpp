@@ -0,0 +1,99 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "fontfamily.h"
+#include "font.h"
+#include "face.h"
+#include "bidi.h"
+
+namespace gb {
+
+FontFamily::FontFamily(const std::vector<std::shared_ptr<Font>>& fontVec) :
+    m_fontVec(fontVec)
+{
+    if (m_fontVec.empty())
+    {
+        fprintf(stderr, "Error FontFamily needs at least one font\n");
+        abort();
+    }
+    for (auto &font : m_fontVec)
+    {
+        if (&font->GetContext() != &m_fontVec[0]->GetContext())
+        {
+            fprintf(stderr, "Error FontFamily fonts must belong to the same Context\n");
+            abort();
+        }
+        m_faceVec.push_back(&font->GetFace());
+    }
+}
+
+uint32_t FontFamily::FindFont(uint32_t codePoint) const
+{
+    for (size_t i = 0; i < m_faceVec.size(); i++)
+    {
+        if (m_faceVec[i]->HasCodePoint(codePoint))
+            return (uint32_t)i;
+    }
+    return 0;
+}
+
+// characters that belong to the cluster before them.
+static bool IsClusterContinuation(uint32_t codePoint)
+{
+    if (codePoint == 0x200c || codePoint == 0x200d) // zero width non-joiner & joiner
+        return true;
+    if ((codePoint >= 0xfe00 && codePoint <= 0xfe0f) || (codePoint >= 0xe0100 && codePoint <= 0xe01ef)) // variation selectors
+        return true;
+    if (codePoint >= 0x1f3fb && codePoint <= 0x1f3ff) // emoji skin tone modifiers
+        return true;
+    return GetBidiClass(codePoint) == BidiClass_NSM;
+}
+
+void FontFamily::Itemize(const uint32_t* codePoints, size_t count, Vector<FontRun>& runVecOut) const
+{
+    runVecOut.clear();
+    uint32_t current = 0;
+    const Face* primary = m_faceVec[0];
+    for (size_t i = 0; i < count; i++)
+    {
+        const uint32_t cp = codePoints[i];
+        uint32_t font;
+        const bool inCurrent = m_faceVec[current]->HasCodePoint(cp);
+        if (current == 0 && inCurrent)
+            font = 0;
+        else if (primary->HasCodePoint(cp))
+            font = inCurrent && IsClusterContinuation(cp) ? current : 0;
+        else if (inCurrent || cp < 0x20)
+            font = current;
+        else if (i > 0 && IsClusterContinuation(cp))
+        {
+            // a mark the base's font lacks, moves the base to a font that has both.
+            font = current;
+            for (size_t f = 0; f < m_faceVec.size(); f++)
+            {
+                if (m_faceVec[f]->HasCodePoint(cp) && m_faceVec[f]->HasCodePoint(codePoints[i - 1]))
+                {
+                    if (f != current)
+                    {
+                        if (runVecOut.back().start == i - 1)
+                            runVecOut.pop_back();
+                        if (runVecOut.empty() || runVecOut.back().font != f)
+                            runVecOut.push_back(FontRun{(uint32_t)(i - 1), (uint32_t)f});
+                        current = (uint32_t)f;
+                    }
+                    font = (uint32_t)f;
+                    break;
+                }
+            }
+        }
+        else
+            font = FindFont(cp);
+
+        if (runVecOut.empty() || font != current)
+        {
+            runVecOut.push_back(FontRun{(uint32_t)i, font});
+            current = font;
+        }
+    }
+}
+
+} // namespace gb
@@ -0,0 +1,51 @@
+#ifndef GB_FONTFAMILY_H
+#define GB_FONTFAMILY_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <memory>
+#include "glyphblaster.h"
+#include "allocator.h"
+
+namespace gb {
+
+class Face;
+class Font;
+
+// code points [start, next run's start) are drawn with the same font of a family.
+struct FontRun
+{
+    uint32_t start;
+    uint32_t font;  // index into the family, 0 is the primary font.
+};
+
+// A primary font followed by fallbacks, tried in order for code points the primary font is missing.
+// Metrics that apply to a whole Text, such as the line height, come from the primary font.
+// Every font must belong to the same Context.
+class FontFamily
+{
+public:
+    explicit FontFamily(const std::vector<std::shared_ptr<Font>>& fontVec);
+
+    size_t GetNumFonts() const { return m_fontVec.size(); }
+    const std::shared_ptr<Font>& GetFont(size_t i) const { return m_fontVec[i]; }
+
+    // index of the first font with a glyph for the code point, 0 if none has one.
+    uint32_t FindFont(uint32_t codePoint) const;
+
+    // Splits code points into runs of the same font, costs a bit test per code point while the
+    // primary font has them.  Marks, joiners and variation selectors stay with the preceding character,
+    // which moves to a font that has both if its own font lacks the mark.
+    void Itemize(const uint32_t* codePoints, size_t count, Vector<FontRun>& runVecOut) const;
+
+protected:
+    std::vector<std::shared_ptr<Font>> m_fontVec;
+    std::vector<const Face*> m_faceVec;  // parallel to m_fontVec, for the coverage bitsets.
+
+    GB_NO_COPY(FontFamily)
+};
+
+} // namespace gb
+
+#endif // GB_FONTFAMILY_H
@@ -1,5 +1,9 @@
 #include <stdio.h>
+#include <string.h>
 #include <assert.h>
+#include <math.h>
+#include <algorithm>
+#include <vector>
 #include "glyph.h"
 #include "font.h"
 #include "context.h"
@@ -14,58 +18,15 @@ Glyph::Glyph(uint32_t index, const Font& font) :
     m_texObj(0),
     m_origin{0, 0},
     m_size{0, 0},
-    m_bearing{0, 0}
+    m_bearing{0, 0},
+    m_baked(false),
+    m_color(false)
 {
-    Context& context = Context::Get();
+    Context& context = font.GetContext();
     assert(font.GetFTFace());
     FT_Face ftFace = font.GetFTFace();
 
-    uint32_t ftLoadFlags;
-
-    switch (font.GetHintOption())
-    {
-    default:
-    case FontHintOption_Default:
-        ftLoadFlags = FT_LOAD_DEFAULT;
-        break;
-    case FontHintOption_ForceAuto:
-        ftLoadFlags = FT_LOAD_FORCE_AUTOHINT;
-        break;
-    case FontHintOption_NoAuto:
-        ftLoadFlags = FT_LOAD_NO_AUTOHINT;
-        break;
-    case FontHintOption_None:
-        ftLoadFlags = FT_LOAD_NO_HINTING;
-        break;
-    }
-
-    switch (font.GetRenderOption())
-    {
-    default:
-    case FontRenderOption_Normal:
-        ftLoadFlags |= FT_LOAD_TARGET_NORMAL;
-        break;
-    case FontRenderOption_Light:
-        ftLoadFlags |= FT_LOAD_TARGET_LIGHT;
-        break;
-    case FontRenderOption_Mono:
-        ftLoadFlags |= FT_LOAD_TARGET_MONO;
-        break;
-    case FontRenderOption_LCD_RGB:
-    case FontRenderOption_LCD_BGR:
-        // Only do sub-pixel anti-aliasing if we are using RGBA textures.
-        if (context.GetTextureFormat() == TextureFormat_RGBA)
-            ftLoadFlags |= FT_LOAD_TARGET_LCD;
-        break;
-    case FontRenderOption_LCD_RGB_V:
-    case FontRenderOption_LCD_BGR_V:
-        // Only do sub-pixel anti-aliasing if we are using RGBA textures.
-        if (context.GetTextureFormat() == TextureFormat_RGBA)
-            ftLoadFlags |= FT_LOAD_TARGET_LCD_V;
-        break;
-    }
-
-    FT_Error ftError = FT_Load_Glyph(font.GetFTFace(), index, ftLoadFlags);
+    FT_Error ftError = FT_Load_Glyph(ftFace, index, font.GetFTLoadFlags());
     if (ftError)
         abort();
 
@@ -105,13 +66,57 @@ Glyph::Glyph(uint32_t index, const Font& font) :
     if (ftError)
         abort();
 
+    FT_Bitmap* ftBitmap = &ftFace->glyph->bitmap;
+    if (ftBitmap->pixel_mode == FT_PIXEL_MODE_BGRA)
+    {
+        // color strikes are scaled to the point size, along with their metrics.
+        const float scale = font.GetBitmapScale();
+        const FT_Glyph_Metrics& metrics = ftFace->glyph->metrics;
+        m_advance = FIXED_TO_INT((FT_Pos)(metrics.horiAdvance * scale));
+        m_bearing = {(int)floorf(metrics.horiBearingX * scale / 64.0f + 0.5f),
+                     (int)floorf(metrics.horiBearingY * scale / 64.0f + 0.5f)};
+        InitColorImageAndSize(context.GetAllocator(), ftBitmap, scale, font.GetPaddingBorder());
+        m_color = true;
+        return;
+    }
+
     // record post-hinting advance and bearing.
     m_advance = FIXED_TO_INT(ftFace->glyph->metrics.horiAdvance);
     m_bearing = {(int)FIXED_TO_INT(ftFace->glyph->metrics.horiBearingX),
                  (int)FIXED_TO_INT(ftFace->glyph->metrics.horiBearingY)};
 
-    FT_Bitmap* ftBitmap = &ftFace->glyph->bitmap;
-    InitImageAndSize(ftBitmap, context.GetTextureFormat(), font.GetRenderOption(), font.GetPaddingBorder());
+    InitImageAndSize(context.GetAllocator(), ftBitmap, context.GetTextureFormat(), font.GetRenderOption(), font.GetPaddingBorder());
+}
+
+Glyph::Glyph(uint32_t index, const Font& font, int advance, IntPoint bearing,
+             IntPoint size, const uint8_t* image, size_t imageSize, bool color) :
+    m_key(index, font.GetIndex()),
+    m_texObj(0),
+    m_origin{0, 0},
+    m_size(size),
+    m_advance(advance),
+    m_bearing(bearing),
+    m_baked(false),
+    m_color(color)
+{
+    if (imageSize > 0)
+    {
+        m_image = AllocateBytes(font.GetContext().GetAllocator(), imageSize);
+        memcpy(m_image.get(), image, imageSize);
+    }
+}
+
+Glyph::Glyph(uint32_t index, const Font& font, int advance, IntPoint bearing,
+             IntPoint size, IntPoint origin, uint32_t texObj) :
+    m_key(index, font.GetIndex()),
+    m_texObj(texObj),
+    m_origin(origin),
+    m_size(size),
+    m_advance(advance),
+    m_bearing(bearing),
+    m_baked(true),
+    m_color(false)
+{
 }
 
 Glyph::~Glyph()
@@ -119,7 +124,7 @@ Glyph::~Glyph()
 
 }
 
-void Glyph::InitImageAndSize(FT_Bitmap* ftBitmap, TextureFormat textureFormat,
+void Glyph::InitImageAndSize(Allocator& allocator, FT_Bitmap* ftBitmap, TextureFormat textureFormat,
                              FontRenderOption renderOption, uint32_t paddingBorder)
 {
     if (ftBitmap->width > 0 && ftBitmap->rows > 0)
@@ -145,8 +150,7 @@ void Glyph::InitImageAndSize(FT_Bitmap* ftBitmap, TextureFormat textureFormat,
             if (textureFormat == TextureFormat_Alpha)
             {
                 // allocate an image to hold a copy of the rasterized glyph
-                std::unique_ptr<uint8_t> image(new uint8_t[numPixels]);
-                m_image = std::move(image);
+                m_image = AllocateBytes(allocator, numPixels);
 
                 // clear dest image
                 memset(m_image.get(), 0, numPixels);
@@ -163,8 +167,7 @@ void Glyph::InitImageAndSize(FT_Bitmap* ftBitmap, TextureFormat textureFormat,
             else if (textureFormat == TextureFormat_RGBA)
             {
                 // allocate an image to hold a copy of the rasterized glyph
-                std::unique_ptr<uint8_t> image(new uint8_t[4 * numPixels]);
-                m_image = std::move(image);
+                m_image = AllocateBytes(allocator, 4 * numPixels);
 
                 // clear dest image
                 memset(m_image.get(), 0, 4 * numPixels);
@@ -206,8 +209,7 @@ void Glyph::InitImageAndSize(FT_Bitmap* ftBitmap, TextureFormat textureFormat,
             if (textureFormat == TextureFormat_Alpha)
             {
                 // allocate an image to hold a copy of the rasterized glyph
-                std::unique_ptr<uint8_t> image(new uint8_t[numPixels]);
-                m_image = std::move(image);
+                m_image = AllocateBytes(allocator, numPixels);
 
                 // clear dest image
                 memset(m_image.get(), 0, numPixels);
@@ -228,8 +230,7 @@ void Glyph::InitImageAndSize(FT_Bitmap* ftBitmap, TextureFormat textureFormat,
             else if (textureFormat == TextureFormat_RGBA)
             {
                 // allocate an image to hold a copy of the rasterized glyph
-                std::unique_ptr<uint8_t> image(new uint8_t[4 * numPixels]);
-                m_image = std::move(image);
+                m_image = AllocateBytes(allocator, 4 * numPixels);
 
                 // clear dest image
                 memset(m_image.get(), 0, 4 * numPixels);
@@ -272,8 +273,7 @@ void Glyph::InitImageAndSize(FT_Bitmap* ftBitmap, TextureFormat textureFormat,
             if (textureFormat == TextureFormat_RGBA)
             {
                 // allocate an image to hold a copy of the rasterized glyph
-                std::unique_ptr<uint8_t> image(new uint8_t[4 * numPixels]);
-                m_image = std::move(image);
+                m_image = AllocateBytes(allocator, 4 * numPixels);
 
                 // clear dest image
                 memset(m_image.get(), 0, 4 * numPixels);
@@ -338,4 +338,107 @@ void Glyph::InitImageAndSize(FT_Bitmap* ftBitmap, TextureFormat textureFormat,
     }
 }
 
+// Source pixels covering [dst / scale, (dst + 1) / scale), weighted by how much of each one is covered.
+// Averaging the area works for any scale, unlike bilinear which skips pixels when shrinking by more than 2.
+struct FilterTap
+{
+    int start;
+    int end;
+    int weightStart;  // index into the weight vector
+};
+
+static void BuildFilterTaps(int srcSize, int dstSize, Vector<FilterTap>& tapVec, Vector<float>& weightVec)
+{
+    const float step = (float)srcSize / (float)dstSize;
+    for (int i = 0; i < dstSize; i++)
+    {
+        const float a = i * step;
+        const float b = std::min((float)srcSize, (i + 1) * step);
+        FilterTap tap = {(int)a, std::min(srcSize, (int)ceilf(b)), (int)weightVec.size()};
+        float total = 0.0f;
+        for (int j = tap.start; j < tap.end; j++)
+        {
+            const float w = std::min(b, (float)(j + 1)) - std::max(a, (float)j);
+            weightVec.push_back(w);
+            total += w;
+        }
+        for (int j = tap.weightStart; j < (int)weightVec.size(); j++)
+            weightVec[j] /= total;
+        tapVec.push_back(tap);
+    }
+}
+
+void Glyph::InitColorImageAndSize(Allocator& allocator, FT_Bitmap* ftBitmap, float scale, uint32_t paddingBorder)
+{
+    const int srcWidth = (int)ftBitmap->width;
+    const int srcHeight = (int)ftBitmap->rows;
+    if (srcWidth <= 0 || srcHeight <= 0)
+    {
+        m_size = {0, 0};
+        return;
+    }
+
+    const int dstWidth = std::max(1, (int)floorf(srcWidth * scale + 0.5f));
+    const int dstHeight = std::max(1, (int)floorf(srcHeight * scale + 0.5f));
+    Vector<FilterTap> xTapVec(allocator), yTapVec(allocator);
+    Vector<float> xWeightVec(allocator), yWeightVec(allocator);
+    BuildFilterTaps(srcWidth, dstWidth, xTapVec, xWeightVec);
+    BuildFilterTaps(srcHeight, dstHeight, yTapVec, yWeightVec);
+
+    // horizontal pass, FreeType's BGRA is premultiplied, which keeps transparent pixels from darkening the edges.
+    Vector<float> rowVec((size_t)srcHeight * dstWidth * 4, 0.0f, allocator);
+    for (int y = 0; y < srcHeight; y++)
+    {
+        const uint8_t* src = ftBitmap->buffer + y * ftBitmap->pitch;
+        float* dst = &rowVec[(size_t)y * dstWidth * 4];
+        for (int x = 0; x < dstWidth; x++)
+        {
+            const FilterTap& tap = xTapVec[x];
+            float sum[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+            for (int j = tap.start; j < tap.end; j++)
+            {
+                const float w = xWeightVec[tap.weightStart + j - tap.start];
+                for (int c = 0; c < 4; c++)
+                    sum[c] += w * src[j * 4 + c];
+            }
+            memcpy(dst + x * 4, sum, sizeof(sum));
+        }
+    }
+
+    // vertical pass, into an RGBA image with the padding border.
+    const int width = dstWidth + 2 * paddingBorder;
+    const int height = dstHeight + 2 * paddingBorder;
+    m_image = AllocateBytes(allocator, 4 * width * height);
+    memset(m_image.get(), 0, 4 * width * height);
+    uint8_t* img = m_image.get();
+    for (int y = 0; y < dstHeight; y++)
+    {
+        const FilterTap& tap = yTapVec[y];
+        for (int x = 0; x < dstWidth; x++)
+        {
+            float sum[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+            for (int j = tap.start; j < tap.end; j++)
+            {
+                const float w = yWeightVec[tap.weightStart + j - tap.start];
+                const float* src = &rowVec[((size_t)j * dstWidth + x) * 4];
+                for (int c = 0; c < 4; c++)
+                    sum[c] += w * src[c];
+            }
+
+            // BGRA premultiplied to RGBA non-premultiplied.
+            uint8_t* dst = img + ((y + paddingBorder) * width + x + paddingBorder) * 4;
+            const float alpha = sum[3];
+            if (alpha > 0.0f)
+            {
+                const float unpremultiply = 255.0f / alpha;
+                dst[0] = (uint8_t)std::min(255.0f, sum[2] * unpremultiply + 0.5f);
+                dst[1] = (uint8_t)std::min(255.0f, sum[1] * unpremultiply + 0.5f);
+                dst[2] = (uint8_t)std::min(255.0f, sum[0] * unpremultiply + 0.5f);
+                dst[3] = (uint8_t)std::min(255.0f, alpha + 0.5f);
+            }
+        }
+    }
+    m_size = {width, height};
+}
+
 } // namespace gb
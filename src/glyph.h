@@ -2,10 +2,12 @@
 #define GB_GLYPH_H
 
 #include <stdint.h>
+#include <stddef.h>
 #include <memory>
 #include <ft2build.h>
 #include FT_FREETYPE_H
 #include "glyphblaster.h"
+#include "allocator.h"
 
 namespace gb {
 
@@ -23,7 +25,17 @@ struct GlyphKey
 class Glyph
 {
 public:
+    // rasterizes the glyph using FreeType.
     Glyph(uint32_t index, const Font& font);
+
+    // initializes the glyph from a previously rasterized image, such as one from a DiskCache.
+    Glyph(uint32_t index, const Font& font, int advance, IntPoint bearing,
+          IntPoint size, const uint8_t* image, size_t imageSize, bool color = false);
+
+    // initializes a glyph that already resides in a texture, such as one loaded from a Bundle.
+    // baked glyphs have no image and are never moved by the Cache.
+    Glyph(uint32_t index, const Font& font, int advance, IntPoint bearing,
+          IntPoint size, IntPoint origin, uint32_t texObj);
     ~Glyph();
 
     GlyphKey GetKey() const { return m_key; }
@@ -35,10 +47,16 @@ public:
     uint32_t GetTexObj() const { return m_texObj; }
     void SetTexObj(uint32_t texObj) { m_texObj = texObj; }
     int GetAdvance() const { return m_advance; }
+    bool IsBaked() const { return m_baked; }
+
+    // color glyphs, such as emoji, are always RGBA, non-premultiplied like the other RGBA glyphs.
+    // they live in RGBA sheets even when the context uses TextureFormat_Alpha.
+    bool IsColor() const { return m_color; }
 
 protected:
-    void InitImageAndSize(FT_Bitmap* ftBitmap, TextureFormat textureFormat,
+    void InitImageAndSize(Allocator& allocator, FT_Bitmap* ftBitmap, TextureFormat textureFormat,
                           FontRenderOption renderOption, uint32_t paddingBorder);
+    void InitColorImageAndSize(Allocator& allocator, FT_Bitmap* ftBitmap, float scale, uint32_t paddingBorder);
 
     GlyphKey m_key;
     uint32_t m_texObj;
@@ -46,9 +64,14 @@ protected:
     IntPoint m_size;
     int m_advance;
     IntPoint m_bearing;
-    std::unique_ptr<uint8_t> m_image;
+    bool m_baked;
+    bool m_color;
+    ByteBuffer m_image;  // from the context's allocator.
 };
 
+// glyphs are allocated by their context's allocator.
+typedef std::unique_ptr<Glyph, AllocatorDelete<Glyph>> GlyphPtr;
+
 } // namespace gb
 
 #endif // GB_GLYPH_H
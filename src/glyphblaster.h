@@ -1,6 +1,8 @@
 #ifndef GB_GLYPHBLASTER_H
 #define GB_GLYPHBLASTER_H
 
+#include <stdint.h>
+
 #define GB_NO_COPY(TypeName)                        \
 	TypeName(const TypeName&);						\
 	TypeName& operator=(const TypeName&);
@@ -17,6 +19,11 @@ struct Point
 typedef Point<int> IntPoint;
 typedef Point<float> FloatPoint;
 
+enum QuadFlags {
+    QuadFlags_None = 0,
+    QuadFlags_Color = 0x01  // the texels are the glyph's own colors, draw them as is instead of tinting the alpha.
+};
+
 // y axis points down
 // origin is upper-left corner of glyph
 struct Quad
@@ -28,6 +35,14 @@ struct Quad
     FloatPoint uvSize;
     void* userData;
     uint32_t glTexObj;
+    uint32_t flags;  // QuadFlags
+};
+
+// inclusive range of unicode code points
+struct CodePointRange
+{
+    uint32_t first;
+    uint32_t last;
 };
 
 enum TextureFormat { TextureFormat_Alpha = 0, TextureFormat_RGBA };
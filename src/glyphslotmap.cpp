@@ -0,0 +1,105 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include "glyphslotmap.h"
+
+namespace gb {
+
+GlyphSlotMap::GlyphSlotMap(Allocator& allocator) :
+    m_allocator(allocator),
+    m_pages(),
+    m_freeVec(allocator),
+    m_numSlots(0)
+{
+}
+
+GlyphSlotMap::~GlyphSlotMap()
+{
+    for (auto page : m_pages)
+    {
+        if (!page)
+            continue;
+        for (uint32_t i = 0; i < kSlotsPerPage; i++)
+            page[i].~Slot();
+        m_allocator.Free(page);
+    }
+}
+
+GlyphHandle GlyphSlotMap::Insert(GlyphPtr glyph)
+{
+    uint32_t index;
+    if (!m_freeVec.empty())
+    {
+        index = m_freeVec.back();
+        m_freeVec.pop_back();
+    }
+    else
+    {
+        if (m_numSlots == kMaxSlots)
+        {
+            fprintf(stderr, "Error glyphblaster has more than %u glyphs\n", (uint32_t)kMaxSlots);
+            abort();
+        }
+        index = m_numSlots++;
+        if (!m_pages[index / kSlotsPerPage])
+        {
+            Slot* page = (Slot*)m_allocator.Allocate(kSlotsPerPage * sizeof(Slot), alignof(Slot));
+            for (uint32_t i = 0; i < kSlotsPerPage; i++)
+                new (page + i) Slot();
+            m_pages[index / kSlotsPerPage] = page;
+        }
+    }
+
+    Slot& slot = m_pages[index / kSlotsPerPage][index % kSlotsPerPage];
+    slot.glyph = std::move(glyph);
+    slot.refCount.store(1, std::memory_order_relaxed);
+    return (slot.generation << kIndexBits) | index;
+}
+
+Glyph* GlyphSlotMap::Get(GlyphHandle handle) const
+{
+    // the page of a valid handle was created before the handle was handed out.
+    const uint32_t index = GetIndex(handle);
+    if (!m_pages[index / kSlotsPerPage])
+        return nullptr;
+    const Slot& slot = m_pages[index / kSlotsPerPage][index % kSlotsPerPage];
+    return slot.generation == GetGeneration(handle) ? slot.glyph.get() : nullptr;
+}
+
+void GlyphSlotMap::Free(GlyphHandle handle)
+{
+    Slot& slot = GetSlot(handle);
+    assert(slot.refCount.load(std::memory_order_relaxed) == 0);
+    slot.glyph.reset();
+
+    // generation 0 is skipped when it wraps, so no handle is ever 0.
+    slot.generation = (slot.generation + 1) & ((1 << kGenerationBits) - 1);
+    if (slot.generation == 0)
+        slot.generation = 1;
+    m_freeVec.push_back(GetIndex(handle));
+}
+
+void GlyphSlotMap::ForEach(const std::function<void (GlyphHandle, Glyph&)>& func) const
+{
+    for (uint32_t i = 0; i < m_numSlots; i++)
+    {
+        const Slot& slot = m_pages[i / kSlotsPerPage][i % kSlotsPerPage];
+        if (slot.glyph)
+            func((slot.generation << kIndexBits) | i, *slot.glyph);
+    }
+}
+
+GlyphSlotMap::Slot& GlyphSlotMap::GetSlot(GlyphHandle handle) const
+{
+    const uint32_t index = GetIndex(handle);
+    assert(m_pages[index / kSlotsPerPage]);
+    Slot& slot = m_pages[index / kSlotsPerPage][index % kSlotsPerPage];
+    if (slot.generation != GetGeneration(handle))
+    {
+        fprintf(stderr, "Error stale glyph handle 0x%08x\n", handle);
+        abort();
+    }
+    return slot;
+}
+
+} // namespace gb
@@ -0,0 +1,77 @@
+#ifndef GB_GLYPHSLOTMAP_H
+#define GB_GLYPHSLOTMAP_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <memory>
+#include <vector>
+#include <atomic>
+#include <functional>
+#include "glyphblaster.h"
+#include "glyph.h"
+#include "allocator.h"
+
+namespace gb {
+
+// slot index in the low bits, the slot's generation in the high bits.  0 is never a valid handle.
+typedef uint32_t GlyphHandle;
+
+// Owns the glyphs of a Context, in slots reached by handle.  A handle is checked against the generation
+// of its slot, so a stale one is caught instead of finding whichever glyph reused the slot.
+// Each glyph has a reference count, Texts hold one reference per unique glyph they draw.  Glyphs that
+// are no longer referenced stay in their slot, ready for reuse, until the context frees them.
+//
+// Insert() and Free() must not run concurrently with anything else, the Context serializes them.
+// Get(), AddRef() & Release() of a glyph the caller holds a reference to can run on any thread.
+class GlyphSlotMap
+{
+public:
+    enum { kIndexBits = 20, kGenerationBits = 32 - kIndexBits, kMaxSlots = 1 << kIndexBits, kSlotsPerPage = 1024 };
+
+    // pages of slots come from allocator.
+    GlyphSlotMap(Allocator& allocator);
+    ~GlyphSlotMap();
+
+    // the new glyph has one reference.
+    GlyphHandle Insert(GlyphPtr glyph);
+
+    // null if the handle is stale.
+    Glyph* Get(GlyphHandle handle) const;
+
+    void AddRef(GlyphHandle handle) { GetSlot(handle).refCount.fetch_add(1, std::memory_order_relaxed); }
+    void Release(GlyphHandle handle) { GetSlot(handle).refCount.fetch_sub(1, std::memory_order_acq_rel); }
+    uint32_t GetRefCount(GlyphHandle handle) const { return GetSlot(handle).refCount.load(std::memory_order_acquire); }
+
+    // destroys the glyph, the slot is reused with the next generation.
+    void Free(GlyphHandle handle);
+
+    // calls func on every glyph, in slot order.
+    void ForEach(const std::function<void (GlyphHandle, Glyph&)>& func) const;
+
+    size_t GetNumGlyphs() const { return m_numSlots - m_freeVec.size(); }
+
+protected:
+    struct Slot
+    {
+        Slot() : refCount(0), generation(1) {}
+        GlyphPtr glyph;
+        std::atomic<uint32_t> refCount;
+        uint32_t generation;
+    };
+
+    static uint32_t GetIndex(GlyphHandle handle) { return handle & (kMaxSlots - 1); }
+    static uint32_t GetGeneration(GlyphHandle handle) { return handle >> kIndexBits; }
+    Slot& GetSlot(GlyphHandle handle) const;
+
+    // pages are never moved or freed, so a slot stays put while other threads read it.
+    Allocator& m_allocator;
+    Slot* m_pages[kMaxSlots / kSlotsPerPage];
+    Vector<uint32_t> m_freeVec;
+    uint32_t m_numSlots;
+
+    GB_NO_COPY(GlyphSlotMap)
+};
+
+} // namespace gb
+
+#endif // GB_GLYPHSLOTMAP_H
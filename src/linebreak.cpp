@@ -0,0 +1,232 @@
+#include <algorithm>
+#include "linebreak.h"
+
+namespace gb {
+
+#define OP LineBreakClass_OP
+#define CL LineBreakClass_CL
+#define QU LineBreakClass_QU
+#define GL LineBreakClass_GL
+#define NS LineBreakClass_NS
+#define EX LineBreakClass_EX
+#define IS LineBreakClass_IS
+#define BA LineBreakClass_BA
+#define HY LineBreakClass_HY
+#define NU LineBreakClass_NU
+#define AL LineBreakClass_AL
+#define ID LineBreakClass_ID
+#define CM LineBreakClass_CM
+#define ZW LineBreakClass_ZW
+#define SP LineBreakClass_SP
+
+static const uint8_t s_asciiClassTable[128] = {
+    CM, CM, CM, CM, CM, CM, CM, CM, CM, BA, CM, CM, CM, CM, CM, CM,
+    CM, CM, CM, CM, CM, CM, CM, CM, CM, CM, CM, CM, CM, CM, CM, CM,
+    SP, EX, QU, AL, AL, AL, AL, QU, OP, CL, AL, AL, IS, HY, IS, IS,
+    NU, NU, NU, NU, NU, NU, NU, NU, NU, NU, IS, IS, AL, AL, AL, EX,
+    AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL,
+    AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, OP, AL, CL, AL, AL,
+    AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL,
+    AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, OP, BA, CL, AL, CM,
+};
+
+struct LineBreakRange
+{
+    uint32_t first;
+    uint32_t last;
+    uint8_t lineBreakClass;
+};
+
+// sorted, code points not covered are AL.
+static const LineBreakRange s_classRangeTable[] = {
+    {0x00080, 0x0009f, CM},  // c1 controls
+    {0x000a0, 0x000a0, GL},  // no-break space
+    {0x000a1, 0x000a1, OP},  // inverted exclamation mark
+    {0x000ab, 0x000ab, QU},
+    {0x000ad, 0x000ad, BA},  // soft hyphen
+    {0x000bb, 0x000bb, QU},
+    {0x000bf, 0x000bf, OP},  // inverted question mark
+    {0x00300, 0x0036f, CM},  // combining diacritical marks
+    {0x00483, 0x00489, CM},  // cyrillic combining marks
+    {0x00591, 0x005bd, CM},  // hebrew points
+    {0x005be, 0x005be, BA},  // maqaf
+    {0x005bf, 0x005c7, CM},
+    {0x00610, 0x0061a, CM},  // arabic marks
+    {0x0064b, 0x0065f, CM},
+    {0x00670, 0x00670, CM},
+    {0x006d6, 0x006ed, CM},
+    {0x01680, 0x01680, BA},  // ogham space mark
+    {0x0180e, 0x0180e, GL},  // mongolian vowel separator
+    {0x01ab0, 0x01aff, CM},  // combining marks extended
+    {0x01dc0, 0x01dff, CM},  // combining marks supplement
+    {0x02000, 0x02006, BA},  // en quad .. six-per-em space
+    {0x02007, 0x02007, GL},  // figure space
+    {0x02008, 0x0200a, BA},  // punctuation space .. hair space
+    {0x0200b, 0x0200b, ZW},  // zero width space
+    {0x0200c, 0x0200d, CM},  // zero width non joiner & joiner
+    {0x02010, 0x02010, BA},  // hyphen
+    {0x02011, 0x02011, GL},  // non-breaking hyphen
+    {0x02012, 0x02014, BA},  // dashes
+    {0x02018, 0x02019, QU},
+    {0x0201c, 0x0201d, QU},
+    {0x02024, 0x02026, NS},  // leaders & ellipsis
+    {0x02027, 0x02027, BA},
+    {0x0202f, 0x0202f, GL},  // narrow no-break space
+    {0x02039, 0x0203a, QU},
+    {0x0203c, 0x0203d, NS},
+    {0x02044, 0x02044, IS},  // fraction slash
+    {0x0205f, 0x0205f, BA},  // medium mathematical space
+    {0x02060, 0x02060, GL},  // word joiner
+    {0x020d0, 0x020ff, CM},  // combining marks for symbols
+    {0x02e80, 0x02fff, ID},  // cjk radicals
+    {0x03000, 0x03000, BA},  // ideographic space
+    {0x03001, 0x03002, CL},  // ideographic comma & full stop
+    {0x03003, 0x03004, ID},
+    {0x03005, 0x03005, NS},
+    {0x03006, 0x03007, ID},
+    {0x03008, 0x03008, OP},
+    {0x03009, 0x03009, CL},
+    {0x0300a, 0x0300a, OP},
+    {0x0300b, 0x0300b, CL},
+    {0x0300c, 0x0300c, OP},
+    {0x0300d, 0x0300d, CL},
+    {0x0300e, 0x0300e, OP},
+    {0x0300f, 0x0300f, CL},
+    {0x03010, 0x03010, OP},
+    {0x03011, 0x03011, CL},
+    {0x03012, 0x03013, ID},
+    {0x03014, 0x03014, OP},
+    {0x03015, 0x03015, CL},
+    {0x03016, 0x0309f, ID},  // hiragana
+    {0x030a0, 0x030a0, NS},
+    {0x030a1, 0x030fa, ID},  // katakana
+    {0x030fb, 0x030fc, NS},
+    {0x030fd, 0x04dbf, ID},  // cjk
+    {0x04e00, 0x09fff, ID},  // cjk unified ideographs
+    {0x0a000, 0x0a4cf, ID},  // yi
+    {0x0ac00, 0x0d7a3, ID},  // hangul syllables
+    {0x0f900, 0x0faff, ID},  // cjk compatibility ideographs
+    {0x0fe00, 0x0fe0f, CM},  // variation selectors
+    {0x0fe20, 0x0fe2f, CM},  // combining half marks
+    {0x0fe30, 0x0fe4f, ID},  // cjk compatibility forms
+    {0x0feff, 0x0feff, GL},  // zero width no-break space
+    {0x0ff01, 0x0ff01, EX},  // fullwidth forms
+    {0x0ff02, 0x0ff07, ID},
+    {0x0ff08, 0x0ff08, OP},
+    {0x0ff09, 0x0ff09, CL},
+    {0x0ff0a, 0x0ff0b, ID},
+    {0x0ff0c, 0x0ff0c, CL},
+    {0x0ff0d, 0x0ff0d, ID},
+    {0x0ff0e, 0x0ff0e, CL},
+    {0x0ff0f, 0x0ff19, ID},
+    {0x0ff1a, 0x0ff1b, NS},
+    {0x0ff1c, 0x0ff1e, ID},
+    {0x0ff1f, 0x0ff1f, EX},
+    {0x0ff20, 0x0ff3a, ID},
+    {0x0ff3b, 0x0ff3b, OP},
+    {0x0ff3c, 0x0ff3c, ID},
+    {0x0ff3d, 0x0ff3d, CL},
+    {0x0ff3e, 0x0ff5a, ID},
+    {0x0ff5b, 0x0ff5b, OP},
+    {0x0ff5c, 0x0ff5c, ID},
+    {0x0ff5d, 0x0ff5d, CL},
+    {0x0ff5e, 0x0ff60, ID},
+    {0x1f300, 0x1f64f, ID},  // pictographs & emoticons
+    {0x1f900, 0x1f9ff, ID},  // supplemental pictographs
+    {0x20000, 0x3fffd, ID},  // cjk extensions
+    {0xe0100, 0xe01ef, CM},  // variation selectors supplement
+};
+
+// D - direct break, a line may break between the pair.
+// I - indirect break, only if there are spaces between the pair.
+// P - prohibited, even with spaces between the pair.
+enum { D = 0, I, P };
+
+// indexed by [before][after], the class before is the last non-space class.
+static const uint8_t s_pairTable[LineBreakClass_SP][LineBreakClass_SP] = {
+    //        OP CL QU GL NS EX IS BA HY NU AL ID CM ZW
+    /* OP */ {P, P, P, P, P, P, P, P, P, P, P, P, P, P},
+    /* CL */ {D, P, I, I, P, P, P, I, I, I, I, D, I, P},
+    /* QU */ {P, P, I, I, I, P, P, I, I, I, I, I, I, P},
+    /* GL */ {I, P, I, I, I, P, P, I, I, I, I, I, I, P},
+    /* NS */ {D, P, I, I, I, P, P, I, I, D, D, D, I, P},
+    /* EX */ {D, P, I, I, I, P, P, I, I, D, D, D, I, P},
+    /* IS */ {D, P, I, I, I, P, P, I, I, I, I, D, I, P},
+    /* BA */ {D, P, I, D, I, P, P, I, I, D, D, D, I, P},
+    /* HY */ {D, P, I, D, I, P, P, I, I, I, D, D, I, P},
+    /* NU */ {I, P, I, I, I, P, P, I, I, I, I, D, I, P},
+    /* AL */ {I, P, I, I, I, P, P, I, I, I, I, D, I, P},
+    /* ID */ {D, P, I, I, I, P, P, I, I, D, D, D, I, P},
+    /* CM */ {I, P, I, I, I, P, P, I, I, I, I, D, I, P},
+    /* ZW */ {D, D, D, D, D, D, D, D, D, D, D, D, D, D},
+};
+
+#undef OP
+#undef CL
+#undef QU
+#undef GL
+#undef NS
+#undef EX
+#undef IS
+#undef BA
+#undef HY
+#undef NU
+#undef AL
+#undef ID
+#undef CM
+#undef ZW
+#undef SP
+
+LineBreakClass GetLineBreakClass(uint32_t codePoint)
+{
+    if (codePoint < 128)
+        return (LineBreakClass)s_asciiClassTable[codePoint];
+
+    const LineBreakRange* begin = s_classRangeTable;
+    const LineBreakRange* end = begin + sizeof(s_classRangeTable) / sizeof(s_classRangeTable[0]);
+    const LineBreakRange* iter = std::upper_bound(begin, end, codePoint, [](uint32_t cp, const LineBreakRange& range)
+    {
+        return cp < range.first;
+    });
+    if (iter != begin && codePoint <= (iter - 1)->last)
+        return (LineBreakClass)(iter - 1)->lineBreakClass;
+    return LineBreakClass_AL;
+}
+
+void FindLineBreakOpportunities(const uint32_t* codePoints, size_t count, Vector<uint8_t>& breakVecOut)
+{
+    breakVecOut.resize(count);
+
+    // the class of the last non-space character, and if spaces followed it.
+    int before = -1;
+    bool spaceBefore = false;
+    for (size_t i = 0; i < count; i++)
+    {
+        LineBreakClass after = GetLineBreakClass(codePoints[i]);
+        breakVecOut[i] = 0;
+        if (after == LineBreakClass_SP)
+        {
+            spaceBefore = true;
+            continue;
+        }
+
+        // combining marks take the class of the character they attach to, or AL when there is none.
+        if (after == LineBreakClass_CM)
+        {
+            if (before < 0 || spaceBefore)
+                after = LineBreakClass_AL;
+            else
+                continue;
+        }
+
+        if (before >= 0)
+        {
+            const uint8_t action = s_pairTable[before][after];
+            breakVecOut[i] = action == D || (action == I && spaceBefore);
+        }
+        before = after;
+        spaceBefore = false;
+    }
+}
+
+} // namespace gb
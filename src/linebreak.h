@@ -0,0 +1,41 @@
+#ifndef GB_LINEBREAK_H
+#define GB_LINEBREAK_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "allocator.h"
+
+namespace gb {
+
+// A subset of the line breaking classes from UAX #14, http://www.unicode.org/reports/tr14/
+// Classes with similar behavior are merged, CP into CL, SY into IS, PR & PO & SA into AL, IN into NS.
+// Mandatory breaks (BK, CR, LF, NL) are not included, callers split paragraphs on newlines first.
+enum LineBreakClass {
+    LineBreakClass_OP = 0,  // open punctuation
+    LineBreakClass_CL,  // close punctuation
+    LineBreakClass_QU,  // quotation
+    LineBreakClass_GL,  // non-breaking glue
+    LineBreakClass_NS,  // nonstarter
+    LineBreakClass_EX,  // exclamation & interrogation
+    LineBreakClass_IS,  // infix numeric separator
+    LineBreakClass_BA,  // break after
+    LineBreakClass_HY,  // hyphen
+    LineBreakClass_NU,  // numeric
+    LineBreakClass_AL,  // alphabetic, the default
+    LineBreakClass_ID,  // ideographic
+    LineBreakClass_CM,  // combining mark
+    LineBreakClass_ZW,  // zero width space
+    LineBreakClass_SP,  // space
+    LineBreakClass_Count
+};
+
+LineBreakClass GetLineBreakClass(uint32_t codePoint);
+
+// Sets breakVecOut[i] to 1 if a line may be broken before codePoints[i], 0 otherwise.
+// A single pass using the pair table from UAX #14, spaces never have a break before them,
+// the break comes after the run of spaces instead.
+void FindLineBreakOpportunities(const uint32_t* codePoints, size_t count, Vector<uint8_t>& breakVecOut);
+
+} // namespace gb
+
+#endif // GB_LINEBREAK_H
@@ -0,0 +1,121 @@
+#if (defined _WIN32) || (defined _WIN64)
+#  include <windows.h>
+#else
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <fcntl.h>
+#  include <unistd.h>
+#endif
+#include "mappedfile.h"
+
+namespace gb {
+
+MappedFile::MappedFile() :
+    m_data(nullptr),
+    m_size(0)
+#if (defined _WIN32) || (defined _WIN64)
+    , m_fileHandle(nullptr),
+    m_mappingHandle(nullptr)
+#endif
+{
+}
+
+MappedFile::~MappedFile()
+{
+    Close();
+}
+
+#if (defined _WIN32) || (defined _WIN64)
+
+bool MappedFile::Open(const char* filename)
+{
+    Close();
+
+    HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+    {
+        CloseHandle(file);
+        return false;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!mapping)
+    {
+        CloseHandle(file);
+        return false;
+    }
+
+    void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!data)
+    {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+
+    m_fileHandle = file;
+    m_mappingHandle = mapping;
+    m_data = (const uint8_t*)data;
+    m_size = (size_t)size.QuadPart;
+    return true;
+}
+
+void MappedFile::Close()
+{
+    if (m_data)
+    {
+        UnmapViewOfFile(m_data);
+        CloseHandle((HANDLE)m_mappingHandle);
+        CloseHandle((HANDLE)m_fileHandle);
+        m_data = nullptr;
+        m_size = 0;
+    }
+}
+
+#else
+
+bool MappedFile::Open(const char* filename)
+{
+    Close();
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        close(fd);
+        return false;
+    }
+
+    void* data = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    // the mapping stays valid after the descriptor is closed.
+    close(fd);
+    if (data == MAP_FAILED)
+        return false;
+
+    m_data = (const uint8_t*)data;
+    m_size = (size_t)st.st_size;
+    return true;
+}
+
+void MappedFile::Close()
+{
+    if (m_data)
+    {
+        munmap((void*)m_data, m_size);
+        m_data = nullptr;
+        m_size = 0;
+    }
+}
+
+#endif
+
+} // namespace gb
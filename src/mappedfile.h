@@ -0,0 +1,38 @@
+#ifndef GB_MAPPEDFILE_H
+#define GB_MAPPEDFILE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "glyphblaster.h"
+
+namespace gb {
+
+// read-only memory mapping of an entire file.
+class MappedFile
+{
+public:
+    MappedFile();
+    ~MappedFile();
+
+    // returns false if the file could not be opened or is empty.
+    bool Open(const char* filename);
+    void Close();
+
+    bool IsOpen() const { return m_data != nullptr; }
+    const uint8_t* GetData() const { return m_data; }
+    size_t GetSize() const { return m_size; }
+
+protected:
+    const uint8_t* m_data;
+    size_t m_size;
+#if (defined _WIN32) || (defined _WIN64)
+    void* m_fileHandle;
+    void* m_mappingHandle;
+#endif
+
+    GB_NO_COPY(MappedFile)
+};
+
+} // namespace gb
+
+#endif // GB_MAPPEDFILE_H
@@ -0,0 +1,120 @@
+#include <algorithm>
+#include "taskscheduler.h"
+
+namespace gb {
+
+void TaskGroup::Spawn(TaskScheduler& scheduler, std::function<void ()> task)
+{
+    m_pending.fetch_add(1, std::memory_order_relaxed);
+    scheduler.Spawn([this, task]()
+    {
+        task();
+        m_pending.fetch_sub(1, std::memory_order_release);
+    });
+}
+
+ThreadPool::ThreadPool(uint32_t numThreads) :
+    m_numThreads(numThreads),
+    m_stopping(false)
+{
+    if (m_numThreads == 0)
+        m_numThreads = std::max(1u, std::thread::hardware_concurrency()) - 1;
+
+    // a single core still gets a worker, so tasks run while the spawning thread is busy.
+    if (m_numThreads == 0)
+        m_numThreads = 1;
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (RunTask(lock))
+            ;
+        m_stopping = true;
+    }
+    m_taskCond.notify_all();
+    for (auto &thread : m_threadVec)
+        thread.join();
+}
+
+void ThreadPool::Spawn(std::function<void ()> task)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_threadVec.empty())
+        {
+            for (uint32_t i = 0; i < m_numThreads; i++)
+                m_threadVec.emplace_back(&ThreadPool::WorkerMain, this);
+        }
+        m_taskQueue.push_back(std::move(task));
+    }
+    m_taskCond.notify_one();
+}
+
+void ThreadPool::Wait(TaskGroup& group)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!group.IsDone())
+    {
+        // help out, the group's tasks may be queued behind others.
+        if (!RunTask(lock))
+            m_doneCond.wait(lock);
+    }
+}
+
+void ThreadPool::WorkerMain()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_stopping)
+    {
+        if (!RunTask(lock))
+            m_taskCond.wait(lock);
+    }
+}
+
+bool ThreadPool::RunTask(std::unique_lock<std::mutex>& lock)
+{
+    if (m_taskQueue.empty())
+        return false;
+
+    std::function<void ()> task = std::move(m_taskQueue.front());
+    m_taskQueue.pop_front();
+    lock.unlock();
+    task();
+    lock.lock();
+
+    // the task may have finished a group, whoever waits on it is blocked on the lock or on m_doneCond.
+    m_doneCond.notify_all();
+    return true;
+}
+
+void ParallelForChunks(TaskScheduler* scheduler, size_t count, size_t grain, const std::function<void (size_t, size_t)>& func)
+{
+    // at most 64 chunks, enough to balance the load on any machine this runs on.
+    const size_t kMaxChunks = 64;
+    grain = std::max<size_t>(grain, 1);
+    const size_t numChunks = std::min(count / grain, kMaxChunks);
+    if (!scheduler || numChunks < 2)
+    {
+        if (count > 0)
+            func(0, count);
+        return;
+    }
+
+    // the calling thread takes the first chunk.
+    TaskGroup group;
+    for (size_t i = 1; i < numChunks; i++)
+    {
+        const size_t begin = count * i / numChunks;
+        const size_t end = count * (i + 1) / numChunks;
+        group.Spawn(*scheduler, [&func, begin, end]()
+        {
+            func(begin, end);
+        });
+    }
+    func(0, count / numChunks);
+    group.Wait(*scheduler);
+}
+
+} // namespace gb
@@ -0,0 +1,100 @@
+#ifndef GB_TASKSCHEDULER_H
+#define GB_TASKSCHEDULER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include "glyphblaster.h"
+
+namespace gb {
+
+class TaskGroup;
+
+// Where a thread-safe Context runs its parallel work, see Context::SetTaskScheduler().
+// Implement it on top of an existing job system to keep glyphblaster off threads of its own.
+class TaskScheduler
+{
+public:
+    virtual ~TaskScheduler() {}
+
+    // runs task soon, on any thread.
+    virtual void Spawn(std::function<void ()> task) = 0;
+
+    // returns once group.IsDone().  tasks can wait on groups of their own, so this should run
+    // other tasks meanwhile rather than block a worker.
+    virtual void Wait(TaskGroup& group) = 0;
+};
+
+// Counts the tasks spawned with it that have not finished yet.
+class TaskGroup
+{
+public:
+    TaskGroup() : m_pending(0) {}
+
+    void Spawn(TaskScheduler& scheduler, std::function<void ()> task);
+    void Wait(TaskScheduler& scheduler) { scheduler.Wait(*this); }
+    bool IsDone() const { return m_pending.load(std::memory_order_acquire) == 0; }
+
+protected:
+    std::atomic<uint32_t> m_pending;
+
+    GB_NO_COPY(TaskGroup)
+};
+
+// The default scheduler, a fixed set of threads started on the first Spawn().
+// Wait() runs queued tasks on the calling thread until the group is done.
+class ThreadPool : public TaskScheduler
+{
+public:
+    // 0 threads is one less than the number of cores, the waiting thread makes up the difference.
+    explicit ThreadPool(uint32_t numThreads = 0);
+
+    // runs the tasks that are still queued, then stops the threads.
+    virtual ~ThreadPool();
+
+    virtual void Spawn(std::function<void ()> task);
+    virtual void Wait(TaskGroup& group);
+
+protected:
+    void WorkerMain();
+
+    // pops and runs one task, with the lock released while it runs.  false if the queue is empty.
+    bool RunTask(std::unique_lock<std::mutex>& lock);
+
+    uint32_t m_numThreads;
+    std::vector<std::thread> m_threadVec;
+    std::deque<std::function<void ()>> m_taskQueue;
+    std::mutex m_mutex;
+    std::condition_variable m_taskCond;  // a task was queued, or the pool is stopping.
+    std::condition_variable m_doneCond;  // a task finished.
+    bool m_stopping;
+
+    GB_NO_COPY(ThreadPool)
+};
+
+// calls func(begin, end) over [0, count) in chunks of at least grain, as tasks on scheduler,
+// and returns when they are all done.  without a scheduler, or with too little work, it is one call.
+void ParallelForChunks(TaskScheduler* scheduler, size_t count, size_t grain, const std::function<void (size_t, size_t)>& func);
+
+// the same, but a single call is made directly, func is only wrapped in a std::function when the work is split.
+template <typename Func>
+void ParallelFor(TaskScheduler* scheduler, size_t count, size_t grain, const Func& func)
+{
+    if (!scheduler || count / (grain ? grain : 1) < 2)
+    {
+        if (count > 0)
+            func(0, count);
+        return;
+    }
+    ParallelForChunks(scheduler, count, grain, func);
+}
+
+} // namespace gb
+
+#endif // GB_TASKSCHEDULER_H
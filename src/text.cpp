@@ -1,4 +1,6 @@
 #include <assert.h>
+#include <algorithm>
+#include <atomic>
 #ifdef GB_USE_HARFBUZZ
 #include <harfbuzz/hb.h>
 #endif
@@ -7,12 +9,20 @@
 #include "cache.h"
 #include "font.h"
 #include "glyph.h"
+#include "face.h"
+#include "bidi.h"
+#include "linebreak.h"
+#include "utf8.h"
+#include "taskscheduler.h"
 
 // 26.6 fixed to int (truncates)
 #define FIXED_TO_INT(n) (uint32_t)(n >> 6)
 
 namespace gb {
 
+// code points per shaping task, long texts are split into chunks of about this size.
+static const size_t kShapeGrain = 4096;
+
 // cp is a utf32 codepoint
 static bool IsSpace(uint32_t codePoint)
 {
@@ -60,258 +70,268 @@ static bool IsNewline(uint32_t codePoint)
     }
 }
 
-// returns the number of bytes to advance
-// fills cp_out with the code point at p.
-static int NextCodePoint(const char *str, uint32_t *codePointOut)
-{
-    const uint8_t* p = (const uint8_t*)str;
-    if ((*p & 0x80) == 0)
-    {
-        *codePointOut = *p;
-        return 1;
-    }
-    else if ((*p & 0xe0) == 0xc0) // 110xxxxx 10xxxxxx
-    {
-        *codePointOut = ((*p & ~0xe0) << 6) | (*(p+1) & ~0xc0);
-        return 2;
-    }
-    else if ((*p & 0xf0) == 0xe0) // 1110xxxx 10xxxxxx 10xxxxxx
-    {
-        *codePointOut = ((*p & ~0xf0) << 12) | ((*(p+1) & ~0xc0) << 6) | (*(p+2) & ~0xc0);
-        return 3;
-    }
-    else if ((*p & 0xf8) == 0xf0) // 11110xxx 10xxxxxx 10xxxxxx 10xxxxxx
-    {
-        *codePointOut = ((*p & ~0xf8) << 18) | ((*(p+1) & ~0xc0) << 12) | ((*(p+1) & ~0xc0) << 6) | (*(p+2) & ~0xc0);
-        return 4;
-    }
-    else
-    {
-        // p is not at a valid starting point. p is not utf8 encoded or is at a bad offset.
-        assert(0);
-        *codePointOut = 0;
-        return 1;
-    }
-}
-
-void Text::UpdateCache(const GlyphCursorVec& glyphCursorVec)
+void Text::UpdateCache(const GlyphInfoVec& glyphInfoVec, TextWorkspace& workspace)
 {
-    Context& context = Context::Get();
+    Context& context = m_font->GetContext();
 
-    // build keyVec
-    std::vector<GlyphKey> keyVec;
-    keyVec.reserve(glyphCursorVec.size());
-    for (auto &glyphCursor : glyphCursorVec)
+    // build keyVec, only glyphs that survived word wrapping are drawn.
+    Vector<GlyphKey>& keyVec = workspace.m_keyVec;
+    keyVec.clear();
+    keyVec.reserve(glyphInfoVec.size());
+    for (auto &info : glyphInfoVec)
     {
-        if (!IsNewline(glyphCursor.cp))
+        if (info.type != NEWLINE_GLYPH)
         {
-            keyVec.push_back(GlyphKey(glyphCursor.index, m_font->GetIndex()));
+            keyVec.push_back(GlyphKey(info.index, GetGlyphFont(info.font).GetIndex()));
         }
     }
 
     // add glyphs to cache and context, doing rasterization and sub-loads if necessary.
-    context.RasterizeAndSubloadGlyphs(keyVec, m_glyphVec);
+    // m_glyphVec ends up parallel to the drawn glyphs in glyphInfoVec, the snapshot references each once.
+    workspace.m_glyphVec.clear();
+    context.RasterizeAndSubloadGlyphs(keyVec, workspace.m_glyphVec, m_snapshot->m_glyphHandleVec, workspace.m_glyphBatchScratch);
 }
 
-enum GlyphType { NEWLINE_GLYPH = 0, SPACE_GLYPH, NORMAL_GLYPH };
-
-struct GlyphInfo
+// Greedy line breaking in a single pass over each paragraph.
+// Break opportunities come from the UAX #14 pair table, and line widths from prefix sums of the glyph advances,
+// so no glyph is measured twice.  Spaces at the end of a line hang past the edge, and are dropped at soft breaks.
+// A line that has no break opportunity is broken at the last glyph that fits, and always holds at least one glyph.
+// When maxLines is not zero and more glyphs follow the last allowed line, that line ends with an ellipsis,
+// wrapping stops and truncatedOut is set.
+// Lines are measured in logical order, then each one is reordered for display by the bidi algorithm.
+void Text::WordWrap(const GlyphCursorVec& glyphCursorVec, size_t maxLines, TextWorkspace& workspace, bool& truncatedOut) const
 {
-    enum GlyphType type;
-    Glyph *gbGlyph;
-    int32_t x;
-};
+    const size_t num_glyphs = glyphCursorVec.size();
+    const bool rtl = m_dir == Direction_RTL;
+    const uint8_t base_level = rtl ? 1 : 0;
 
-static uint32_t loop_begin_rtl(uint32_t num_glyphs) { return num_glyphs - 1; }
-static uint32_t loop_begin_ltr(uint32_t num_glyphs) { return 0; }
-
-static uint32_t loop_end_rtl(uint32_t num_glyphs) { return -1; }
-static uint32_t loop_end_ltr(uint32_t num_glyphs) { return num_glyphs; }
+    // pen[k] is the pen position before glyph k.  kerning with the glyph to its right, in the same run
+    // and font, counts towards the advance of a glyph.
+    Vector<int32_t>& pen = workspace.m_penVec;
+    Vector<uint32_t>& codePointVec = workspace.m_wrapCodePointVec;
+    pen.resize(num_glyphs + 1);
+    codePointVec.resize(num_glyphs);
+    pen[0] = 0;
+    for (size_t k = 0; k < num_glyphs; k++)
+    {
+        const GlyphCursor& glyph = glyphCursorVec[k];
+        int32_t advance = 0;
+        if (!IsNewline(glyph.cp))
+        {
+            const Font& font = GetGlyphFont(glyph.font);
+            advance = font.GetAdvance(glyph.index);
+            const bool odd = (glyph.level & 1) != 0;
+            const size_t right = odd ? k - 1 : k + 1;
+            if ((odd ? k > 0 : k + 1 < num_glyphs) && glyphCursorVec[right].level == glyph.level &&
+                glyphCursorVec[right].font == glyph.font && FT_HAS_KERNING(font.GetFace().GetFTFace()))
+            {
+                // activates the font's size, which the kerning is scaled by.
+                FT_Vector delta;
+                FT_Get_Kerning(font.GetFTFace(), glyph.index, glyphCursorVec[right].index, FT_KERNING_DEFAULT, &delta);
+                advance += (int32_t)FIXED_TO_INT(delta.x);
+            }
+        }
+        pen[k + 1] = pen[k] + advance;
+        codePointVec[k] = glyph.cp;
+    }
 
-static uint32_t loop_next_rtl(uint32_t i) { return i - 1; }
-static uint32_t loop_next_ltr(uint32_t i) { return i + 1; }
+    // a single ellipsis glyph if the font has one, three periods otherwise.
+    uint32_t ellipsis_index = 0;
+    int32_t ellipsis_count = 0;
+    if (maxLines > 0)
+    {
+        ellipsis_index = m_font->GetGlyphIndex(0x2026);
+        ellipsis_count = 1;
+        if (ellipsis_index == 0)
+        {
+            ellipsis_index = m_font->GetGlyphIndex('.');
+            ellipsis_count = ellipsis_index ? 3 : 0;
+        }
+    }
+    const int32_t ellipsis_advance = ellipsis_count ? m_font->GetAdvance(ellipsis_index) : 0;
 
-// TODO: fix inf. loop if fit always returns false.
-static int loop_fit_ltr(int32_t pen_x, uint32_t advance, int32_t kern, uint32_t size) { return (pen_x + advance + kern) <= size; }
-static int loop_fit_rtl(int32_t pen_x, uint32_t advance, int32_t kern, uint32_t size) { return (-pen_x + advance + kern) <= size; }
+    GlyphInfoVec& q = workspace.m_glyphInfoVec;
+    q.clear();
+    q.reserve(num_glyphs + 1);
+    const int32_t max_width = m_size.x;
+    size_t num_lines = 0;
+    truncatedOut = false;
 
-static int32_t loop_advance_ltr(int32_t pen_x, uint32_t advance, int32_t kern) { return pen_x + advance + kern; }
-static int32_t loop_advance_rtl(int32_t pen_x, uint32_t advance, int32_t kern) { return pen_x - advance - kern; }
-static int32_t loop_advance_none(int32_t pen_x, uint32_t advance, int32_t kern) { return pen_x; }
+    // appends the glyphs in [start, end) followed by a NEWLINE_GLYPH holding the line width.
+    // returns false once the line limit is reached.
+    Vector<uint8_t>& lineLevelVec = workspace.m_lineLevelVec;
+    Vector<uint32_t>& visualVec = workspace.m_lineVisualVec;
+    auto addLine = [&](size_t start, size_t end, bool softBreak)
+    {
+        size_t trimmed = end;
+        while (trimmed > start && IsSpace(codePointVec[trimmed - 1]))
+            trimmed--;
 
-typedef uint32_t (*iter_func_t)(uint32_t i);
-typedef int (*fit_func_t)(int32_t pen_x, uint32_t advance, int32_t kern, uint32_t size);
-typedef int32_t (*advance_func_t)(int32_t pen_x, uint32_t advance, int32_t kern);
+        // the last allowed line gives up glyphs at the end until the ellipsis fits.
+        const bool truncate = maxLines > 0 && num_lines + 1 == maxLines && end < num_glyphs;
+        if (truncate)
+        {
+            while (trimmed > start && pen[trimmed] - pen[start] + ellipsis_count * ellipsis_advance > max_width)
+                trimmed--;
+            while (trimmed > start && IsSpace(codePointVec[trimmed - 1]))
+                trimmed--;
+        }
 
-// TODO: split this into several methods
-// TODO: vertical justification
-// TODO: more c++ like impl, use traits or interfaces instead of function pointers
-void Text::WordWrapAndGenerateQuads(const GlyphCursorVec& glyphCursorVec)
-{
-    Context& context = Context::Get();
-
-    // create a queue to hold word-wrapped glyphs
-    std::vector<GlyphInfo> q;
-
-    fit_func_t fit;
-    advance_func_t pre_advance, post_advance;
-    iter_func_t begin, end, next, prev;
-    if (m_dir == Direction_RTL)
-    {
-        fit = loop_fit_rtl;
-        pre_advance = loop_advance_rtl;
-        post_advance = loop_advance_none;
-        begin = loop_begin_rtl;
-        end = loop_end_rtl;
-        next = loop_next_rtl;
-        prev = loop_next_ltr;
-    }
-    else
-    {
-        fit = loop_fit_ltr;
-        pre_advance = loop_advance_none;
-        post_advance = loop_advance_ltr;
-        begin = loop_begin_ltr;
-        end = loop_end_ltr;
-        next = loop_next_ltr;
-        prev = loop_next_rtl;
-    }
+        // the line ends at its newline, or before the spaces dropped at a soft break or the glyphs cut by the ellipsis.
+        const size_t drawEnd = (softBreak || truncate) ? trimmed : end;
+        const uint32_t cluster_end = drawEnd < num_glyphs ? glyphCursorVec[drawEnd].cluster : (uint32_t)m_string.size();
 
-    int32_t pen_x = 0;
-    int32_t inside_word = 0;
-    uint32_t word_start_i = 0, word_end_i = 0;
-    int32_t word_start_x = 0, word_end_x = 0;
-    int32_t num_glyphs = glyphCursorVec.size();
-    for (int i = begin(num_glyphs); i != end(num_glyphs); i = next(i))
-    {
-        // lookup kerning
-        int32_t kern = 0;
-        if (next(i) != end(num_glyphs))
+        // trailing spaces go back to the paragraph direction (L1).
+        const size_t line_start = q.size();
+        uint32_t any_level = base_level;
+        for (size_t k = start; k < drawEnd; k++)
         {
-            FT_Vector delta;
-            FT_Get_Kerning(m_font->GetFTFace(), glyphCursorVec[i].index,
-                           glyphCursorVec[next(i)].index,
-                           FT_KERNING_DEFAULT, &delta);
-            kern = FIXED_TO_INT(delta.x);
+            const GlyphType type = IsSpace(codePointVec[k]) ? SPACE_GLYPH : NORMAL_GLYPH;
+            const GlyphCursor& glyph = glyphCursorVec[k];
+            q.push_back(GlyphInfo{type, glyph.index, glyph.font, 0, pen[k + 1] - pen[k], glyph.cluster, 0, (glyph.level & 1) != 0});
+            any_level |= glyph.level;
         }
+        if (truncate)
+            for (int32_t i = 0; i < ellipsis_count; i++)
+                q.push_back(GlyphInfo{NORMAL_GLYPH, ellipsis_index, 0, 0, ellipsis_advance, cluster_end, 0, rtl});
 
-        if (IsNewline(glyphCursorVec[i].cp))
+        // trailing spaces do not count towards alignment, they hang past the end of the line.
+        const int32_t width = pen[trimmed] - pen[start] + (truncate ? ellipsis_count * ellipsis_advance : 0);
+        int32_t x = rtl ? pen[trimmed] - pen[drawEnd] : 0;
+
+        // a line that is all level 0 is already in visual order.
+        const size_t line_end = q.size();
+        if (any_level == 0)
         {
-            q.push_back(GlyphInfo{NEWLINE_GLYPH, nullptr, pen_x});
-            pen_x = 0;
-            inside_word = 0;
+            for (size_t i = line_start; i < line_end; i++)
+            {
+                q[i].x = x;
+                q[i].visual = (uint32_t)(i - line_start);
+                x += q[i].advance;
+            }
         }
         else
         {
-            auto weakGlyphPtr = context.FindInMap(GlyphKey(glyphCursorVec[i].index, m_font->GetIndex()));
-            assert(!weakGlyphPtr.expired());
-            std::shared_ptr<Glyph> glyph(weakGlyphPtr.lock());
-
-            if (inside_word)
+            lineLevelVec.clear();
+            for (size_t k = start; k < drawEnd; k++)
+                lineLevelVec.push_back(k < trimmed ? (uint8_t)glyphCursorVec[k].level : base_level);
+            lineLevelVec.resize(line_end - line_start, base_level);
+            ReorderBidiLine(lineLevelVec.data(), lineLevelVec.size(), visualVec);
+            for (size_t v = 0; v < visualVec.size(); v++)
             {
-                // does glyph fit on this line?
-                if (fit(pen_x, glyph->GetAdvance(), kern, m_size.x))
-                {
-                    pen_x = pre_advance(pen_x, glyph->GetAdvance(), kern);
-                    if (IsSpace(glyphCursorVec[i].cp))
-                    {
-                        q.push_back(GlyphInfo{SPACE_GLYPH, glyph.get(), pen_x});
-                        // exiting word
-                        word_end_i = i;
-                        word_end_x = pen_x;
-                        inside_word = 0;
-                    }
-                    else
-                    {
-                        q.push_back(GlyphInfo{NORMAL_GLYPH, glyph.get(), pen_x});
-                    }
-                    pen_x = post_advance(pen_x, glyph->GetAdvance(), kern);
-                }
-                else
-                {
-                    if (IsSpace(glyphCursorVec[i].cp))
-                    {
-                        // skip spaces
-                        while (IsSpace(glyphCursorVec[i].cp))
-                        {
-                            i = next(i);
-                        }
-                        prev(i);
-                    }
-                    else
-                    {
-                        // if the current word starts at the beginning of the line.
-                        if (word_start_x == 0)
-                        {
-                            // we will have to split the word in the middle.
-                            i = prev(i);
-                        }
-                        else
-                        {
-                            // backtrack to one before word_start_i, and restore pen_x
-                            while (i != prev(word_start_i))
-                            {
-                                if (m_dir == Direction_LTR)
-                                    pen_x = q.back().x;
-                                q.pop_back();
-                                if (m_dir == Direction_RTL)
-                                    pen_x = q.back().x;
-                                i = prev(i);
-                            }
-                        }
-                    }
-                    q.push_back(GlyphInfo{NEWLINE_GLYPH, nullptr, pen_x});
-                    pen_x = 0;
-                    inside_word = 0;
-                }
+                GlyphInfo& info = q[line_start + visualVec[v]];
+                info.x = x;
+                info.visual = (uint32_t)v;
+                x += info.advance;
             }
-            else  // !inside_word
+        }
+        q.push_back(GlyphInfo{NEWLINE_GLYPH, 0, 0, width, 0, cluster_end, 0, rtl});
+
+        num_lines++;
+        truncatedOut = truncate;
+        return !truncate;
+    };
+
+    Vector<uint8_t>& breakVec = workspace.m_breakVec;
+    size_t paragraph_start = 0;
+    while (true)
+    {
+        size_t paragraph_end = paragraph_start;
+        while (paragraph_end < num_glyphs && !IsNewline(codePointVec[paragraph_end]))
+            paragraph_end++;
+
+        FindLineBreakOpportunities(codePointVec.data() + paragraph_start, paragraph_end - paragraph_start, breakVec);
+
+        size_t line_start = paragraph_start;
+        size_t last_break = paragraph_start;
+        for (size_t k = paragraph_start; k < paragraph_end; k++)
+        {
+            if (breakVec[k - paragraph_start])
+                last_break = k;
+
+            // spaces never overflow, they hang.
+            if (IsSpace(codePointVec[k]))
+                continue;
+
+            while (k > line_start && pen[k + 1] - pen[line_start] > max_width)
             {
-                // does glyph fit on this line?
-                if (fit(pen_x, glyph->GetAdvance(), kern, m_size.x))
-                {
-                    pen_x = pre_advance(pen_x, glyph->GetAdvance(), kern);
-                    if (IsSpace(glyphCursorVec[i].cp))
-                    {
-                        q.push_back(GlyphInfo{SPACE_GLYPH, glyph.get(), pen_x});
-                    }
-                    else
-                    {
-                        q.push_back(GlyphInfo{NORMAL_GLYPH, glyph.get(), pen_x});
-                        // entering word
-                        word_start_i = i;
-                        word_start_x = pen_x;
-                        inside_word = 1;
-                    }
-                    pen_x = post_advance(pen_x, glyph->GetAdvance(), kern);
-                }
-                else
+                size_t line_end = last_break;
+                if (line_end <= line_start)
                 {
-                    // skip spaces
-                    while (IsSpace(glyphCursorVec[i].cp))
-                    {
-                        i = next(i);
-                    }
-                    // backup one char, so the next iteration thru the loop will be a non-space character
-                    i = prev(i);
-                    q.push_back(GlyphInfo{NEWLINE_GLYPH, nullptr, word_end_x});
-                    pen_x = 0;
-                    inside_word = 0;
+                    // no break opportunity, break after as many glyphs as fit.
+                    line_end = line_start + 1;
+                    while (line_end < k && pen[line_end + 1] - pen[line_start] <= max_width)
+                        line_end++;
                 }
+                if (!addLine(line_start, line_end, true))
+                    return;
+                line_start = line_end;
             }
         }
+        if (!addLine(line_start, paragraph_end, false))
+            return;
+
+        // skip the newline itself.
+        if (paragraph_end >= num_glyphs)
+            break;
+        paragraph_start = paragraph_end + 1;
+    }
+
+}
+
+// returns where to cut the string to shape at least size bytes of it.
+// cuts after a space or newline when one is close, so words are not shaped in pieces.
+static size_t FindPrefixEnd(const String& str, size_t size)
+{
+    if (size >= str.size())
+        return str.size();
+
+    const size_t limit = std::min(str.size(), size + 64);
+    for (size_t i = size; i < limit; i++)
+    {
+        if (str[i] == ' ' || str[i] == '\n')
+            return i + 1;
+    }
+
+    // otherwise at the next code point.
+    while (size < str.size() && (str[size] & 0xc0) == 0x80)
+        size++;
+    return size;
+}
+
+// Wraps the lines that fit in size.y, shaping a prefix of the string that doubles until the lines overflow.
+// Nothing past the last line is shaped, measured or rasterized, so labels of any length cost the same.
+void Text::TruncatedWordWrap(TextWorkspace& workspace) const
+{
+    const size_t maxLines = std::max(1, m_size.y / std::max(1, m_font->GetLineHeight()));
+
+    // guess from the width of a space, which is narrower than most glyphs.
+    const int32_t space_advance = std::max(1, m_font->GetAdvance(m_font->GetGlyphIndex(' ')));
+    size_t size = (maxLines + 1) * (std::max(0, m_size.x) / space_advance + 1);
+    while (true)
+    {
+        const size_t end = FindPrefixEnd(m_string, size);
+        bool truncated = false;
+        Shape(end, workspace);
+        WordWrap(workspace.m_glyphCursorVec, maxLines, workspace, truncated);
+        if (truncated || end == m_string.size())
+            return;
+        size = end * 2;
     }
+}
 
-    // end with a new line, (makes justification easier)
-    q.push_back(GlyphInfo{NEWLINE_GLYPH, nullptr, pen_x});
+// TODO: vertical justification
+void Text::GenerateQuads(GlyphInfoVec& q, const Vector<const Glyph*>& glyphVec)
+{
+    Context& context = m_font->GetContext();
 
     // allocate quads
-    m_quadVec.clear();
-    m_quadVec.reserve(q.size());
+    m_snapshot->m_quadVec.clear();
+    m_snapshot->m_quadVec.reserve(q.size());
 
     const Cache& cache = context.GetCache();
     const float texture_size = (float)cache.GetTextureSize();
-    int32_t line_height = FIXED_TO_INT(m_font->GetFTFace()->size->metrics.height);
+    int32_t line_height = m_font->GetLineHeight();
     int32_t y = m_origin.y + line_height;
 
     // horizontal justification
@@ -321,19 +341,17 @@ void Text::WordWrapAndGenerateQuads(const GlyphCursorVec& glyphCursorVec)
         GlyphInfo& info = q[i];
         if (info.type == NEWLINE_GLYPH)
         {
-            int32_t left_edge = (m_dir == Direction_RTL) ? info.x : 0;
-            int32_t right_edge = (m_dir == Direction_RTL) ? 0 : info.x;
             int32_t offset = 0;
             switch (m_horizontalAlign)
             {
             case TextHorizontalAlign_Left:
-                offset = -left_edge;
+                offset = 0;
                 break;
             case TextHorizontalAlign_Right:
-                offset = m_size.x - right_edge;
+                offset = m_size.x - info.x;
                 break;
             case TextHorizontalAlign_Center:
-                offset = (m_size.x - left_edge - right_edge) / 2;
+                offset = (m_size.x - info.x) / 2;
                 break;
             }
             // apply offset to each glyphinfo.x
@@ -342,141 +360,670 @@ void Text::WordWrapAndGenerateQuads(const GlyphCursorVec& glyphCursorVec)
                 q[j].x += offset;
             }
             line_start = i + 1;
+
+            // from here on the newline holds where the caret starts on its line.
+            info.x = (m_dir == Direction_RTL) ? offset + info.x : offset;
         }
     }
 
     // initialize quads
+    size_t glyph_i = 0;
+    m_lineVec.clear();
+    m_caretVec.clear();
+    m_caretVec.reserve(q.size());
+    m_visualVec.resize(q.size());
+    Line line = {0, 0, y, y, 0, 0, 0};
     for (auto &info : q)
     {
         if (info.type == NEWLINE_GLYPH)
         {
+            line.quadEnd = (uint32_t)m_snapshot->m_quadVec.size();
+            line.x = m_origin.x + info.x;
+            line.clusterStart = line.quadEnd > line.quadStart ? m_caretVec[line.quadStart].cluster : info.cluster;
+            line.clusterEnd = info.cluster;
+            m_lineVec.push_back(line);
+
+            // each glyph ends where the next cluster in logical order starts.
+            for (uint32_t i = line.quadEnd; i-- > line.quadStart; )
+            {
+                if (i + 1 == line.quadEnd)
+                    m_caretVec[i].clusterEnd = info.cluster;
+                else if (m_caretVec[i + 1].cluster != m_caretVec[i].cluster)
+                    m_caretVec[i].clusterEnd = m_caretVec[i + 1].cluster;
+                else
+                    m_caretVec[i].clusterEnd = m_caretVec[i + 1].clusterEnd;
+            }
             y += line_height;
+            line = Line{line.quadEnd, line.quadEnd, y, y, 0, 0, 0};
         }
         else
         {
             // NOTE: y axis points down, quad origin is upper-left corner of glyph
             // build quad
-            IntPoint glyphBearing = info.gbGlyph->GetBearing();
-            IntPoint glyphOrigin = info.gbGlyph->GetOrigin();
-            IntPoint glyphSize = info.gbGlyph->GetSize();
+            const Glyph* glyph = glyphVec[glyph_i++];
+            IntPoint glyphBearing = glyph->GetBearing();
+            IntPoint glyphOrigin = glyph->GetOrigin();
+            IntPoint glyphSize = glyph->GetSize();
 
-            const int pad = (int)m_font->GetPaddingBorder();
+            const int pad = (int)GetGlyphFont(info.font).GetPaddingBorder();
 
             IntPoint pen = {m_origin.x + info.x, y};
             IntPoint origin = {m_origin.x + info.x + glyphBearing.x - pad, y - glyphBearing.y - pad};
             IntPoint size = glyphSize;
             FloatPoint uvOrigin = {glyphOrigin.x / texture_size, glyphOrigin.y / texture_size};
             FloatPoint uvSize = {glyphSize.x / texture_size, glyphSize.y / texture_size};
-            uint32_t glTexObj = info.gbGlyph->GetTexObj() ? info.gbGlyph->GetTexObj() : context.GetFallbackTexture().GetTexObj();
+            uint32_t glTexObj = glyph->GetTexObj() ? glyph->GetTexObj() : context.GetFallbackTexture().GetTexObj();
+
+            const uint32_t flags = glyph->IsColor() ? QuadFlags_Color : QuadFlags_None;
+            m_snapshot->m_quadVec.push_back(Quad{pen, origin, size, uvOrigin, uvSize, m_userData, glTexObj, flags});
+            m_visualVec[line.quadStart + info.visual] = (uint32_t)m_snapshot->m_quadVec.size() - 1;
+            m_caretVec.push_back(Caret{info.cluster, 0, info.advance, info.rtl});
+            line.top = std::min(line.top, origin.y);
+            line.bottom = std::max(line.bottom, origin.y + size.y);
+        }
+    }
+
+    // make the line extents monotonic, a tall glyph can reach past its neighbours.
+    for (size_t i = 1; i < m_lineVec.size(); i++)
+        m_lineVec[i].bottom = std::max(m_lineVec[i].bottom, m_lineVec[i - 1].bottom);
+    for (size_t i = m_lineVec.size(); i-- > 1; )
+        m_lineVec[i - 1].top = std::min(m_lineVec[i - 1].top, m_lineVec[i].top);
+    m_visualVec.resize(m_snapshot->m_quadVec.size());
+}
+
+uint32_t Text::HitTest(IntPoint point) const
+{
+    if (m_lineVec.empty())
+        return 0;
+
+    const int32_t line_height = std::max(1, m_font->GetLineHeight());
+    int32_t line_i = point.y >= m_origin.y ? (point.y - m_origin.y) / line_height : 0;
+    const Line& line = m_lineVec[std::min<size_t>(line_i, m_lineVec.size() - 1)];
+    if (line.quadStart == line.quadEnd)
+        return line.clusterStart;
+
+    // first glyph from the left that ends at or past the point, or the last one.
+    // a point on the edge between two glyphs goes to the left one, where the edge is a caret position of both.
+    uint32_t lo = line.quadStart, hi = line.quadEnd;
+    while (lo < hi)
+    {
+        uint32_t mid = lo + (hi - lo) / 2;
+        const uint32_t i = m_visualVec[mid];
+        if (m_snapshot->m_quadVec[i].pen.x + m_caretVec[i].advance < point.x)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    const Caret& caret = m_caretVec[m_visualVec[std::min(lo, line.quadEnd - 1)]];
+    const int32_t x = m_snapshot->m_quadVec[m_visualVec[std::min(lo, line.quadEnd - 1)]].pen.x;
+
+    // the caret goes to whichever side of the glyph is closer, the right side is the end of a left-to-right glyph.
+    const bool right = lo == line.quadEnd || point.x - x >= caret.advance / 2;
+    return right != caret.rtl ? caret.clusterEnd : caret.cluster;
+}
+
+IntPoint Text::GetCaretPosition(uint32_t cluster) const
+{
+    if (m_lineVec.empty())
+        return m_origin;
 
-            m_quadVec.push_back(Quad{pen, origin, size, uvOrigin, uvSize, m_userData, glTexObj});
+    // last line starting at or before the cluster.
+    auto line_iter = std::upper_bound(m_lineVec.begin(), m_lineVec.end(), cluster,
+                                      [](uint32_t c, const Line& line) { return c < line.clusterStart; });
+    if (line_iter != m_lineVec.begin())
+        --line_iter;
+    const Line& line = *line_iter;
+    const int32_t top = m_origin.y + (int32_t)(line_iter - m_lineVec.begin()) * m_font->GetLineHeight();
+
+    // before the first glyph of the cluster, or after the glyph holding it.
+    auto begin = m_caretVec.begin() + line.quadStart;
+    auto end = m_caretVec.begin() + line.quadEnd;
+    auto iter = std::lower_bound(begin, end, cluster,
+                                 [](const Caret& caret, uint32_t c) { return caret.cluster < c; });
+    if (iter != end && iter->cluster == cluster)
+    {
+        const int32_t x = m_snapshot->m_quadVec[iter - m_caretVec.begin()].pen.x;
+        return IntPoint{iter->rtl ? x + iter->advance : x, top};
+    }
+    else if (iter != begin)
+    {
+        --iter;
+        const int32_t x = m_snapshot->m_quadVec[iter - m_caretVec.begin()].pen.x;
+        return IntPoint{iter->rtl ? x : x + iter->advance, top};
+    }
+    return IntPoint{line.x, top};
+}
+
+// trims the quad to the rectangle, returns false if nothing is left.
+static bool ClipQuad(Quad& quad, int32_t left, int32_t top, int32_t right, int32_t bottom)
+{
+    int32_t x0 = std::max(quad.origin.x, left);
+    int32_t y0 = std::max(quad.origin.y, top);
+    int32_t x1 = std::min(quad.origin.x + quad.size.x, right);
+    int32_t y1 = std::min(quad.origin.y + quad.size.y, bottom);
+    if (x0 >= x1 || y0 >= y1)
+        return false;
+
+    if (x0 != quad.origin.x || x1 != quad.origin.x + quad.size.x)
+    {
+        float du = quad.uvSize.x / quad.size.x;
+        quad.uvOrigin.x += (x0 - quad.origin.x) * du;
+        quad.uvSize.x = (x1 - x0) * du;
+        quad.origin.x = x0;
+        quad.size.x = x1 - x0;
+    }
+    if (y0 != quad.origin.y || y1 != quad.origin.y + quad.size.y)
+    {
+        float dv = quad.uvSize.y / quad.size.y;
+        quad.uvOrigin.y += (y0 - quad.origin.y) * dv;
+        quad.uvSize.y = (y1 - y0) * dv;
+        quad.origin.y = y0;
+        quad.size.y = y1 - y0;
+    }
+    return true;
+}
+
+void Text::ClipQuads(IntPoint clipOrigin, IntPoint clipSize, QuadVec& quadVecOut) const
+{
+    const int32_t left = clipOrigin.x;
+    const int32_t top = clipOrigin.y;
+    const int32_t right = clipOrigin.x + clipSize.x;
+    const int32_t bottom = clipOrigin.y + clipSize.y;
+
+    // skip the lines above the rectangle, stop at the first line below it.
+    auto iter = std::upper_bound(m_lineVec.begin(), m_lineVec.end(), top,
+                                 [](int32_t y, const Line& line) { return y < line.bottom; });
+    for (; iter != m_lineVec.end() && iter->top < bottom; ++iter)
+    {
+        for (uint32_t i = iter->quadStart; i < iter->quadEnd; i++)
+        {
+            Quad quad = m_snapshot->m_quadVec[i];
+            if (ClipQuad(quad, left, top, right, bottom))
+                quadVecOut.push_back(quad);
         }
     }
 }
 
+QuadSnapshot::QuadSnapshot(Context& context, std::shared_ptr<void> userData) :
+    m_context(context),
+    m_quadVec(context.GetAllocator()),
+    m_glyphHandleVec(context.GetAllocator()),
+    m_sourceVec(context.GetAllocator()),
+    m_userData(userData)
+{
+}
+
+QuadSnapshot::~QuadSnapshot()
+{
+    m_context.ReleaseGlyphs(m_glyphHandleVec);
+}
+
+std::shared_ptr<QuadSnapshot> QuadSnapshot::Create(Context& context, std::shared_ptr<void> userData)
+{
+    Allocator& allocator = context.GetAllocator();
+    void* ptr = allocator.Allocate(sizeof(QuadSnapshot), alignof(QuadSnapshot));
+    return std::shared_ptr<QuadSnapshot>(new (ptr) QuadSnapshot(context, userData), AllocatorDelete<QuadSnapshot>(&allocator),
+                                         StlAllocator<QuadSnapshot>(allocator));
+}
+
+// userData is freed with free(), the reference count comes from the allocator.
+static std::shared_ptr<void> MakeUserData(Allocator& allocator, void* userData)
+{
+    return std::shared_ptr<void>(userData, free, StlAllocator<char>(allocator));
+}
+
+Text::ShapeScratch::ShapeScratch(Allocator& allocator) :
+    runVec(allocator),
+    fontRunVec(allocator)
+#ifdef GB_USE_HARFBUZZ
+    , hbBuffer(nullptr),
+    paragraphStart(0),
+    paragraphEnd(0)
+#endif
+{
+}
+
+Text::ShapeScratch::~ShapeScratch()
+{
+#ifdef GB_USE_HARFBUZZ
+    if (hbBuffer)
+        hb_buffer_destroy(hbBuffer);
+#endif
+}
+
+TextWorkspace::TextWorkspace(Context& context) :
+    m_codePointVec(context.GetAllocator()),
+    m_clusterVec(context.GetAllocator()),
+    m_chunkVec(context.GetAllocator()),
+    m_glyphCursorVec(context.GetAllocator()),
+    m_shapeScratch(context.GetAllocator()),
+    m_penVec(context.GetAllocator()),
+    m_wrapCodePointVec(context.GetAllocator()),
+    m_breakVec(context.GetAllocator()),
+    m_lineLevelVec(context.GetAllocator()),
+    m_lineVisualVec(context.GetAllocator()),
+    m_glyphInfoVec(context.GetAllocator()),
+    m_keyVec(context.GetAllocator()),
+    m_glyphBatchScratch(context.GetAllocator()),
+    m_glyphVec(context.GetAllocator()),
+    m_oldHandleVec(context.GetAllocator())
+{
+}
+
 Text::Text(const std::string& string, std::shared_ptr<Font> font,
            void* userData, IntPoint origin, IntPoint size,
            TextHorizontalAlign horizontalAlign, TextVerticalAlign verticalAlign,
            uint32_t optionFlags, const char* script) :
+    Text(string.data(), string.size(), font, userData, origin, size, horizontalAlign, verticalAlign, optionFlags, script)
+{
+}
+
+Text::Text(const char* string, size_t length, std::shared_ptr<Font> font,
+           void* userData, IntPoint origin, IntPoint size,
+           TextHorizontalAlign horizontalAlign, TextVerticalAlign verticalAlign,
+           uint32_t optionFlags, const char* script) :
     m_font(font),
-    m_string(string),
-    m_script(script ? script : ""),
+    m_string(string, length, font->GetContext().GetAllocator()),
+    m_script(script ? script : "", font->GetContext().GetAllocator()),
+    m_dir(optionFlags & TextOptionFlags_DirectionRightToLeft ? Direction_RTL : Direction_LTR),
+    m_userData(userData),
+    m_origin(origin),
+    m_size(size),
+    m_horizontalAlign(horizontalAlign),
+    m_verticalAlign(verticalAlign),
+    m_optionFlags(optionFlags),
+    m_snapshot(QuadSnapshot::Create(font->GetContext(), MakeUserData(font->GetContext().GetAllocator(), userData))),
+    m_clipQuadVec(font->GetContext().GetAllocator()),
+    m_lineVec(font->GetContext().GetAllocator()),
+    m_caretVec(font->GetContext().GetAllocator()),
+    m_visualVec(font->GetContext().GetAllocator())
+{
+    TextWorkspacePtr temporary;
+    Layout(GetWorkspace(nullptr, temporary));
+}
+
+Text::Text(const std::string& string, std::shared_ptr<FontFamily> fontFamily,
+           void* userData, IntPoint origin, IntPoint size,
+           TextHorizontalAlign horizontalAlign, TextVerticalAlign verticalAlign,
+           uint32_t optionFlags, const char* script) :
+    m_font(fontFamily->GetFont(0)),
+    m_fontFamily(fontFamily->GetNumFonts() > 1 ? fontFamily : nullptr),
+    m_string(string.data(), string.size(), m_font->GetContext().GetAllocator()),
+    m_script(script ? script : "", m_font->GetContext().GetAllocator()),
     m_dir(optionFlags & TextOptionFlags_DirectionRightToLeft ? Direction_RTL : Direction_LTR),
     m_userData(userData),
     m_origin(origin),
     m_size(size),
     m_horizontalAlign(horizontalAlign),
     m_verticalAlign(verticalAlign),
-    m_optionFlags(optionFlags)
+    m_optionFlags(optionFlags),
+    m_snapshot(QuadSnapshot::Create(m_font->GetContext(), MakeUserData(m_font->GetContext().GetAllocator(), userData))),
+    m_clipQuadVec(m_font->GetContext().GetAllocator()),
+    m_lineVec(m_font->GetContext().GetAllocator()),
+    m_caretVec(m_font->GetContext().GetAllocator()),
+    m_visualVec(m_font->GetContext().GetAllocator())
+{
+    TextWorkspacePtr temporary;
+    Layout(GetWorkspace(nullptr, temporary));
+}
+
+Allocator& Text::GetAllocator() const
+{
+    return m_font->GetContext().GetAllocator();
+}
+
+TextWorkspace& Text::GetWorkspace(TextWorkspace* workspace, TextWorkspacePtr& temporaryOut) const
+{
+    Context& context = m_font->GetContext();
+    if (workspace)
+        return *workspace;
+    if (!context.IsThreadSafe())
+        return context.GetTextWorkspace();
+    temporaryOut = AllocateUnique<TextWorkspace>(context.GetAllocator(), context);
+    return *temporaryOut;
+}
+
+void Text::Layout(TextWorkspace& workspace)
+{
+    if (m_optionFlags & TextOptionFlags_Truncate)
+    {
+        TruncatedWordWrap(workspace);
+    }
+    else
+    {
+        bool truncated = false;
+        Shape(m_string.size(), workspace);
+        WordWrap(workspace.m_glyphCursorVec, 0, workspace, truncated);
+    }
+    UpdateCache(workspace.m_glyphInfoVec, workspace);
+    GenerateQuads(workspace.m_glyphInfoVec, workspace.m_glyphVec);
+
+    // glyphs shared with the previous layout are never unreferenced, so they can not be reclaimed in between.
+    m_font->GetContext().ReleaseGlyphs(workspace.m_oldHandleVec);
+    workspace.m_oldHandleVec.clear();
+}
+
+void Text::SetString(const std::string& string, TextWorkspace* workspace)
 {
-    const GlyphCursorVec glyphCursorVec = Shape();
-    UpdateCache(glyphCursorVec);
-    WordWrapAndGenerateQuads(glyphCursorVec);
+    TextWorkspacePtr temporary;
+    TextWorkspace& layoutWorkspace = GetWorkspace(workspace, temporary);
+    m_string.assign(string.data(), string.size());
+
+    // the last snapshot is reused, unless a render thread still holds it, see Document::SetScrollY().
+    std::shared_ptr<QuadSnapshot> oldSnapshot;
+    if (m_snapshot.use_count() > 1)
+    {
+        oldSnapshot = m_snapshot;
+        m_snapshot = QuadSnapshot::Create(m_font->GetContext(), oldSnapshot->m_userData);
+    }
+    else
+    {
+        // copied rather than swapped, the workspace is shared by many texts and each keeps its own capacity.
+        std::atomic_thread_fence(std::memory_order_acquire);
+        Vector<GlyphHandle>& glyphHandleVec = m_snapshot->m_glyphHandleVec;
+        layoutWorkspace.m_oldHandleVec.assign(glyphHandleVec.begin(), glyphHandleVec.end());
+        glyphHandleVec.clear();
+    }
+    Layout(layoutWorkspace);
 }
 
 Text::~Text()
 {
-    if (m_userData)
-        free(m_userData);
+    // m_userData is freed by the snapshot, which may outlive the text.
+}
+
+static void CheckAsyncContext(const Context& context)
+{
+    if (!context.IsThreadSafe())
+    {
+        fprintf(stderr, "Error Text::CreateAsync requires a context created with ContextOptionFlags_ThreadSafe\n");
+        abort();
+    }
+}
+
+std::future<std::shared_ptr<Text>> Text::CreateAsync(const std::string& string, std::shared_ptr<Font> font,
+                                                     void* userData, IntPoint origin, IntPoint size,
+                                                     TextHorizontalAlign horizontalAlign, TextVerticalAlign verticalAlign,
+                                                     uint32_t optionFlags, const char* script)
+{
+    Context& context = font->GetContext();
+    CheckAsyncContext(context);
+    // an empty script is the same as none.
+    const std::string scriptString = script ? script : "";
+    StlAllocator<Text> allocator(context.GetAllocator());
+    auto promise = std::allocate_shared<std::promise<std::shared_ptr<Text>>>(allocator, std::allocator_arg, allocator);
+    context.GetTaskScheduler()->Spawn([=]()
+    {
+        promise->set_value(std::allocate_shared<Text>(allocator, string, font, userData, origin, size, horizontalAlign, verticalAlign,
+                                                  optionFlags, scriptString.c_str()));
+    });
+    return promise->get_future();
+}
+
+std::future<std::shared_ptr<Text>> Text::CreateAsync(const std::string& string, std::shared_ptr<FontFamily> fontFamily,
+                                                     void* userData, IntPoint origin, IntPoint size,
+                                                     TextHorizontalAlign horizontalAlign, TextVerticalAlign verticalAlign,
+                                                     uint32_t optionFlags, const char* script)
+{
+    Context& context = fontFamily->GetFont(0)->GetContext();
+    CheckAsyncContext(context);
+    // an empty script is the same as none.
+    const std::string scriptString = script ? script : "";
+    StlAllocator<Text> allocator(context.GetAllocator());
+    auto promise = std::allocate_shared<std::promise<std::shared_ptr<Text>>>(allocator, std::allocator_arg, allocator);
+    context.GetTaskScheduler()->Spawn([=]()
+    {
+        promise->set_value(std::allocate_shared<Text>(allocator, string, fontFamily, userData, origin, size, horizontalAlign, verticalAlign,
+                                                  optionFlags, scriptString.c_str()));
+    });
+    return promise->get_future();
+}
+
+void Text::CreateBatch(const std::vector<std::string>& stringVec, std::shared_ptr<Font> font,
+                       IntPoint origin, IntPoint size,
+                       TextHorizontalAlign horizontalAlign, TextVerticalAlign verticalAlign,
+                       uint32_t optionFlags, const char* script,
+                       std::vector<std::shared_ptr<Text>>& textVecOut)
+{
+    textVecOut.assign(stringVec.size(), nullptr);
+    StlAllocator<Text> allocator(font->GetContext().GetAllocator());
+    ParallelFor(font->GetContext().GetTaskScheduler(), stringVec.size(), 1, [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; i++)
+        {
+            textVecOut[i] = std::allocate_shared<Text>(allocator, stringVec[i], font, nullptr, origin, size,
+                                                   horizontalAlign, verticalAlign, optionFlags, script);
+        }
+    });
 }
 
 // Renders given text using renderer func.
 void Text::Draw()
 {
-    Context& context = Context::Get();
-    context.m_renderFunc(m_quadVec);
+    Context& context = m_font->GetContext();
+    context.UploadTextures();
+    context.m_renderFunc(m_snapshot->m_quadVec);
 }
 
-const Text::GlyphCursorVec Text::Shape() const
+void Text::Draw(IntPoint clipOrigin, IntPoint clipSize)
 {
-#ifdef GB_USE_HARFBUZZ
-    if (m_optionFlags & TextOptionFlags_DisableShaping)
+    m_clipQuadVec.clear();
+    ClipQuads(clipOrigin, clipSize, m_clipQuadVec);
+    Context& context = m_font->GetContext();
+    context.UploadTextures();
+    context.m_renderFunc(m_clipQuadVec);
+}
+
+// shapes the first size bytes of the string, which must end on a code point boundary.
+// long texts in a thread-safe context are split at paragraph ends and shaped as tasks.
+void Text::Shape(size_t size, TextWorkspace& workspace) const
+{
+    // decode once, every shaper works from the same utf32 code points.
+    Allocator& allocator = GetAllocator();
+    Vector<uint32_t>& codePointVec = workspace.m_codePointVec;
+    Vector<uint32_t>& clusterVec = workspace.m_clusterVec;
+    codePointVec.clear();
+    clusterVec.clear();
+    DecodeUTF8(m_string.c_str(), size, codePointVec, clusterVec);
+    const size_t num_cps = codePointVec.size();
+
+    GlyphCursorVec& glyphCursorVec = workspace.m_glyphCursorVec;
+    glyphCursorVec.clear();
+    glyphCursorVec.reserve(num_cps);
+
+    Vector<size_t>& chunkVec = workspace.m_chunkVec;
+    chunkVec.assign(1, 0);
+    TaskScheduler* scheduler = m_font->GetContext().GetTaskScheduler();
+    if (scheduler && num_cps >= 2 * kShapeGrain)
     {
-        return FreeTypeShape();
+        size_t chunk_end = kShapeGrain;
+        while (chunk_end < num_cps)
+        {
+            while (chunk_end < num_cps && !IsNewline(codePointVec[chunk_end - 1]))
+                chunk_end++;
+            chunkVec.push_back(chunk_end);
+            chunk_end += kShapeGrain;
+        }
     }
-    else
+    if (chunkVec.back() < num_cps)
+        chunkVec.push_back(num_cps);
+    if (chunkVec.size() <= 2)
     {
-        return HarfBuzzShape();
+        ShapeParagraphs(codePointVec, clusterVec, 0, num_cps, workspace.m_shapeScratch, glyphCursorVec);
+        return;
     }
+
+    Vector<GlyphCursorVec> chunkGlyphCursorVec(chunkVec.size() - 1, GlyphCursorVec(allocator), allocator);
+    ParallelFor(scheduler, chunkGlyphCursorVec.size(), 1, [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; i++)
+        {
+            ShapeScratch scratch(allocator);
+            chunkGlyphCursorVec[i].reserve(chunkVec[i + 1] - chunkVec[i]);
+            ShapeParagraphs(codePointVec, clusterVec, chunkVec[i], chunkVec[i + 1], scratch, chunkGlyphCursorVec[i]);
+        }
+    });
+
+    for (auto &chunk : chunkGlyphCursorVec)
+        glyphCursorVec.insert(glyphCursorVec.end(), chunk.begin(), chunk.end());
+}
+
+// each paragraph in code points [start, end) is split into runs by the bidi algorithm,
+// and each run is shaped in its own direction.  start & end are paragraph boundaries.
+void Text::ShapeParagraphs(const Vector<uint32_t>& codePointVec, const Vector<uint32_t>& clusterVec,
+                           size_t start, size_t end, ShapeScratch& scratch, GlyphCursorVec& glyphCursorVec) const
+{
+    BidiRunCache& bidiRunCache = m_font->GetContext().GetBidiRunCache();
+    const uint8_t baseLevel = m_dir == Direction_RTL ? 1 : 0;
+    Vector<BidiRun>& runVec = scratch.runVec;
+    size_t paragraph_start = start;
+    while (paragraph_start < end)
+    {
+        // each paragraph includes its newline.
+        size_t paragraph_end = paragraph_start;
+        while (paragraph_end < end && !IsNewline(codePointVec[paragraph_end]))
+            paragraph_end++;
+        if (paragraph_end < end)
+            paragraph_end++;
+
+#ifdef GB_USE_HARFBUZZ
+        scratch.paragraphStart = paragraph_start;
+        scratch.paragraphEnd = paragraph_end;
+#endif
+        bidiRunCache.GetRuns(codePointVec.data() + paragraph_start, paragraph_end - paragraph_start, baseLevel, runVec);
+        for (size_t i = 0; i < runVec.size(); i++)
+        {
+            size_t run_start = paragraph_start + runVec[i].start;
+            size_t run_end = i + 1 < runVec.size() ? paragraph_start + runVec[i + 1].start : paragraph_end;
+            ShapeRun(codePointVec, clusterVec, run_start, run_end, runVec[i].level, scratch, glyphCursorVec);
+        }
+        paragraph_start = paragraph_end;
+    }
+}
+
+void Text::ShapeRun(const Vector<uint32_t>& codePointVec, const Vector<uint32_t>& clusterVec,
+                    size_t start, size_t end, uint32_t level, ShapeScratch& scratch, GlyphCursorVec& glyphCursorVec) const
+{
+    const size_t run_start = glyphCursorVec.size();
+    FontRun single = {0, 0};
+    const FontRun* fontRuns = &single;
+    size_t num_font_runs = 1;
+    Vector<FontRun>& fontRunVec = scratch.fontRunVec;
+    if (m_fontFamily && end > start)
+    {
+        m_fontFamily->Itemize(codePointVec.data() + start, end - start, fontRunVec);
+        fontRuns = fontRunVec.data();
+        num_font_runs = fontRunVec.size();
+    }
+
+    // right-to-left font runs are still appended in logical order.
+    for (size_t i = 0; i < num_font_runs; i++)
+    {
+        const size_t font_start = start + fontRuns[i].start;
+        const size_t font_end = i + 1 < num_font_runs ? start + fontRuns[i + 1].start : end;
+        const uint32_t font = fontRuns[i].font;
+#ifdef GB_USE_HARFBUZZ
+        // most runs are plain labels that shaping would not change.
+        if (m_optionFlags & TextOptionFlags_DisableShaping)
+            FreeTypeShape(codePointVec, clusterVec, font_start, font_end, font, glyphCursorVec);
+        else if ((level & 1) || !SimpleShape(codePointVec, clusterVec, font_start, font_end, font, glyphCursorVec))
+            HarfBuzzShape(codePointVec, clusterVec, font_start, font_end, font, (level & 1) != 0, scratch, glyphCursorVec);
 #else
-    return FreeTypeShape();
+        FreeTypeShape(codePointVec, clusterVec, font_start, font_end, font, glyphCursorVec);
 #endif
+    }
+    for (size_t i = run_start; i < glyphCursorVec.size(); i++)
+        glyphCursorVec[i].level = level;
 }
 
 #ifdef GB_USE_HARFBUZZ
-const Text::GlyphCursorVec Text::HarfBuzzShape() const
+// code points harfbuzz maps straight through the cmap, when the font has a glyph for them.
+// excludes combining marks, default ignorables and anything needing complex shaping.
+static bool IsSimpleCodePoint(uint32_t codePoint)
 {
-    const char* str = m_string.c_str();
-    hb_buffer_t* hb_buffer = hb_buffer_create();
-    hb_buffer_set_direction(hb_buffer, m_dir == Direction_RTL ? HB_DIRECTION_RTL : HB_DIRECTION_LTR);
+    if (codePoint < 0x80) // ascii
+        return codePoint >= 0x20 || IsNewline(codePoint);
+    else if (codePoint < 0x250) // latin-1 & latin extended, minus c1 controls and soft hyphen
+        return codePoint >= 0xa0 && codePoint != 0xad;
+    else if (codePoint >= 0x370 && codePoint < 0x400) // greek
+        return true;
+    else if (codePoint >= 0x400 && codePoint < 0x530) // cyrillic, minus combining marks
+        return codePoint < 0x483 || codePoint > 0x489;
+    else
+        return false;
+}
+
+// appends a left-to-right run straight from the cmap cache, returns false and appends nothing if it needs HarfBuzz.
+bool Text::SimpleShape(const Vector<uint32_t>& codePointVec, const Vector<uint32_t>& clusterVec,
+                       size_t start, size_t end, uint32_t font, GlyphCursorVec& glyphCursorVec) const
+{
+    if (!m_script.empty() && m_script != "Latn" && m_script != "Grek" && m_script != "Cyrl")
+        return false;
+
+    const Font& glyphFont = GetGlyphFont(font);
+    const Face& face = glyphFont.GetFace();
+    const size_t run_start = glyphCursorVec.size();
+    for (size_t i = start; i < end; i++)
+    {
+        const uint32_t cp = codePointVec[i];
+        const bool simple = IsSimpleCodePoint(cp);
+        const uint32_t index = simple ? glyphFont.GetGlyphIndex(cp) : 0;
+
+        // harfbuzz decomposes or substitutes characters missing from the font.
+        if (!simple || (index == 0 && !IsNewline(cp)) || face.IsSubstitutedGlyph(index))
+        {
+            glyphCursorVec.resize(run_start);
+            return false;
+        }
+        glyphCursorVec.push_back(GlyphCursor{index, font, clusterVec[i], cp, 0});
+    }
+    return true;
+}
+
+void Text::HarfBuzzShape(const Vector<uint32_t>& codePointVec, const Vector<uint32_t>& clusterVec,
+                         size_t start, size_t end, uint32_t font, bool rtl, ShapeScratch& scratch,
+                         GlyphCursorVec& glyphCursorVec) const
+{
+    // the buffer is cleared rather than destroyed, so it keeps its memory for the next run.
+    if (!scratch.hbBuffer)
+        scratch.hbBuffer = hb_buffer_create();
+    hb_buffer_t* hb_buffer = scratch.hbBuffer;
+    hb_buffer_clear_contents(hb_buffer);
+    hb_buffer_set_direction(hb_buffer, rtl ? HB_DIRECTION_RTL : HB_DIRECTION_LTR);
     hb_script_t scriptTag = HB_SCRIPT_LATIN; // default script
     if (m_script.size() == 4)
         scriptTag = hb_script_from_string(m_script.c_str(), 4);
     hb_buffer_set_script(hb_buffer, scriptTag);
 
-    hb_buffer_add_utf8(hb_buffer, str, m_string.size(), 0, m_string.size());
-    hb_shape(m_font->GetHarfBuzzFont(), hb_buffer, NULL, 0);
+    // the rest of the paragraph is context for the run, harfbuzz clusters are indices into the paragraph,
+    // mapped back to byte offsets below.
+    const size_t paragraph_start = scratch.paragraphStart;
+    hb_buffer_add_codepoints(hb_buffer, codePointVec.data() + paragraph_start, (int)(scratch.paragraphEnd - paragraph_start),
+                             (unsigned int)(start - paragraph_start), (int)(end - start));
+    hb_shape(GetGlyphFont(font).GetHarfBuzzFont(), hb_buffer, NULL, 0);
 
-    // fill up glyphCursorVec with post shaping results.
+    // fill up glyphCursorVec with post shaping results, right-to-left runs come out in visual order.
     int num_glyphs = hb_buffer_get_length(hb_buffer);
-    std::vector<GlyphCursor> glyphCursorVec;
-    glyphCursorVec.reserve(num_glyphs);
+    glyphCursorVec.reserve(glyphCursorVec.size() + num_glyphs);
     hb_glyph_info_t *glyphs = hb_buffer_get_glyph_infos(hb_buffer, NULL);
-
-    // iterate over each glyph
     for (int i = 0; i < num_glyphs; i++)
     {
-        // figure out a utf codepoint for this glyph
-        uint32_t cp;
-        NextCodePoint(str + glyphs[i].cluster, &cp);
-
-        glyphCursorVec.push_back(GlyphCursor{glyphs[i].codepoint, glyphs[i].cluster, cp});
+        const hb_glyph_info_t& glyph = glyphs[rtl ? num_glyphs - 1 - i : i];
+        const size_t cluster = paragraph_start + glyph.cluster;
+        glyphCursorVec.push_back(GlyphCursor{glyph.codepoint, font, clusterVec[cluster], codePointVec[cluster], 0});
     }
-    hb_buffer_destroy(hb_buffer);
-
-    return glyphCursorVec;
 }
 #endif
 
-const Text::GlyphCursorVec Text::FreeTypeShape() const
+void Text::FreeTypeShape(const Vector<uint32_t>& codePointVec, const Vector<uint32_t>& clusterVec,
+                         size_t start, size_t end, uint32_t font, GlyphCursorVec& glyphCursorVec) const
 {
-    std::vector<GlyphCursor> glyphCursorVec;
-    glyphCursorVec.reserve(m_string.size()); // more then we need.
-
-    // iterate over utf8 string
-    auto ft_face = m_font->GetFTFace();
-    const char* str = m_string.c_str();
-    uint32_t cluster = 0;
-    while (*str)
+    const Font& glyphFont = GetGlyphFont(font);
+    for (size_t i = start; i < end; i++)
     {
-        uint32_t cp;
-        int offset = NextCodePoint(str, &cp);
-        uint32_t index = FT_Get_Char_Index(ft_face, cp);
-        glyphCursorVec.push_back(GlyphCursor{index, cluster, cp});
-        cluster += offset;
-        str += offset;
+        uint32_t index = glyphFont.GetGlyphIndex(codePointVec[i]);
+        glyphCursorVec.push_back(GlyphCursor{index, font, clusterVec[i], codePointVec[i], 0});
     }
-    return glyphCursorVec;
 }
 
 } // namspace gb
@@ -4,12 +4,19 @@
 #include <stdint.h>
 #include <string>
 #include <vector>
+#include <future>
+#ifdef GB_USE_HARFBUZZ
+#include <harfbuzz/hb.h>
+#endif
 #include "glyphblaster.h"
 #include "context.h"
+#include "fontfamily.h"
+#include "bidi.h"
 
 namespace gb {
 
 class Font;
+class TextWorkspace;
 
 enum TextHorizontalAlign {
     TextHorizontalAlign_Left = 0,
@@ -26,11 +33,42 @@ enum TextVerticalAlign {
 enum TextOptionFlags {
     TextOptionFlags_None = 0,
     TextOptionFlags_DisableShaping = 0x01,
-    TextOptionFlags_DirectionRightToLeft = 0x02
+    TextOptionFlags_DirectionRightToLeft = 0x02,  // paragraph direction, runs within it are ordered by the bidi algorithm.
+    TextOptionFlags_Truncate = 0x04  // keep only the lines that fit in size.y, the last one ends with an ellipsis.
+};
+
+// The quads of a Text or a Document, with the glyphs and user data they reference.  A snapshot never
+// changes once it is made, relayouts and scrolls make new ones, so a render thread can hold on to last
+// frame's while the next one is built, even after the Text is destroyed.  its glyphs keep their place
+// in the texture sheets until Context::Compact() repacks them.
+class QuadSnapshot
+{
+    friend class Text;
+    friend class Document;
+public:
+    const QuadVec& GetQuadVec() const { return m_quadVec; }
+
+    // releases the glyphs, the context must still exist.
+    ~QuadSnapshot();
+
+protected:
+    QuadSnapshot(Context& context, std::shared_ptr<void> userData);
+
+    // the snapshot and its reference count come from the context's allocator.
+    static std::shared_ptr<QuadSnapshot> Create(Context& context, std::shared_ptr<void> userData);
+
+    Context& m_context;
+    QuadVec m_quadVec;
+    Vector<GlyphHandle> m_glyphHandleVec;  // one reference per unique glyph.
+    Vector<std::shared_ptr<const QuadSnapshot>> m_sourceVec;  // snapshots the quads were clipped from.
+    std::shared_ptr<void> m_userData;  // freed along with the last snapshot.
+
+    GB_NO_COPY(QuadSnapshot)
 };
 
 class Text
 {
+    friend class TextWorkspace;
 public:
     // string is assumed to be utf8 encoded.
     // script tag is 4 char code from iso 15952, http://unicode.org/iso15924/
@@ -38,30 +76,176 @@ public:
          void* userData, IntPoint origin, IntPoint size,
          TextHorizontalAlign horizontalAlign, TextVerticalAlign verticalAlign,
          uint32_t optionFlags = TextOptionFlags_None, const char* script = nullptr);
+
+    // the same, for the first length bytes of string, such as one paragraph of a Document.
+    Text(const char* string, size_t length, std::shared_ptr<Font> font,
+         void* userData, IntPoint origin, IntPoint size,
+         TextHorizontalAlign horizontalAlign, TextVerticalAlign verticalAlign,
+         uint32_t optionFlags = TextOptionFlags_None, const char* script = nullptr);
+
+    // code points missing from the primary font of the family are drawn with the first fallback that has them.
+    Text(const std::string& string, std::shared_ptr<FontFamily> fontFamily,
+         void* userData, IntPoint origin, IntPoint size,
+         TextHorizontalAlign horizontalAlign, TextVerticalAlign verticalAlign,
+         uint32_t optionFlags = TextOptionFlags_None, const char* script = nullptr);
     ~Text();
+
+    // the same as the constructors above, but shaping, word-wrapping and rasterization run as a task on the
+    // context's TaskScheduler.  the font's context must be created with ContextOptionFlags_ThreadSafe,
+    // new glyphs are uploaded on the GL thread, by Draw() or Context::UploadTextures().
+    static std::future<std::shared_ptr<Text>> CreateAsync(const std::string& string, std::shared_ptr<Font> font,
+        void* userData, IntPoint origin, IntPoint size,
+        TextHorizontalAlign horizontalAlign, TextVerticalAlign verticalAlign,
+        uint32_t optionFlags = TextOptionFlags_None, const char* script = nullptr);
+    static std::future<std::shared_ptr<Text>> CreateAsync(const std::string& string, std::shared_ptr<FontFamily> fontFamily,
+        void* userData, IntPoint origin, IntPoint size,
+        TextHorizontalAlign horizontalAlign, TextVerticalAlign verticalAlign,
+        uint32_t optionFlags = TextOptionFlags_None, const char* script = nullptr);
+
+    // lays out every string with the same font & settings, as tasks on the context's TaskScheduler in a
+    // thread-safe context, and returns when they are all done.  textVecOut[i] is the Text for stringVec[i].
+    static void CreateBatch(const std::vector<std::string>& stringVec, std::shared_ptr<Font> font,
+                            IntPoint origin, IntPoint size,
+                            TextHorizontalAlign horizontalAlign, TextVerticalAlign verticalAlign,
+                            uint32_t optionFlags, const char* script,
+                            std::vector<std::shared_ptr<Text>>& textVecOut);
+
+    // lays the text out again with a new string, keeping the font, rectangle, alignment & options.
+    // the quads are rebuilt in place, unless a QuadSnapshot still holds them, so a label rebuilt every frame
+    // with a string of about the same length allocates nothing once its buffers have grown.
+    // the scratch buffers come from workspace, if it is null from the context's own workspace,
+    // or from a temporary one in a thread-safe context.
+    void SetString(const std::string& string, TextWorkspace* workspace = nullptr);
+
     void Draw();
-    const QuadVec& GetQuadVec() const { return m_quadVec; }
+
+    // only draws the parts of glyphs inside the clip rectangle, quads are trimmed,
+    // so a scrolling region needs no scissor or stencil.
+    void Draw(IntPoint clipOrigin, IntPoint clipSize);
+    const QuadVec& GetQuadVec() const { return m_snapshot->m_quadVec; }
+
+    // shares the quads without copying them, for drawing on another thread.
+    std::shared_ptr<const QuadSnapshot> GetQuadSnapshot() const { return m_snapshot; }
+
+    // appends the quads overlapping the clip rectangle to quadVecOut, trimmed to fit.
+    void ClipQuads(IntPoint clipOrigin, IntPoint clipSize, QuadVec& quadVecOut) const;
+
+    // number of lines after word-wrapping, an empty string is one line.
+    int GetNumLines() const { return (int)m_lineVec.size(); }
+
+    // byte offset in the string of the caret position nearest to point, as when clicking in an editor.
+    uint32_t HitTest(IntPoint point) const;
+
+    // top of the caret in front of the character at byte offset cluster, the caret is one line tall.
+    IntPoint GetCaretPosition(uint32_t cluster) const;
 
 protected:
+    // in logical order, level is the bidi embedding level, odd for right-to-left.
+    // font is the index of the glyph's font in the family, 0 is the primary font.
     struct GlyphCursor
     {
         uint32_t index;
+        uint32_t font;
         uint32_t cluster;
         uint32_t cp;
+        uint32_t level;
+    };
+    typedef Vector<GlyphCursor> GlyphCursorVec;
+
+    // word-wrapped glyph in logical order, NEWLINE_GLYPH ends each line.
+    // visual is the position of the glyph on its line, counting from the left.
+    // for a NEWLINE_GLYPH x is the line width, and cluster is where the line ends.
+    enum GlyphType { NEWLINE_GLYPH = 0, SPACE_GLYPH, NORMAL_GLYPH };
+    struct GlyphInfo
+    {
+        GlyphType type;
+        uint32_t index;
+        uint32_t font;
+        int32_t x;
+        int32_t advance;
+        uint32_t cluster;
+        uint32_t visual;
+        bool rtl;
+    };
+    typedef Vector<GlyphInfo> GlyphInfoVec;
+
+    // quads [quadStart, quadEnd) are on the line.
+    // the vertical extents are made monotonic, so lines can be culled with a binary search.
+    struct Line
+    {
+        uint32_t quadStart;
+        uint32_t quadEnd;
+        int32_t top;     // smallest top of any quad on this or a following line.
+        int32_t bottom;  // largest bottom of any quad on this or a preceding line.
+        int32_t x;       // caret position at the start of the line.
+        uint32_t clusterStart;
+        uint32_t clusterEnd;
+    };
+    typedef Vector<Line> LineVec;
+
+    // parallel to the quads, in logical order, the quad's pen is the left edge of the glyph.
+    // [cluster, clusterEnd) are the bytes of m_string the glyph was shaped from.
+    struct Caret
+    {
+        uint32_t cluster;
+        uint32_t clusterEnd;
+        int32_t advance;
+        bool rtl;
     };
-    typedef std::vector<GlyphCursor> GlyphCursorVec;
+    typedef Vector<Caret> CaretVec;
 
-    const GlyphCursorVec Shape() const;
+    // buffers for shaping one stretch of the string, tasks shaping other stretches have their own.
+    struct ShapeScratch
+    {
+        explicit ShapeScratch(Allocator& allocator);
+        ~ShapeScratch();
+        Vector<BidiRun> runVec;
+        Vector<FontRun> fontRunVec;
 #ifdef GB_USE_HARFBUZZ
-    const GlyphCursorVec HarfBuzzShape() const;
+        hb_buffer_t* hbBuffer;  // created on first use.
+        size_t paragraphStart, paragraphEnd;  // the paragraph being shaped, context for harfbuzz.
 #endif
-    const GlyphCursorVec FreeTypeShape() const;
-    void UpdateCache(const GlyphCursorVec& glyphCursorVec);
-    void WordWrapAndGenerateQuads(const GlyphCursorVec& glyphCursorVec);
+        GB_NO_COPY(ShapeScratch)
+    };
+
+    const Font& GetGlyphFont(uint32_t font) const { return font ? *m_fontFamily->GetFont(font) : *m_font; }
+    Allocator& GetAllocator() const;  // the context's.
 
-    std::shared_ptr<Font> m_font;
-    std::string m_string; // utf8 encoding.
-    std::string m_script; // 4 char code from iso 15952, http://unicode.org/iso15924/
+    // workspace, or the one to use when it is null, see SetString().
+    typedef std::unique_ptr<TextWorkspace, AllocatorDelete<TextWorkspace>> TextWorkspacePtr;
+    TextWorkspace& GetWorkspace(TextWorkspace* workspace, TextWorkspacePtr& temporaryOut) const;
+
+    // releases the glyphs in workspace.m_oldHandleVec once the new layout holds its own.
+    void Layout(TextWorkspace& workspace);
+
+    // shapes into workspace.m_glyphCursorVec, each shaper appends the glyphs for code points [start, end) in logical order.
+    void Shape(size_t size, TextWorkspace& workspace) const;
+    void ShapeParagraphs(const Vector<uint32_t>& codePointVec, const Vector<uint32_t>& clusterVec,
+                         size_t start, size_t end, ShapeScratch& scratch, GlyphCursorVec& glyphCursorVec) const;
+    void ShapeRun(const Vector<uint32_t>& codePointVec, const Vector<uint32_t>& clusterVec,
+                  size_t start, size_t end, uint32_t level, ShapeScratch& scratch, GlyphCursorVec& glyphCursorVec) const;
+#ifdef GB_USE_HARFBUZZ
+    bool SimpleShape(const Vector<uint32_t>& codePointVec, const Vector<uint32_t>& clusterVec,
+                     size_t start, size_t end, uint32_t font, GlyphCursorVec& glyphCursorVec) const;
+    void HarfBuzzShape(const Vector<uint32_t>& codePointVec, const Vector<uint32_t>& clusterVec,
+                       size_t start, size_t end, uint32_t font, bool rtl, ShapeScratch& scratch,
+                       GlyphCursorVec& glyphCursorVec) const;
+#endif
+    void FreeTypeShape(const Vector<uint32_t>& codePointVec, const Vector<uint32_t>& clusterVec,
+                       size_t start, size_t end, uint32_t font, GlyphCursorVec& glyphCursorVec) const;
+
+    // word-wrap into workspace.m_glyphInfoVec.
+    void WordWrap(const GlyphCursorVec& glyphCursorVec, size_t maxLines, TextWorkspace& workspace, bool& truncatedOut) const;
+    void TruncatedWordWrap(TextWorkspace& workspace) const;
+
+    // fills workspace.m_glyphVec.
+    void UpdateCache(const GlyphInfoVec& glyphInfoVec, TextWorkspace& workspace);
+    void GenerateQuads(GlyphInfoVec& glyphInfoVec, const Vector<const Glyph*>& glyphVec);
+
+    std::shared_ptr<Font> m_font;  // primary font.
+    std::shared_ptr<FontFamily> m_fontFamily;  // null for a single font.
+    String m_string; // utf8 encoding.
+    String m_script; // 4 char code from iso 15952, http://unicode.org/iso15924/
     enum Direction { Direction_LTR = 0, Direction_RTL };
     Direction m_dir;
     void* m_userData;
@@ -70,8 +254,41 @@ protected:
     TextHorizontalAlign m_horizontalAlign;
     TextVerticalAlign m_verticalAlign;
     uint32_t m_optionFlags;
-    QuadVec m_quadVec;
-    std::vector<std::shared_ptr<Glyph>> m_glyphVec;
+    std::shared_ptr<QuadSnapshot> m_snapshot;  // owns the quads, glyphs & user data.
+    QuadVec m_clipQuadVec;
+    LineVec m_lineVec;
+    CaretVec m_caretVec;
+    Vector<uint32_t> m_visualVec;  // per line, indices into the quads from left to right.
+};
+
+// Scratch buffers for laying out Texts, kept from one layout to the next, so texts of similar length are
+// laid out without allocating.  they keep the capacity of the longest text laid out with them.
+// A workspace is used by one thread at a time.  a context that is not thread-safe has one of its own, used
+// by every Text that is not given one, with a thread-safe context give each thread its own.
+class TextWorkspace
+{
+    friend class Text;
+public:
+    explicit TextWorkspace(Context& context);
+
+protected:
+    Vector<uint32_t> m_codePointVec;
+    Vector<uint32_t> m_clusterVec;
+    Vector<size_t> m_chunkVec;
+    Text::GlyphCursorVec m_glyphCursorVec;
+    Text::ShapeScratch m_shapeScratch;
+    Vector<int32_t> m_penVec;
+    Vector<uint32_t> m_wrapCodePointVec;
+    Vector<uint8_t> m_breakVec;
+    Vector<uint8_t> m_lineLevelVec;
+    Vector<uint32_t> m_lineVisualVec;
+    Text::GlyphInfoVec m_glyphInfoVec;
+    Vector<GlyphKey> m_keyVec;
+    GlyphBatchScratch m_glyphBatchScratch;
+    Vector<const Glyph*> m_glyphVec;
+    Vector<GlyphHandle> m_oldHandleVec;  // the glyphs of the previous layout, released after the new one.
+
+    GB_NO_COPY(TextWorkspace)
 };
 
 } // namespace gb
@@ -24,6 +24,9 @@
 
 #include "texture.h"
 #include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
 
 namespace gb {
 
@@ -61,10 +64,53 @@ void GLErrorCheck(const char *message)
 }
 #endif
 
-Texture::Texture(TextureFormat format, uint32_t textureSize, uint8_t* image) :
-    m_format(format)
+// ids handed out to textures that are not backed by OpenGL, unique across contexts on any thread.
+static std::atomic<uint32_t> s_nextSystemMemoryTexObj(0x80000000);
+
+Texture::Texture(TextureFormat format, uint32_t textureSize, const uint8_t* image, bool useGL, bool deferSubload,
+                 Allocator* allocator, bool deferStorage) :
+    m_texObj(0),
+    m_format(format),
+    m_textureSize(textureSize),
+    m_useGL(useGL),
+    m_deferSubload(useGL && deferSubload),
+    m_storagePending(m_deferSubload && deferStorage),
+    m_allocator(allocator ? *allocator : GetDefaultAllocator()),
+    m_mipDirty(false),
+    m_dirtyTop(0),
+    m_dirtyBottom(0)
 {
+    if (!useGL || (m_deferSubload && !m_storagePending))
+        AllocateImage(image);
+
+    if (!useGL)
+    {
+        m_texObj = s_nextSystemMemoryTexObj++;
+        return;
+    }
+
     glGenTextures(1, &m_texObj);
+    if (!m_storagePending)
+        CreateStorage(image);
+
+#ifndef NDEBUG
+    GLErrorCheck("Texture::Texture");
+#endif
+}
+
+void Texture::AllocateImage(const uint8_t* image)
+{
+    const uint32_t pixelSize = m_format == TextureFormat_Alpha ? 1 : 4;
+    const uint32_t imageSize = m_textureSize * m_textureSize * pixelSize;
+    m_image = AllocateBytes(m_allocator, imageSize);
+    if (image)
+        memcpy(m_image.get(), image, imageSize);
+    else
+        memset(m_image.get(), 0, imageSize);
+}
+
+void Texture::CreateStorage(const uint8_t* image)
+{
     glBindTexture(GL_TEXTURE_2D, m_texObj);
 
     GLfloat largest_supported_anisotropy;
@@ -77,22 +123,21 @@ Texture::Texture(TextureFormat format, uint32_t textureSize, uint8_t* image) :
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
     glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-    if (format == TextureFormat_Alpha)
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA, textureSize, textureSize, 0, GL_ALPHA, GL_UNSIGNED_BYTE, image);
+    if (m_format == TextureFormat_Alpha)
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA, m_textureSize, m_textureSize, 0, GL_ALPHA, GL_UNSIGNED_BYTE, image);
     else
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, textureSize, textureSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, m_textureSize, m_textureSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
 
     glGenerateMipmap(GL_TEXTURE_2D);
 
     m_mipDirty = false;
-
-#ifndef NDEBUG
-    GLErrorCheck("Texture::Texture");
-#endif
 }
 
 Texture::~Texture()
 {
+    if (!m_useGL)
+        return;
+
     glDeleteTextures(1, &m_texObj);
 
 #ifndef NDEBUG
@@ -100,8 +145,37 @@ Texture::~Texture()
 #endif
 }
 
-void Texture::Subload(IntPoint origin, IntPoint size, uint8_t* image)
+void Texture::Subload(IntPoint origin, IntPoint size, const uint8_t* image)
 {
+    if (!m_useGL || m_deferSubload)
+    {
+        if (!m_image)
+            AllocateImage(nullptr);
+
+        // copy image into the system memory texture, row by row.
+        const uint32_t pixelSize = m_format == TextureFormat_Alpha ? 1 : 4;
+        for (int i = 0; i < size.y; i++)
+        {
+            memcpy(m_image.get() + ((origin.y + i) * m_textureSize + origin.x) * pixelSize,
+                   image + i * size.x * pixelSize, size.x * pixelSize);
+        }
+
+        if (m_deferSubload && size.y > 0)
+        {
+            if (m_dirtyTop == m_dirtyBottom)
+            {
+                m_dirtyTop = origin.y;
+                m_dirtyBottom = origin.y + size.y;
+            }
+            else
+            {
+                m_dirtyTop = std::min<uint32_t>(m_dirtyTop, origin.y);
+                m_dirtyBottom = std::max<uint32_t>(m_dirtyBottom, origin.y + size.y);
+            }
+        }
+        return;
+    }
+
     glBindTexture(GL_TEXTURE_2D, m_texObj);
     if (m_format == TextureFormat_Alpha)
         glTexSubImage2D(GL_TEXTURE_2D, 0, origin.x, origin.y, size.x, size.y, GL_ALPHA, GL_UNSIGNED_BYTE, image);
@@ -114,9 +188,42 @@ void Texture::Subload(IntPoint origin, IntPoint size, uint8_t* image)
 #endif
 }
 
+void Texture::Upload()
+{
+    if (!m_deferSubload || m_dirtyTop == m_dirtyBottom)
+        return;
+
+    // the first sub-load of a texture with deferred storage, the whole image goes up at once.
+    if (m_storagePending)
+    {
+        CreateStorage(m_image.get());
+        m_storagePending = false;
+        m_dirtyTop = m_dirtyBottom = 0;
+#ifndef NDEBUG
+        GLErrorCheck("Texture::Upload");
+#endif
+        return;
+    }
+
+    // whole rows, so the source rows are contiguous.
+    const uint32_t pixelSize = m_format == TextureFormat_Alpha ? 1 : 4;
+    const uint8_t* rows = m_image.get() + m_dirtyTop * m_textureSize * pixelSize;
+    const GLenum format = m_format == TextureFormat_Alpha ? GL_ALPHA : GL_RGBA;
+    glBindTexture(GL_TEXTURE_2D, m_texObj);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, m_dirtyTop, m_textureSize, m_dirtyBottom - m_dirtyTop,
+                    format, GL_UNSIGNED_BYTE, rows);
+    glGenerateMipmap(GL_TEXTURE_2D);
+    m_dirtyTop = m_dirtyBottom = 0;
+
+#ifndef NDEBUG
+    GLErrorCheck("Texture::Upload");
+#endif
+}
+
 void Texture::GenerateMipmap() const
 {
-    if (m_mipDirty)
+    if (m_useGL && m_mipDirty)
     {
         glBindTexture(GL_TEXTURE_2D, m_texObj);
         glGenerateMipmap(GL_TEXTURE_2D);
@@ -2,22 +2,49 @@
 #define GB_TEXTURE
 
 #include <stdint.h>
+#include <memory>
 #include "glyphblaster.h"
+#include "allocator.h"
 
 namespace gb {
 
 class Texture
 {
 public:
-    Texture(TextureFormat format, uint32_t texture_size, uint8_t* image);
+    // if useGL is false, the texture only lives in system memory and no OpenGL calls are made,
+    // GetTexObj() then returns a unique id rather than a GL texture name.
+    // if deferSubload is true, Subload() only updates a copy in system memory, so it can be called
+    // from any thread, and the changed rows reach OpenGL on the next Upload().
+    // the copy in system memory comes from allocator, or the default allocator if it is null.
+    // if deferStorage is true as well, only the texture name is created here, the copy in system memory is
+    // allocated by the first Subload() and the OpenGL storage by the Upload() after it, image is ignored.
+    Texture(TextureFormat format, uint32_t texture_size, const uint8_t* image, bool useGL = true,
+            bool deferSubload = false, Allocator* allocator = nullptr, bool deferStorage = false);
     ~Texture();
     uint32_t GetTexObj() const { return m_texObj; }
-    void Subload(IntPoint origin, IntPoint size, uint8_t* image);
+    void Subload(IntPoint origin, IntPoint size, const uint8_t* image);
     void GenerateMipmap() const;
+
+    // uploads the rows changed by deferred sub-loads and regenerates the mipmaps.
+    void Upload();
+
+    // only available for textures in system memory, returns nullptr otherwise.
+    const uint8_t* GetImage() const { return m_image.get(); }
 protected:
+    void CreateStorage(const uint8_t* image);
+    void AllocateImage(const uint8_t* image);
+
     uint32_t m_texObj;
     TextureFormat m_format;
+    uint32_t m_textureSize;
+    bool m_useGL;
+    bool m_deferSubload;
+    bool m_storagePending;  // the OpenGL storage is created by the next Upload().
+    Allocator& m_allocator;
+    ByteBuffer m_image;
     mutable bool m_mipDirty;
+    uint32_t m_dirtyTop;  // rows [m_dirtyTop, m_dirtyBottom) are waiting for Upload().
+    uint32_t m_dirtyBottom;
 };
 
 } // namespace gb
@@ -0,0 +1,103 @@
+#ifndef GB_THREADSLOT_H
+#define GB_THREADSLOT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <mutex>
+#include <functional>
+#include "glyphblaster.h"
+#include "allocator.h"
+
+namespace gb {
+
+// An entry per thread, indexed by the small thread slots that thread-safe contexts hand out, see Font::GetFTFace().
+// Page i holds kPageSize << i entries, so the fixed table covers any number of threads.  Pages are allocated
+// on first use from allocator, zeroed, and never move, so an entry can be used without holding a lock.
+template <typename T>
+class ThreadSlotTable
+{
+public:
+    enum { kPageSize = 16, kNumPages = 28 };
+
+    ThreadSlotTable(Allocator& allocator) : m_allocator(allocator)
+    {
+        for (int i = 0; i < kNumPages; i++)
+        {
+            m_pages[i].store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+    ~ThreadSlotTable()
+    {
+        uint32_t size = kPageSize;
+        for (int i = 0; i < kNumPages; size <<= 1, i++)
+        {
+            T* entries = m_pages[i].load(std::memory_order_relaxed);
+            if (!entries)
+                continue;
+            for (uint32_t j = 0; j < size; j++)
+            {
+                entries[j].~T();
+            }
+            m_allocator.Free(entries);
+        }
+    }
+
+    T& Get(uint32_t slot)
+    {
+        // slots [first, first + size) are on page.
+        uint32_t page = 0, first = 0, size = kPageSize;
+        while (slot - first >= size)
+        {
+            first += size;
+            size <<= 1;
+            page++;
+        }
+
+        T* entries = m_pages[page].load(std::memory_order_acquire);
+        if (!entries)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            entries = m_pages[page].load(std::memory_order_relaxed);
+            if (!entries)
+            {
+                entries = (T*)m_allocator.Allocate(size * sizeof(T), alignof(T));
+                for (uint32_t i = 0; i < size; i++)
+                {
+                    new (entries + i) T();
+                }
+                m_pages[page].store(entries, std::memory_order_release);
+            }
+        }
+        return entries[slot - first];
+    }
+
+    // calls func on every entry of the pages allocated so far, in slot order.
+    // must not run concurrently with Get().
+    void ForEach(const std::function<void (uint32_t, T&)>& func)
+    {
+        uint32_t first = 0, size = kPageSize;
+        for (int i = 0; i < kNumPages; first += size, size <<= 1, i++)
+        {
+            T* entries = m_pages[i].load(std::memory_order_relaxed);
+            if (!entries)
+                continue;
+            for (uint32_t j = 0; j < size; j++)
+            {
+                func(first + j, entries[j]);
+            }
+        }
+    }
+
+protected:
+    Allocator& m_allocator;
+    std::atomic<T*> m_pages[kNumPages];
+    std::mutex m_mutex;
+
+    GB_NO_COPY(ThreadSlotTable)
+};
+
+} // namespace gb
+
+#endif // GB_THREADSLOT_H
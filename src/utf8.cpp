@@ -0,0 +1,172 @@
+#include "utf8.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#define GB_UTF8_SSE2
+#endif
+
+namespace gb {
+
+#ifdef GB_UTF8_SSE2
+// mask must be non-zero
+static inline int CountTrailingZeros(int mask)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, (unsigned long)mask);
+    return (int)index;
+#else
+    return __builtin_ctz((unsigned int)mask);
+#endif
+}
+#endif
+
+static const size_t kBlockSize = 4096;
+static const size_t kBlockMargin = 16;
+
+// decodes a single multi-byte sequence, see table 3-7 of the unicode standard.
+// sets lengthOut to the number of bytes consumed, which is always at least 1.
+static uint32_t DecodeSequence(const uint8_t* p, const uint8_t* end, int* lengthOut)
+{
+    const uint8_t c = *p;
+    uint8_t lo = 0x80, hi = 0xbf;
+    uint32_t codePoint;
+    int numContinuation;
+    if (c < 0x80)
+    {
+        *lengthOut = 1;
+        return c;
+    }
+    else if (c >= 0xc2 && c <= 0xdf) // 110xxxxx 10xxxxxx
+    {
+        numContinuation = 1;
+        codePoint = c & 0x1f;
+    }
+    else if (c >= 0xe0 && c <= 0xef) // 1110xxxx 10xxxxxx 10xxxxxx
+    {
+        numContinuation = 2;
+        codePoint = c & 0x0f;
+        if (c == 0xe0)
+            lo = 0xa0;  // overlong
+        else if (c == 0xed)
+            hi = 0x9f;  // surrogates
+    }
+    else if (c >= 0xf0 && c <= 0xf4) // 11110xxx 10xxxxxx 10xxxxxx 10xxxxxx
+    {
+        numContinuation = 3;
+        codePoint = c & 0x07;
+        if (c == 0xf0)
+            lo = 0x90;  // overlong
+        else if (c == 0xf4)
+            hi = 0x8f;  // above U+10FFFF
+    }
+    else
+    {
+        // stray continuation byte, or a lead byte that can never be valid.
+        *lengthOut = 1;
+        return kReplacementCodePoint;
+    }
+
+    for (int i = 1; i <= numContinuation; i++)
+    {
+        if (p + i >= end || p[i] < lo || p[i] > hi)
+        {
+            // the bytes so far are a maximal subpart, skip them with a single replacement.
+            *lengthOut = i;
+            return kReplacementCodePoint;
+        }
+        codePoint = (codePoint << 6) | (p[i] & 0x3f);
+        lo = 0x80;
+        hi = 0xbf;
+    }
+    *lengthOut = numContinuation + 1;
+    return codePoint;
+}
+
+void DecodeUTF8(const char* str, size_t size, Vector<uint32_t>& codePointVecOut,
+                Vector<uint32_t>& clusterVecOut)
+{
+    // never more code points than bytes, the output is grown a block at a time
+    // so the zero fill done by resize() stays in cache.
+    const size_t start = codePointVecOut.size();
+    codePointVecOut.reserve(start + size + kBlockMargin);
+    clusterVecOut.reserve(start + size + kBlockMargin);
+
+    const uint8_t* begin = (const uint8_t*)str;
+    const uint8_t* end = begin + size;
+    const uint8_t* p = begin;
+    size_t count = 0;
+#ifdef GB_UTF8_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i four = _mm_set1_epi32(4);
+#endif
+    while (p < end)
+    {
+        // a block yields at most one code point per byte consumed, which can run past blockEnd
+        // by at most one 16 byte ascii run or one sequence.
+        const uint8_t* blockEnd = p + ((size_t)(end - p) < kBlockSize ? (size_t)(end - p) : kBlockSize);
+        codePointVecOut.resize(start + count + (blockEnd - p) + kBlockMargin);
+        clusterVecOut.resize(start + count + (blockEnd - p) + kBlockMargin);
+        uint32_t* codePoints = codePointVecOut.data() + start;
+        uint32_t* clusters = clusterVecOut.data() + start;
+
+        while (p < blockEnd)
+        {
+#ifdef GB_UTF8_SSE2
+            if (end - p >= 16)
+            {
+                const __m128i bytes = _mm_loadu_si128((const __m128i*)p);
+                const int mask = _mm_movemask_epi8(bytes);
+                if (mask == 0)
+                {
+                    // pure ascii, widen all 16 bytes at once.
+                    const __m128i lo = _mm_unpacklo_epi8(bytes, zero);
+                    const __m128i hi = _mm_unpackhi_epi8(bytes, zero);
+                    _mm_storeu_si128((__m128i*)(codePoints + count), _mm_unpacklo_epi16(lo, zero));
+                    _mm_storeu_si128((__m128i*)(codePoints + count + 4), _mm_unpackhi_epi16(lo, zero));
+                    _mm_storeu_si128((__m128i*)(codePoints + count + 8), _mm_unpacklo_epi16(hi, zero));
+                    _mm_storeu_si128((__m128i*)(codePoints + count + 12), _mm_unpackhi_epi16(hi, zero));
+
+                    const int offset = (int)(p - begin);
+                    __m128i cluster = _mm_setr_epi32(offset, offset + 1, offset + 2, offset + 3);
+                    for (int i = 0; i < 16; i += 4)
+                    {
+                        _mm_storeu_si128((__m128i*)(clusters + count + i), cluster);
+                        cluster = _mm_add_epi32(cluster, four);
+                    }
+                    count += 16;
+                    p += 16;
+                    continue;
+                }
+
+                // copy the ascii prefix of the block, then fall through to decode the first non-ascii sequence.
+                const int numAscii = CountTrailingZeros(mask);
+                for (int i = 0; i < numAscii; i++)
+                {
+                    clusters[count] = (uint32_t)(p - begin);
+                    codePoints[count] = *p;
+                    count++;
+                    p++;
+                }
+            }
+#endif
+            // stay on the scalar path until the next ascii byte, non-latin text rarely mixes in ascii.
+            do
+            {
+                int length;
+                clusters[count] = (uint32_t)(p - begin);
+                codePoints[count] = DecodeSequence(p, end, &length);
+                count++;
+                p += length;
+            } while (p < blockEnd && *p >= 0x80);
+        }
+    }
+
+    codePointVecOut.resize(start + count);
+    clusterVecOut.resize(start + count);
+}
+
+} // namespace gb
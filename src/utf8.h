@@ -0,0 +1,24 @@
+#ifndef GB_UTF8_H
+#define GB_UTF8_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "allocator.h"
+
+namespace gb {
+
+// The code point used in place of malformed utf8 sequences.
+static const uint32_t kReplacementCodePoint = 0xfffd;
+
+// Validates and transcodes utf8 into utf32.
+// Appends one code point to codePointVecOut for every character in str, and the byte offset
+// of that character within str to clusterVecOut.  Malformed sequences, such as overlong encodings,
+// surrogates, truncated sequences or stray continuation bytes, are replaced with kReplacementCodePoint,
+// one for each maximal invalid subpart, as recommended by the unicode standard.
+// Blocks of pure ascii are converted 16 bytes at a time when SSE2 is available.
+void DecodeUTF8(const char* str, size_t size, Vector<uint32_t>& codePointVecOut,
+                Vector<uint32_t>& clusterVecOut);
+
+} // namespace gb
+
+#endif // GB_UTF8_H
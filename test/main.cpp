@@ -202,7 +202,7 @@ void DebugDrawGlyphCache(const Config& config)
     }
 }
 
-void TextRenderFunc(const std::vector<gb::Quad>& quadVec)
+void TextRenderFunc(const gb::QuadVec& quadVec)
 {
     // note this flips y-axis so y is down.
     Matrixf proj = Matrixf::Ortho(0, s_config->width, s_config->height, 0, -10, 10);
@@ -247,12 +247,14 @@ void TextRenderFunc(const std::vector<gb::Quad>& quadVec)
 
         }
 
+        // color glyphs are not tinted.
+        const uint32_t color = (quad.flags & gb::QuadFlags_Color) ? MakeColor(255, 255, 255, 255) : *((uint32_t*)quad.userData);
         DrawTexturedQuad(quad.glTexObj,
                          Vector2f(quad.origin.x, quad.origin.y),
                          Vector2f(quad.size.x, quad.size.y),
                          Vector2f(quad.uvOrigin.x, quad.uvOrigin.y),
                          Vector2f(quad.uvSize.x, quad.uvSize.y),
-                         *((uint32_t*)quad.userData));
+                         color);
     }
 
     count++;
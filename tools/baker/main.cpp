@@ -0,0 +1,165 @@
+// Offline atlas baker.
+//
+// Rasterizes a character set for a list of fonts and point sizes, packs the glyphs
+// and writes a bundle that can be registered at startup with gb::Context::LoadBundle().
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <memory>
+
+#include "../../src/context.h"
+#include "../../src/font.h"
+#include "../../src/text.h"
+
+static void Usage()
+{
+    fprintf(stderr,
+            "usage: baker [options] font.ttf:pointSize ...\n"
+            "    -o FILE    bundle to write (default atlas.gbab)\n"
+            "    -s N       texture size (default 1024)\n"
+            "    -n N       number of sheets (default 1)\n"
+            "    -f FORMAT  alpha or rgba (default alpha)\n"
+            "    -c FILE    utf8 file holding the characters to bake\n"
+            "    -t TEXT    characters to bake\n"
+            "    -p N       padding border in pixels (default 0)\n"
+            "    -r OPTION  normal, light, mono, lcd-rgb, lcd-bgr, lcd-rgb-v or lcd-bgr-v (default normal)\n"
+            "    -h OPTION  default, auto, noauto or none (default default)\n");
+    exit(1);
+}
+
+static bool LoadFile(const char* filename, std::string& result)
+{
+    FILE* f = fopen(filename, "rb");
+    if (!f)
+        return false;
+    char buffer[4096];
+    size_t size;
+    while ((size = fread(buffer, 1, sizeof(buffer), f)) > 0)
+    {
+        result.append(buffer, size);
+    }
+    fclose(f);
+    return true;
+}
+
+static bool ParseRenderOption(const char* str, gb::FontRenderOption& option)
+{
+    const char* names[] = {"normal", "light", "mono", "lcd-rgb", "lcd-bgr", "lcd-rgb-v", "lcd-bgr-v"};
+    for (int i = 0; i < (int)(sizeof(names) / sizeof(names[0])); i++)
+    {
+        if (strcmp(str, names[i]) == 0)
+        {
+            option = (gb::FontRenderOption)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool ParseHintOption(const char* str, gb::FontHintOption& option)
+{
+    const char* names[] = {"default", "auto", "noauto", "none"};
+    for (int i = 0; i < (int)(sizeof(names) / sizeof(names[0])); i++)
+    {
+        if (strcmp(str, names[i]) == 0)
+        {
+            option = (gb::FontHintOption)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+int main(int argc, char* argv[])
+{
+    std::string output = "atlas.gbab";
+    uint32_t textureSize = 1024;
+    uint32_t numSheets = 1;
+    gb::TextureFormat textureFormat = gb::TextureFormat_Alpha;
+    std::string charset;
+    uint32_t paddingBorder = 0;
+    gb::FontRenderOption renderOption = gb::FontRenderOption_Normal;
+    gb::FontHintOption hintOption = gb::FontHintOption_Default;
+    std::vector<std::string> fontArgs;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char* arg = argv[i];
+        if (arg[0] == '-' && arg[1] && !arg[2])
+        {
+            if (i + 1 >= argc)
+                Usage();
+            const char* value = argv[++i];
+            switch (arg[1])
+            {
+            case 'o': output = value; break;
+            case 's': textureSize = atoi(value); break;
+            case 'n': numSheets = atoi(value); break;
+            case 'f':
+                if (strcmp(value, "alpha") == 0)
+                    textureFormat = gb::TextureFormat_Alpha;
+                else if (strcmp(value, "rgba") == 0)
+                    textureFormat = gb::TextureFormat_RGBA;
+                else
+                    Usage();
+                break;
+            case 'c':
+                if (!LoadFile(value, charset))
+                {
+                    fprintf(stderr, "Error reading \"%s\"\n", value);
+                    return 1;
+                }
+                break;
+            case 't': charset += value; break;
+            case 'p': paddingBorder = atoi(value); break;
+            case 'r': if (!ParseRenderOption(value, renderOption)) Usage(); break;
+            case 'h': if (!ParseHintOption(value, hintOption)) Usage(); break;
+            default: Usage();
+            }
+        }
+        else
+        {
+            fontArgs.push_back(arg);
+        }
+    }
+
+    if (fontArgs.empty() || charset.empty() || textureSize == 0 || numSheets == 0)
+        Usage();
+
+    gb::Context::Init(textureSize, numSheets, textureFormat, gb::ContextOptionFlags_NoGL);
+    bool ok = true;
+    {
+        std::vector<std::shared_ptr<gb::Font>> fontVec;
+        std::vector<std::unique_ptr<gb::Text>> textVec;
+        const gb::IntPoint origin = {0, 0};
+        const gb::IntPoint size = {1 << 20, 1 << 20};
+        for (auto &fontArg : fontArgs)
+        {
+            size_t colon = fontArg.rfind(':');
+            int pointSize = colon != std::string::npos ? atoi(fontArg.c_str() + colon + 1) : 0;
+            if (pointSize <= 0)
+            {
+                fprintf(stderr, "Error: expected font.ttf:pointSize, got \"%s\"\n", fontArg.c_str());
+                Usage();
+            }
+            auto font = std::make_shared<gb::Font>(fontArg.substr(0, colon), pointSize, paddingBorder,
+                                                   renderOption, hintOption);
+            fontVec.push_back(font);
+
+            // every glyph in the cmap, then shaped for ligatures & contextual forms.
+            font->Preload(charset, true);
+            textVec.emplace_back(new gb::Text(charset, font, nullptr, origin, size,
+                                              gb::TextHorizontalAlign_Left, gb::TextVerticalAlign_Top));
+        }
+
+        // repack in decreasing height order for the tightest fit.
+        gb::Context::Get().Compact();
+        ok = gb::Context::Get().SaveBundle(output);
+    }
+    gb::Context::Shutdown();
+
+    return ok ? 0 : 1;
+}
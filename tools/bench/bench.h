@@ -0,0 +1,75 @@
+#ifndef GB_BENCH_H
+#define GB_BENCH_H
+
+// shared by the benchmark modes, see main.cpp.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <chrono>
+
+#include "../../src/context.h"
+#include "../../src/font.h"
+#include "../../src/text.h"
+
+struct Workload
+{
+    std::vector<std::string> fontFileVec;  // modes that need a single font use the first one.
+    std::string text;
+    std::vector<std::string> lineVec;  // the non-empty lines of text.
+    std::vector<uint32_t> pointSizeVec;
+    uint32_t numLayouts;
+};
+
+// glyph positions & sizes, the texture coordinates depend on the order the glyphs were packed in.
+typedef std::vector<int32_t> Layout;
+
+// counts the allocations of a context, and the bytes it holds.  not thread-safe.
+class CountingAllocator : public gb::Allocator
+{
+public:
+    CountingAllocator() : m_count(0), m_liveBytes(0) {}
+
+    virtual void* Allocate(size_t size, size_t alignment);
+    virtual void Free(void* ptr);
+
+    uint64_t GetCount() const { return m_count; }
+    uint64_t GetLiveBytes() const { return m_liveBytes; }
+
+protected:
+    uint64_t m_count;
+    uint64_t m_liveBytes;
+};
+
+static const gb::IntPoint kOrigin = {0, 0};
+static const gb::IntPoint kSize = {800, 1 << 20};
+
+bool LoadFile(const char* filename, std::string& result);
+
+// the first font file of the workload at pointSizeVec[size].
+std::shared_ptr<gb::Font> CreateFont(gb::Context& context, const Workload& workload, uint32_t size);
+
+void GetLayout(const gb::Text& text, Layout& layoutOut);
+void LayOut(const std::string& string, std::shared_ptr<gb::Font> font, Layout& layoutOut);
+
+inline double GetMilliseconds(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// the modes besides the throughput ones, each prints its results and returns false if a check failed.
+bool BenchFaces(const Workload& workload);
+bool BenchLoad(const Workload& workload);
+bool BenchDiskCache(const Workload& workload);
+bool BenchPreload(const Workload& workload);
+bool BenchCmap(const Workload& workload);
+bool BenchLabels(const Workload& workload);
+bool BenchUTF8(const Workload& workload);
+bool BenchWrap(const Workload& workload);
+bool BenchDocument(const Workload& workload);
+bool BenchHitTest(const Workload& workload);
+bool BenchChurn(const Workload& workload);
+
+#endif
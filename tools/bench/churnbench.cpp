@@ -0,0 +1,189 @@
+// -m churn, builds 10k short labels with the first font at the first size, then a few rounds of creating and
+// destroying 40 fonts of other sizes, each laying out one label, and compacting the context.  Everything the
+// context holds comes from a counting allocator.
+//
+// Reports the time to build the labels, the best of a few builds with the glyphs cached, the bytes each
+// label holds, and the bytes the context holds around each Compact.  Compact must give back what the
+// short-lived fonts left behind, and the labels must lay out as before once their glyphs are rasterized again.
+//
+// Then a font's own tables: its glyph metrics, cmap pages and, in a thread-safe context, its sizes on the
+// per-thread faces.  They come from the counting allocator as well, a font must hold at least its metrics
+// table, and give back everything it held once destroyed.
+
+#include <stdio.h>
+#include <algorithm>
+#include <thread>
+
+#include "bench.h"
+
+static const uint32_t kNumLabels = 10000;
+static const uint32_t kNumBuilds = 5;
+static const uint32_t kNumFonts = 40;
+static const uint32_t kNumRounds = 3;
+static const gb::IntPoint kLabelSize = {400, 40};
+static const uint32_t kNumThreads = 4;
+
+typedef std::vector<std::unique_ptr<gb::Text>> LabelVec;
+
+static void BuildLabels(const std::vector<std::string>& stringVec, std::shared_ptr<gb::Font> font, LabelVec& labelVecOut)
+{
+    labelVecOut.clear();
+    labelVecOut.reserve(stringVec.size());
+    for (auto &string : stringVec)
+    {
+        labelVecOut.emplace_back(new gb::Text(string, font, nullptr, kOrigin, kLabelSize, gb::TextHorizontalAlign_Left,
+                                              gb::TextVerticalAlign_Top));
+    }
+}
+
+// the number of glyphs in a font file, from a library of its own so the context's allocator does not see it.
+static uint32_t GetNumGlyphs(const std::string& filename)
+{
+    FT_Library ftLibrary;
+    FT_Face ftFace;
+    uint32_t numGlyphs = 0;
+    if (FT_Init_FreeType(&ftLibrary) == 0)
+    {
+        if (FT_New_Face(ftLibrary, filename.c_str(), 0, &ftFace) == 0)
+        {
+            numGlyphs = (uint32_t)ftFace->num_glyphs;
+            FT_Done_Face(ftFace);
+        }
+        FT_Done_FreeType(ftLibrary);
+    }
+    return numGlyphs;
+}
+
+// creates a font, looks up a few code points off the latin-1 page on kNumThreads threads in turn, then destroys it.
+// returns false if the font held less than its metrics table, or left anything behind.
+static bool CheckFontTables(const Workload& workload, uint32_t optionFlags, uint64_t& fontBytesOut,
+                            uint64_t& leftBytesOut)
+{
+    CountingAllocator allocator;
+    gb::Context context(256, 1, gb::TextureFormat_Alpha, (gb::ContextOptionFlags)optionFlags, &allocator);
+
+    // the context keeps an entry for each font file it opened, the second font of the file is the one measured.
+    uint64_t beforeBytes = 0;
+    for (uint32_t pass = 0; pass < 2; pass++)
+    {
+        beforeBytes = allocator.GetLiveBytes();
+        auto font = CreateFont(context, workload, 0);
+        for (uint32_t i = 0; i < kNumThreads; i++)
+        {
+            // one thread at a time, the counting allocator is not thread-safe.
+            std::thread thread([&font]()
+            {
+                for (uint32_t codePoint : {0x41u, 0x416u, 0x3b1u, 0x2022u, 0x3042u})
+                    font->GetAdvance(font->GetGlyphIndex(codePoint));
+            });
+            thread.join();
+        }
+        fontBytesOut = allocator.GetLiveBytes() - beforeBytes;
+    }
+    leftBytesOut = allocator.GetLiveBytes() - beforeBytes;
+
+    const uint64_t metricsBytes = (uint64_t)GetNumGlyphs(workload.fontFileVec[0]) * sizeof(gb::GlyphMetrics);
+    if (fontBytesOut < metricsBytes)
+    {
+        fprintf(stderr, "Error a font held %u bytes, less than its %u byte metrics table\n", (uint32_t)fontBytesOut,
+                (uint32_t)metricsBytes);
+        return false;
+    }
+    if (leftBytesOut != 0)
+    {
+        fprintf(stderr, "Error a destroyed font left %u bytes behind\n", (uint32_t)leftBytesOut);
+        return false;
+    }
+    return true;
+}
+
+bool BenchChurn(const Workload& workload)
+{
+    CountingAllocator allocator;
+    gb::Context context(2048, 1, gb::TextureFormat_Alpha, gb::ContextOptionFlags_NoGL, &allocator);
+    auto font = CreateFont(context, workload, 0);
+
+    std::vector<std::string> stringVec;
+    for (uint32_t i = 0; i < kNumLabels; i++)
+        stringVec.push_back("Player " + std::to_string(i * 7919 % 100000) + " score " + std::to_string(i * 31 % 9973) + " pts");
+
+    LabelVec labelVec;
+    BuildLabels(stringVec, font, labelVec);
+    std::vector<Layout> referenceVec(labelVec.size());
+    for (size_t i = 0; i < labelVec.size(); i++)
+        GetLayout(*labelVec[i], referenceVec[i]);
+    labelVec.clear();
+
+    double bestMs = 0.0;
+    uint64_t labelBytes = 0, numAllocations = 0;
+    for (uint32_t build = 0; build < kNumBuilds; build++)
+    {
+        const uint64_t liveBytes = allocator.GetLiveBytes();
+        const uint64_t count = allocator.GetCount();
+        auto start = std::chrono::steady_clock::now();
+        BuildLabels(stringVec, font, labelVec);
+        const double ms = GetMilliseconds(start);
+        bestMs = build == 0 ? ms : std::min(bestMs, ms);
+        labelBytes = allocator.GetLiveBytes() - liveBytes;
+        numAllocations = allocator.GetCount() - count;
+        labelVec.clear();
+    }
+
+    printf("%u labels at %u points, best of %u builds\n", kNumLabels, workload.pointSizeVec[0], kNumBuilds);
+    printf("build ms  bytes/label  allocations/label\n");
+    printf("%8.1f  %11.0f  %17.1f\n", bestMs, (double)labelBytes / kNumLabels, (double)numAllocations / kNumLabels);
+
+    // the glyph slots grow to the most glyphs alive between compactions and stay, so the first round sets
+    // how much the context holds after Compact, and later rounds must not hold more.
+    // Cache::Compact() prints a line of its own, so the table is printed after the rounds.
+    bool ok = true;
+    const uint64_t beforeBytes = allocator.GetLiveBytes();
+    uint64_t churnBytes[kNumRounds], compactBytes[kNumRounds];
+    for (uint32_t round = 0; round < kNumRounds; round++)
+    {
+        for (uint32_t i = 0; i < kNumFonts; i++)
+        {
+            auto shortLived = std::make_shared<gb::Font>(context, workload.fontFileVec[0], 10 + i % 20, 0,
+                                                         gb::FontRenderOption_Normal, gb::FontHintOption_Default);
+            gb::Text text(stringVec[i], shortLived, nullptr, kOrigin, kLabelSize, gb::TextHorizontalAlign_Left,
+                          gb::TextVerticalAlign_Top);
+        }
+        churnBytes[round] = allocator.GetLiveBytes();
+        context.Compact();
+        compactBytes[round] = allocator.GetLiveBytes();
+        if (compactBytes[round] >= churnBytes[round] || compactBytes[round] > compactBytes[0])
+        {
+            fprintf(stderr, "Error Compact kept what %u short-lived fonts left behind\n", kNumFonts);
+            ok = false;
+        }
+    }
+
+    printf("context KiB, %.1f before the fonts\n", beforeBytes / 1024.0);
+    printf("round  after fonts  after Compact\n");
+    for (uint32_t round = 0; round < kNumRounds; round++)
+        printf("%5u  %11.1f  %13.1f\n", round, churnBytes[round] / 1024.0, compactBytes[round] / 1024.0);
+
+    BuildLabels(stringVec, font, labelVec);
+    Layout layout;
+    for (size_t i = 0; i < labelVec.size(); i++)
+    {
+        GetLayout(*labelVec[i], layout);
+        if (layout != referenceVec[i])
+        {
+            fprintf(stderr, "Error label %u lays out differently after Compact\n", (uint32_t)i);
+            ok = false;
+            break;
+        }
+    }
+
+    printf("font tables       KiB held  KiB left\n");
+    for (uint32_t optionFlags : {(uint32_t)gb::ContextOptionFlags_NoGL,
+                                 (uint32_t)(gb::ContextOptionFlags_NoGL | gb::ContextOptionFlags_ThreadSafe)})
+    {
+        uint64_t fontBytes = 0, leftBytes = 0;
+        ok = CheckFontTables(workload, optionFlags, fontBytes, leftBytes) && ok;
+        printf("%-16s  %8.1f  %8.1f\n", (optionFlags & gb::ContextOptionFlags_ThreadSafe) ? "thread-safe" : "single thread",
+               fontBytes / 1024.0, leftBytes / 1024.0);
+    }
+    return ok;
+}
@@ -0,0 +1,74 @@
+// -m cmap, maps every code point of the text to a glyph index, with the first font.
+//
+// Font::GetGlyphIndex, which caches lookups per font, against FT_Get_Char_Index on a face the bench opens
+// itself.  Reports the time per code point of each, and checks that they agree on every code point.
+
+#include <stdio.h>
+#include <algorithm>
+
+#include "bench.h"
+#include "../../src/utf8.h"
+
+static const uint32_t kNumRounds = 200;
+
+bool BenchCmap(const Workload& workload)
+{
+    gb::Vector<uint32_t> codePointVec, clusterVec;
+    gb::DecodeUTF8(workload.text.data(), workload.text.size(), codePointVec, clusterVec);
+    if (codePointVec.empty())
+        return true;
+
+    FT_Library ftLibrary;
+    FT_Face ftFace;
+    if (FT_Init_FreeType(&ftLibrary))
+    {
+        fprintf(stderr, "Error FT_Init_FreeType failed\n");
+        return false;
+    }
+    if (FT_New_Face(ftLibrary, workload.fontFileVec[0].c_str(), 0, &ftFace))
+    {
+        fprintf(stderr, "Error loading font \"%s\"\n", workload.fontFileVec[0].c_str());
+        FT_Done_FreeType(ftLibrary);
+        return false;
+    }
+
+    gb::Context context(1024, 1, gb::TextureFormat_Alpha, gb::ContextOptionFlags_NoGL);
+    auto font = CreateFont(context, workload, 0);
+
+    // the sums keep the lookups from being optimized away, and are compared as well.
+    uint64_t fontSum = 0, ftSum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t round = 0; round < kNumRounds; round++)
+        for (auto codePoint : codePointVec)
+            fontSum += font->GetGlyphIndex(codePoint);
+    const double fontMs = GetMilliseconds(start);
+
+    start = std::chrono::steady_clock::now();
+    for (uint32_t round = 0; round < kNumRounds; round++)
+        for (auto codePoint : codePointVec)
+            ftSum += FT_Get_Char_Index(ftFace, codePoint);
+    const double ftMs = GetMilliseconds(start);
+
+    const double numLookups = (double)kNumRounds * codePointVec.size();
+    printf("%u code points, %u lookups each\n", (uint32_t)codePointVec.size(), kNumRounds);
+    printf("lookup             ns/code point\n");
+    printf("GetGlyphIndex      %13.2f\n", fontMs * 1e6 / numLookups);
+    printf("FT_Get_Char_Index  %13.2f\n", ftMs * 1e6 / numLookups);
+
+    bool ok = fontSum == ftSum;
+    for (auto codePoint : codePointVec)
+    {
+        const uint32_t glyphIndex = font->GetGlyphIndex(codePoint);
+        const uint32_t ftGlyphIndex = FT_Get_Char_Index(ftFace, codePoint);
+        if (glyphIndex != ftGlyphIndex)
+        {
+            fprintf(stderr, "Error U+%04X maps to %u, FreeType maps it to %u\n", codePoint, glyphIndex, ftGlyphIndex);
+            ok = false;
+            break;
+        }
+    }
+
+    FT_Done_Face(ftFace);
+    FT_Done_FreeType(ftLibrary);
+    return ok;
+}
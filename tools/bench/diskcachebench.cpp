@@ -0,0 +1,71 @@
+// -m diskcache, lays out the whole text with the first font, at the first size, in a new context each time:
+// without a disk cache, with a new cache file and with the file it left behind.
+//
+// Reports the time of each, the cache saves rasterizing but not loading the font or shaping.
+// Every layout must match the one made without a cache, including one made after part of the file
+// was overwritten with garbage, whose entries must be dropped rather than read.
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+#include "bench.h"
+
+static const char* kCacheFile = "bench.gbdc";
+
+// an empty filename means no disk cache.
+static double LayOutText(const Workload& workload, const char* cacheFile, Layout& layoutOut)
+{
+    gb::Context context(2048, 2, gb::TextureFormat_Alpha, gb::ContextOptionFlags_NoGL);
+    auto start = std::chrono::steady_clock::now();
+    if (cacheFile[0])
+        context.EnableDiskCache(cacheFile);
+    auto font = CreateFont(context, workload, 0);
+    LayOut(workload.text, font, layoutOut);
+    return GetMilliseconds(start);
+}
+
+// overwrites size bytes in the middle of the file.
+static bool DamageFile(const char* filename, size_t size)
+{
+    FILE* f = fopen(filename, "r+b");
+    if (!f)
+        return false;
+    fseek(f, 0, SEEK_END);
+    const long fileSize = ftell(f);
+    std::vector<uint8_t> garbage(size, 0xff);
+    fseek(f, fileSize / 2, SEEK_SET);
+    const bool ok = fwrite(garbage.data(), 1, std::min<size_t>(size, fileSize / 2), f) > 0;
+    fclose(f);
+    return ok;
+}
+
+bool BenchDiskCache(const Workload& workload)
+{
+    remove(kCacheFile);
+    printf("%u bytes of text at %u points\n", (uint32_t)workload.text.size(), workload.pointSizeVec[0]);
+    printf("cache    ms\n");
+
+    Layout reference, layout;
+    printf("none     %7.2f\n", LayOutText(workload, "", reference));
+
+    bool ok = true;
+    struct Run { const char* name; bool damage; } runVec[] = {{"cold", false}, {"warm", false}, {"damaged", true}};
+    for (auto &run : runVec)
+    {
+        if (run.damage && !DamageFile(kCacheFile, 4096))
+        {
+            fprintf(stderr, "Error could not damage \"%s\"\n", kCacheFile);
+            ok = false;
+            continue;
+        }
+        printf("%-7s  %7.2f\n", run.name, LayOutText(workload, kCacheFile, layout));
+        if (layout != reference)
+        {
+            fprintf(stderr, "Error the layout with a %s cache differs from the one without\n", run.name);
+            ok = false;
+        }
+    }
+    remove(kCacheFile);
+    return ok;
+}
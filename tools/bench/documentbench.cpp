@@ -0,0 +1,129 @@
+// -m document, scrolls a Document over the text repeated to 50 MB, with the first font at the first size:
+// the first frame, a line at a time, back a line at a time, a page at a time and random jumps.
+//
+// Reports the time of the first frame, against laying out the first MB as a single Text, and the time per
+// frame of each kind of scroll.  Every quad drawn must lie in the viewport, and scrolling back to a position
+// must draw the same frame as scrolling to it did.
+
+#include <stdio.h>
+#include <algorithm>
+#include <map>
+#include <random>
+
+#include "bench.h"
+#include "../../src/document.h"
+
+static const size_t kDocumentSize = 50 << 20;
+static const size_t kTextSize = 1 << 20;
+static const gb::IntPoint kViewportOrigin = {10, 20};
+static const gb::IntPoint kViewportSize = {800, 600};
+
+static uint64_t HashQuads(const gb::QuadVec& quadVec)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (auto &quad : quadVec)
+    {
+        const int32_t valueVec[] = {quad.pen.x, quad.pen.y, quad.origin.x, quad.origin.y, quad.size.x, quad.size.y};
+        for (auto value : valueVec)
+            hash = (hash ^ (uint32_t)value) * 1099511628211ull;
+    }
+    return hash;
+}
+
+static bool IsInViewport(const gb::QuadVec& quadVec)
+{
+    for (auto &quad : quadVec)
+    {
+        if (quad.origin.x < kViewportOrigin.x || quad.origin.y < kViewportOrigin.y ||
+            quad.origin.x + quad.size.x > kViewportOrigin.x + kViewportSize.x ||
+            quad.origin.y + quad.size.y > kViewportOrigin.y + kViewportSize.y)
+            return false;
+    }
+    return true;
+}
+
+bool BenchDocument(const Workload& workload)
+{
+    if (workload.text.empty())
+        return true;
+
+    std::string string;
+    string.reserve(kDocumentSize + workload.text.size());
+    while (string.size() < kDocumentSize)
+        string += workload.text;
+
+    gb::Context context(1024, 4, gb::TextureFormat_Alpha, gb::ContextOptionFlags_NoGL);
+    auto font = CreateFont(context, workload, 0);
+
+    // warm the glyph cache, so both layouts below only shape & wrap.
+    gb::Text warm(string.substr(0, kTextSize / 10), font, nullptr, kViewportOrigin, kViewportSize,
+                  gb::TextHorizontalAlign_Left, gb::TextVerticalAlign_Top);
+
+    auto start = std::chrono::steady_clock::now();
+    gb::Text text(string.substr(0, kTextSize), font, nullptr, kViewportOrigin, kViewportSize,
+                  gb::TextHorizontalAlign_Left, gb::TextVerticalAlign_Top);
+    const double textMs = GetMilliseconds(start);
+
+    start = std::chrono::steady_clock::now();
+    gb::Document document(string, font, nullptr, kViewportOrigin, kViewportSize, gb::TextHorizontalAlign_Left);
+    document.SetScrollY(0);
+    document.Draw();
+    const double documentMs = GetMilliseconds(start);
+
+    printf("%u MB, %u paragraphs, at %u points\n", (uint32_t)(string.size() >> 20),
+           (uint32_t)document.GetNumParagraphs(), workload.pointSizeVec[0]);
+    printf("first frame     ms\n");
+    printf("Text, 1 MB      %7.1f\n", textMs);
+    printf("Document        %7.1f\n", documentMs);
+
+    // scrolling forward records each frame, scrolling back must draw the same ones.
+    bool ok = IsInViewport(document.GetQuadVec());
+    uint32_t numFrames = 1, numCompared = 0;
+    std::map<int, uint64_t> frameMap;
+    frameMap[0] = HashQuads(document.GetQuadVec());
+
+    const int lineHeight = font->GetLineHeight();
+    struct Scroll { const char* name; uint32_t numFrames; int step; } scrollVec[] = {
+        {"line", 5000, lineHeight},
+        {"back a line", 5000, -lineHeight},
+        {"page", 500, kViewportSize.y},
+        {"random jump", 200, 0},
+    };
+
+    printf("scroll          us/frame\n");
+    std::mt19937 rng(36);
+    int y = 0;
+    for (auto &scroll : scrollVec)
+    {
+        double ms = 0.0;
+        for (uint32_t i = 0; i < scroll.numFrames; i++, numFrames++)
+        {
+            y = scroll.step ? std::max(y + scroll.step, 0) : (int)(rng() % (uint32_t)document.GetHeight());
+            start = std::chrono::steady_clock::now();
+            document.SetScrollY(y);
+            document.Draw();
+            ms += GetMilliseconds(start);
+
+            if (ok && !IsInViewport(document.GetQuadVec()))
+            {
+                fprintf(stderr, "Error a quad at scroll y %d is outside the viewport\n", y);
+                ok = false;
+            }
+            const uint64_t hash = HashQuads(document.GetQuadVec());
+            if (scroll.step > 0)
+                frameMap[y] = hash;
+            else if (scroll.step < 0 && frameMap.count(y))
+            {
+                numCompared++;
+                if (ok && frameMap[y] != hash)
+                {
+                    fprintf(stderr, "Error scrolling back to y %d draws a different frame\n", y);
+                    ok = false;
+                }
+            }
+        }
+        printf("%-14s  %8.1f\n", scroll.name, ms * 1000.0 / scroll.numFrames);
+    }
+    printf("%u frames checked, %u compared after scrolling back\n", numFrames, numCompared);
+    return ok;
+}
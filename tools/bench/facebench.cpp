@@ -0,0 +1,95 @@
+// -m faces, creates every font file at every size.
+//
+// In one context the sizes of a file share a face, with a context per font every font has a face of its own,
+// as they did before faces were shared.  Reports the time & the memory the fonts allocated both ways,
+// and checks that sharing saved memory and that a shared face lays out the same as one of its own.
+
+#include <stdio.h>
+#include <algorithm>
+
+#include "bench.h"
+
+static const uint32_t kNumRounds = 3;
+
+// creates a font for each file & size, in order, and returns the time it took.
+static double CreateFonts(const Workload& workload, const std::vector<gb::Context*>& contextVec,
+                          std::vector<std::shared_ptr<gb::Font>>& fontVecOut)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (auto &file : workload.fontFileVec)
+    {
+        for (auto pointSize : workload.pointSizeVec)
+        {
+            gb::Context& context = *contextVec[fontVecOut.size() % contextVec.size()];
+            fontVecOut.push_back(std::make_shared<gb::Font>(context, file, pointSize, 0, gb::FontRenderOption_Normal,
+                                                            gb::FontHintOption_Default));
+        }
+    }
+    return GetMilliseconds(start);
+}
+
+bool BenchFaces(const Workload& workload)
+{
+    const uint32_t numFonts = (uint32_t)(workload.fontFileVec.size() * workload.pointSizeVec.size());
+    printf("%u fonts, %u files at %u sizes\n", numFonts, (uint32_t)workload.fontFileVec.size(),
+           (uint32_t)workload.pointSizeVec.size());
+    printf("contexts  ms      KiB allocated\n");
+
+    bool ok = true;
+    uint64_t sharedBytes = 0;
+    std::vector<Layout> sharedLayoutVec;
+    for (uint32_t numContexts : {1u, numFonts})
+    {
+        // best of a few rounds, the first one also pays for reading the files.
+        double bestMs = 0.0;
+        uint64_t fontBytes = 0;
+        for (uint32_t round = 0; round < kNumRounds; round++)
+        {
+            CountingAllocator allocator;
+            std::vector<std::unique_ptr<gb::Context>> contextVec;
+            std::vector<gb::Context*> contextPtrVec;
+            for (uint32_t i = 0; i < numContexts; i++)
+            {
+                contextVec.emplace_back(new gb::Context(1024, 1, gb::TextureFormat_Alpha, gb::ContextOptionFlags_NoGL,
+                                                        &allocator));
+                contextPtrVec.push_back(contextVec.back().get());
+            }
+
+            std::vector<std::shared_ptr<gb::Font>> fontVec;
+            const uint64_t liveBytes = allocator.GetLiveBytes();
+            const double ms = CreateFonts(workload, contextPtrVec, fontVec);
+            fontBytes = allocator.GetLiveBytes() - liveBytes;
+            bestMs = round == 0 ? ms : std::min(bestMs, ms);
+
+            if (round + 1 < kNumRounds)
+                continue;
+            for (uint32_t i = 0; i < numFonts; i++)
+            {
+                Layout layout;
+                LayOut(workload.lineVec[0], fontVec[i], layout);
+                if (numContexts == 1)
+                {
+                    sharedLayoutVec.push_back(layout);
+                }
+                else if (layout != sharedLayoutVec[i])
+                {
+                    fprintf(stderr, "Error font %u differs with a face of its own\n", i);
+                    ok = false;
+                }
+            }
+        }
+        printf("%8u  %6.2f  %13.1f\n", numContexts, bestMs, fontBytes / 1024.0);
+
+        // FreeType allocates through the context, so a face of its own for each size costs more.
+        if (numContexts == 1)
+        {
+            sharedBytes = fontBytes;
+        }
+        else if (numFonts > workload.fontFileVec.size() && fontBytes <= sharedBytes)
+        {
+            fprintf(stderr, "Error the fonts of one context allocated no less than a context per font\n");
+            ok = false;
+        }
+    }
+    return ok;
+}
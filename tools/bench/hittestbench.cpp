@@ -0,0 +1,129 @@
+// -m hittest, maps points to carets and carets to points in the text, with the first font at the first size.
+//
+// Every character of the text must round trip, its caret position hit tests to a caret at the same place,
+// left to right and right to left, at every alignment.  Then reports the time of Text::HitTest and
+// Text::GetCaretPosition on the text repeated to 1 MB, against scanning the quads for the one under a point.
+
+#include <stdio.h>
+#include <random>
+
+#include "bench.h"
+
+static const size_t kTextSize = 1 << 20;
+static const uint32_t kNumQueries = 200000;
+static const uint32_t kNumScans = 200;
+static const gb::IntPoint kRoundTripOrigin = {7, 5};
+
+// the lookups add their results here, so they are not optimized away.
+static volatile uint64_t s_sum;
+
+// returns the number of characters whose caret does not round trip, and prints the first few.
+static uint32_t CheckRoundTrips(const Workload& workload, std::shared_ptr<gb::Font> font, uint32_t optionFlags,
+                                gb::TextHorizontalAlign horizontalAlign, uint32_t& numCheckedOut)
+{
+    const gb::IntPoint size = {400, kSize.y};
+    gb::Text text(workload.text, font, nullptr, kRoundTripOrigin, size, horizontalAlign, gb::TextVerticalAlign_Top,
+                  optionFlags);
+    const int32_t lineHeight = font->GetLineHeight();
+
+    uint32_t numFailed = 0;
+    for (uint32_t cluster = 0; cluster <= workload.text.size(); cluster++)
+    {
+        // carets go between characters, not inside their utf8 sequences.
+        if (cluster < workload.text.size() && (workload.text[cluster] & 0xc0) == 0x80)
+            continue;
+        numCheckedOut++;
+        const gb::IntPoint position = text.GetCaretPosition(cluster);
+        const uint32_t hit = text.HitTest(gb::IntPoint{position.x, position.y + lineHeight / 2});
+        const gb::IntPoint hitPosition = text.GetCaretPosition(hit);
+        if (hitPosition.x != position.x || hitPosition.y != position.y)
+        {
+            if (numFailed++ < 5)
+            {
+                fprintf(stderr, "Error the caret at %u is at %d,%d, but hit tests to %u at %d,%d\n",
+                        cluster, position.x, position.y, hit, hitPosition.x, hitPosition.y);
+            }
+        }
+    }
+    return numFailed;
+}
+
+bool BenchHitTest(const Workload& workload)
+{
+    if (workload.text.empty())
+        return true;
+
+    gb::Context context(1024, 4, gb::TextureFormat_Alpha, gb::ContextOptionFlags_NoGL);
+    auto font = CreateFont(context, workload, 0);
+
+    bool ok = true;
+    static const char* s_alignNameTable[] = {"left", "right", "center"};
+    printf("direction  align   carets  round trips\n");
+    for (uint32_t optionFlags : {(uint32_t)gb::TextOptionFlags_None, (uint32_t)gb::TextOptionFlags_DirectionRightToLeft})
+    {
+        for (int align = gb::TextHorizontalAlign_Left; align <= gb::TextHorizontalAlign_Center; align++)
+        {
+            uint32_t numChecked = 0;
+            const uint32_t numFailed = CheckRoundTrips(workload, font, optionFlags, (gb::TextHorizontalAlign)align,
+                                                       numChecked);
+            printf("%-9s  %-6s  %6u  %11u\n", optionFlags ? "rtl" : "ltr", s_alignNameTable[align], numChecked,
+                   numChecked - numFailed);
+            ok = ok && numFailed == 0;
+        }
+    }
+
+    std::string string;
+    while (string.size() < kTextSize)
+        string += workload.text;
+    gb::Text text(string, font, nullptr, kOrigin, kSize, gb::TextHorizontalAlign_Left, gb::TextVerticalAlign_Top);
+    const int32_t lineHeight = font->GetLineHeight();
+    const int32_t height = text.GetNumLines() * lineHeight;
+
+    std::mt19937 rng(39);
+    std::vector<gb::IntPoint> pointVec;
+    std::vector<uint32_t> clusterVec;
+    for (uint32_t i = 0; i < kNumQueries; i++)
+    {
+        pointVec.push_back(gb::IntPoint{(int32_t)(rng() % (uint32_t)(kSize.x + 20)), (int32_t)(rng() % (uint32_t)height)});
+        clusterVec.push_back(rng() % (uint32_t)string.size());
+    }
+
+    uint64_t sum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (auto &point : pointVec)
+        sum += text.HitTest(point);
+    const double hitTestMs = GetMilliseconds(start);
+
+    start = std::chrono::steady_clock::now();
+    for (auto cluster : clusterVec)
+        sum += text.GetCaretPosition(cluster).x;
+    const double caretMs = GetMilliseconds(start);
+
+    // what callers did before, look for the quad under the point.
+    const gb::QuadVec& quadVec = text.GetQuadVec();
+    start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < kNumScans; i++)
+    {
+        const gb::IntPoint& point = pointVec[i];
+        for (size_t j = 0; j < quadVec.size(); j++)
+        {
+            const gb::Quad& quad = quadVec[j];
+            if (quad.pen.y - lineHeight < point.y && point.y <= quad.pen.y &&
+                quad.pen.x <= point.x && point.x < quad.pen.x + quad.size.x)
+            {
+                sum += j;
+                break;
+            }
+        }
+    }
+    const double scanMs = GetMilliseconds(start);
+    s_sum = sum;
+
+    printf("%u bytes, %u glyphs, %u lines\n", (uint32_t)string.size(), (uint32_t)quadVec.size(),
+           (uint32_t)text.GetNumLines());
+    printf("lookup            ns/query\n");
+    printf("HitTest           %10.0f\n", hitTestMs * 1e6 / kNumQueries);
+    printf("GetCaretPosition  %10.0f\n", caretMs * 1e6 / kNumQueries);
+    printf("quad scan         %10.0f\n", scanMs * 1e6 / kNumScans);
+    return ok;
+}
@@ -0,0 +1,67 @@
+// -m labels, lays out short UI labels over and over with the first font at the first size, the glyphs are
+// cached after the first pass.
+//
+// Labels like these need no shaping, so with GB_USE_HARFBUZZ they skip HarfBuzz.  They are also laid out
+// with the script tag Zyyy, which always takes the full shaping path.  Reports labels per second for both,
+// the best of a few passes, and checks that both paths lay every label out the same.
+
+#include <stdio.h>
+#include <algorithm>
+
+#include "bench.h"
+
+static const char* s_labelTable[] = {"OK", "Cancel", "Score: 12345", "Settings", "Player 1", "Level 42 / 100",
+                                     "Volume 75%", "Quit Game"};
+static const uint32_t kNumLabels = sizeof(s_labelTable) / sizeof(s_labelTable[0]);
+static const uint32_t kNumPasses = 3;
+static const gb::IntPoint kLabelSize = {400, 100};
+
+// the best rate of a few passes of workload.numLayouts labels each.
+static double LayOutLabels(const Workload& workload, std::shared_ptr<gb::Font> font, const char* script)
+{
+    double bestMs = 0.0;
+    for (uint32_t pass = 0; pass < kNumPasses; pass++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < workload.numLayouts; i++)
+        {
+            gb::Text text(s_labelTable[i % kNumLabels], font, nullptr, kOrigin, kLabelSize, gb::TextHorizontalAlign_Left,
+                          gb::TextVerticalAlign_Top, gb::TextOptionFlags_None, script);
+        }
+        const double ms = GetMilliseconds(start);
+        bestMs = pass == 0 ? ms : std::min(bestMs, ms);
+    }
+    return workload.numLayouts / bestMs * 1000.0;
+}
+
+static void GetLabelLayout(std::shared_ptr<gb::Font> font, const char* label, const char* script, Layout& layoutOut)
+{
+    gb::Text text(label, font, nullptr, kOrigin, kLabelSize, gb::TextHorizontalAlign_Left, gb::TextVerticalAlign_Top,
+                  gb::TextOptionFlags_None, script);
+    GetLayout(text, layoutOut);
+}
+
+bool BenchLabels(const Workload& workload)
+{
+    gb::Context context(1024, 1, gb::TextureFormat_Alpha, gb::ContextOptionFlags_NoGL);
+    auto font = CreateFont(context, workload, 0);
+
+    bool ok = true;
+    Layout simpleLayout, shapedLayout;
+    for (uint32_t i = 0; i < kNumLabels; i++)
+    {
+        GetLabelLayout(font, s_labelTable[i], nullptr, simpleLayout);
+        GetLabelLayout(font, s_labelTable[i], "Zyyy", shapedLayout);
+        if (simpleLayout != shapedLayout)
+        {
+            fprintf(stderr, "Error \"%s\" lays out differently when shaped\n", s_labelTable[i]);
+            ok = false;
+        }
+    }
+
+    printf("%u labels at %u points, best of %u passes\n", workload.numLayouts, workload.pointSizeVec[0], kNumPasses);
+    printf("script  labels/s\n");
+    printf("none    %9.0f\n", LayOutLabels(workload, font, nullptr));
+    printf("Zyyy    %9.0f\n", LayOutLabels(workload, font, "Zyyy"));
+    return ok;
+}
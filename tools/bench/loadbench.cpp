@@ -0,0 +1,83 @@
+// -m load, startup time, every font file at the first size with the first line of text laid out.
+//
+// Fonts are opened from the file, which is memory-mapped, and from a buffer the bench read the file into,
+// the time to read it included.  Reports the best of a few rounds, each in a new context, and checks that
+// both ways lay out the same.
+
+#include <stdio.h>
+#include <algorithm>
+
+#include "bench.h"
+
+static const uint32_t kNumRounds = 3;
+
+// lays out the first line with each font, from its file or from bufferVec, returns false if a file can not be read.
+static bool Load(const Workload& workload, std::vector<std::string>* bufferVec, std::vector<Layout>& layoutVecOut,
+                 double& msOut)
+{
+    gb::Context context(1024, 1, gb::TextureFormat_Alpha, gb::ContextOptionFlags_NoGL);
+    std::vector<std::shared_ptr<gb::Font>> fontVec;
+    layoutVecOut.resize(workload.fontFileVec.size());
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < workload.fontFileVec.size(); i++)
+    {
+        const std::string& file = workload.fontFileVec[i];
+        if (bufferVec)
+        {
+            std::string& buffer = (*bufferVec)[i];
+            buffer.clear();
+            if (!LoadFile(file.c_str(), buffer))
+            {
+                fprintf(stderr, "Error reading \"%s\"\n", file.c_str());
+                return false;
+            }
+            fontVec.push_back(std::make_shared<gb::Font>(context, (const uint8_t*)buffer.data(), buffer.size(),
+                                                         workload.pointSizeVec[0], 0, gb::FontRenderOption_Normal,
+                                                         gb::FontHintOption_Default));
+        }
+        else
+        {
+            fontVec.push_back(std::make_shared<gb::Font>(context, file, workload.pointSizeVec[0], 0,
+                                                         gb::FontRenderOption_Normal, gb::FontHintOption_Default));
+        }
+        LayOut(workload.lineVec[0], fontVec.back(), layoutVecOut[i]);
+    }
+    msOut = GetMilliseconds(start);
+
+    // the fonts go before the buffers they were created from.
+    fontVec.clear();
+    return true;
+}
+
+bool BenchLoad(const Workload& workload)
+{
+    printf("%u fonts at %u points, one text each\n", (uint32_t)workload.fontFileVec.size(), workload.pointSizeVec[0]);
+    printf("source  ms\n");
+
+    std::vector<std::string> bufferVec(workload.fontFileVec.size());
+    std::vector<Layout> mappedLayoutVec, bufferLayoutVec;
+    double mappedMs = 0.0, bufferMs = 0.0;
+    for (uint32_t round = 0; round < kNumRounds; round++)
+    {
+        double ms;
+        Load(workload, nullptr, mappedLayoutVec, ms);
+        mappedMs = round == 0 ? ms : std::min(mappedMs, ms);
+        if (!Load(workload, &bufferVec, bufferLayoutVec, ms))
+            return false;
+        bufferMs = round == 0 ? ms : std::min(bufferMs, ms);
+    }
+    printf("mapped  %6.2f\n", mappedMs);
+    printf("buffer  %6.2f\n", bufferMs);
+
+    bool ok = true;
+    for (size_t i = 0; i < workload.fontFileVec.size(); i++)
+    {
+        if (mappedLayoutVec[i] != bufferLayoutVec[i])
+        {
+            fprintf(stderr, "Error \"%s\" lays out differently from a buffer\n", workload.fontFileVec[i].c_str());
+            ok = false;
+        }
+    }
+    return ok;
+}
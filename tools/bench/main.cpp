@@ -0,0 +1,371 @@
+// Multi-threaded throughput benchmark and stress test.
+//
+// Lays out every line of a text file as a Text of its own, at several point sizes, over and over
+// on 1, 2, 4 ... N threads, and reports the layouts per second for each thread count.
+// With -m separate each thread has its own gb::Context and fonts.  With -m shared every thread uses
+// the same fonts in one thread-safe context, and also creates and destroys fonts of its own meanwhile.
+// With -m rebuild a single thread keeps one Text per size and gives it every line in turn with
+// Text::SetString, through a counting allocator, after a warm-up pass no rebuild may allocate.
+// Every layout is checked against one made up front on a single thread.
+//
+// The other modes each measure one part of the library, and check its results, the first font file is
+// used unless noted:
+// -m faces creates every font file at every size, the sizes of a file must share one face.
+// -m load opens every font file mapped and from a buffer, both must lay out the same.
+// -m diskcache lays out the whole text without a disk cache, with a cold one, a warm one and a damaged one.
+// -m preload lays out every line with and without preloading the glyphs, both must lay out the same.
+// -m cmap maps the code points of the text to glyph indices, through the font and through FreeType.
+// -m labels lays out short UI labels with and without the shaping fast path, both must lay out the same.
+// -m utf8 decodes the repeated text and malformed strings, through DecodeUTF8 and a reference decoder.
+// -m wrap word wraps long and short words into narrow boxes, every line must fit and every glyph be drawn.
+// -m document scrolls a Document over the repeated text, every frame must stay in the viewport.
+// -m hittest round trips every caret of the text through HitTest, then times the lookups.
+// -m churn builds 10k labels, then lets fonts come and go, Compact must give back what they left.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <chrono>
+
+#include "bench.h"
+
+static void Usage()
+{
+    fprintf(stderr,
+            "usage: bench [options] font.ttf... text.txt\n"
+            "    -m MODE    separate, shared or rebuild (default separate),\n"
+            "               or faces, load, diskcache, preload, cmap, labels, utf8, wrap,\n"
+            "               document, hittest, churn\n"
+            "    -t N       largest number of threads (default hardware concurrency)\n"
+            "    -n N       layouts per thread (default 1000)\n"
+            "    -p N       smallest point size (default 12)\n"
+            "    -s N       number of point sizes, two apart (default 4)\n");
+    exit(1);
+}
+
+struct Mode
+{
+    const char* name;
+    bool (*func)(const Workload& workload);
+};
+
+static const Mode s_modeTable[] = {
+    {"faces", BenchFaces},
+    {"load", BenchLoad},
+    {"diskcache", BenchDiskCache},
+    {"preload", BenchPreload},
+    {"cmap", BenchCmap},
+    {"labels", BenchLabels},
+    {"utf8", BenchUTF8},
+    {"wrap", BenchWrap},
+    {"document", BenchDocument},
+    {"hittest", BenchHitTest},
+    {"churn", BenchChurn},
+};
+
+bool LoadFile(const char* filename, std::string& result)
+{
+    FILE* f = fopen(filename, "rb");
+    if (!f)
+        return false;
+    char buffer[4096];
+    size_t size;
+    while ((size = fread(buffer, 1, sizeof(buffer), f)) > 0)
+    {
+        result.append(buffer, size);
+    }
+    fclose(f);
+    return true;
+}
+
+// each allocation is preceded by its size, in a header that keeps the alignment of any scalar type.
+static const size_t kHeaderSize = alignof(max_align_t);
+
+void* CountingAllocator::Allocate(size_t size, size_t alignment)
+{
+    m_count++;
+    m_liveBytes += size;
+    uint8_t* ptr = (uint8_t*)gb::GetDefaultAllocator().Allocate(size + kHeaderSize, kHeaderSize);
+    memcpy(ptr, &size, sizeof(size));
+    return ptr + kHeaderSize;
+}
+
+void CountingAllocator::Free(void* ptr)
+{
+    if (!ptr)
+        return;
+    uint8_t* block = (uint8_t*)ptr - kHeaderSize;
+    size_t size;
+    memcpy(&size, block, sizeof(size));
+    m_liveBytes -= size;
+    gb::GetDefaultAllocator().Free(block);
+}
+
+std::shared_ptr<gb::Font> CreateFont(gb::Context& context, const Workload& workload, uint32_t size)
+{
+    return std::make_shared<gb::Font>(context, workload.fontFileVec[0], workload.pointSizeVec[size], 0,
+                                      gb::FontRenderOption_Normal, gb::FontHintOption_Default);
+}
+
+void GetLayout(const gb::Text& text, Layout& layoutOut)
+{
+    layoutOut.clear();
+    for (auto &quad : text.GetQuadVec())
+    {
+        layoutOut.push_back(quad.origin.x);
+        layoutOut.push_back(quad.origin.y);
+        layoutOut.push_back(quad.size.x);
+        layoutOut.push_back(quad.size.y);
+    }
+}
+
+void LayOut(const std::string& string, std::shared_ptr<gb::Font> font, Layout& layoutOut)
+{
+    gb::Text text(string, font, nullptr, kOrigin, kSize, gb::TextHorizontalAlign_Left, gb::TextVerticalAlign_Top);
+    GetLayout(text, layoutOut);
+}
+
+// indexed by size * number of lines + line.
+static std::vector<Layout> s_referenceVec;
+
+static void Worker(const Workload& workload, const std::vector<std::shared_ptr<gb::Font>>* sharedFontVec,
+                   uint32_t thread, bool* okOut)
+{
+    const uint32_t numSizes = (uint32_t)workload.pointSizeVec.size();
+    const uint32_t numLines = (uint32_t)workload.lineVec.size();
+
+    std::unique_ptr<gb::Context> context;
+    std::vector<std::shared_ptr<gb::Font>> fontVec;
+    if (sharedFontVec)
+    {
+        fontVec = *sharedFontVec;
+    }
+    else
+    {
+        context.reset(new gb::Context(1024, 1, gb::TextureFormat_Alpha, gb::ContextOptionFlags_NoGL));
+        for (uint32_t i = 0; i < numSizes; i++)
+            fontVec.push_back(CreateFont(*context, workload, i));
+    }
+
+    bool ok = true;
+    Layout layout;
+    for (uint32_t i = 0; i < workload.numLayouts; i++)
+    {
+        const uint32_t size = (i + thread) % numSizes;
+        const uint32_t line = (i * 7 + thread) % numLines;
+        std::shared_ptr<gb::Font> font = fontVec[size];
+
+        // a font of this thread's own, sharing the face and the glyph cache with the others.
+        if (sharedFontVec && i % 50 == 49)
+            font = CreateFont(fontVec[0]->GetContext(), workload, size);
+
+        LayOut(workload.lineVec[line], font, layout);
+        if (layout != s_referenceVec[size * numLines + line])
+        {
+            fprintf(stderr, "Error thread %u, line %u at %u points differs from the reference\n",
+                    thread, line, workload.pointSizeVec[size]);
+            ok = false;
+        }
+    }
+    fontVec.clear();
+    *okOut = ok;
+}
+
+// -m rebuild, returns false if a layout differs from the reference or a rebuild allocated.
+static bool Rebuild(const Workload& workload)
+{
+    const uint32_t numSizes = (uint32_t)workload.pointSizeVec.size();
+    const uint32_t numLines = (uint32_t)workload.lineVec.size();
+
+    CountingAllocator allocator;
+    gb::Context context(1024, 1, gb::TextureFormat_Alpha, gb::ContextOptionFlags_NoGL, &allocator);
+    std::vector<std::unique_ptr<gb::Text>> textVec;
+    for (uint32_t i = 0; i < numSizes; i++)
+    {
+        textVec.emplace_back(new gb::Text(std::string(), CreateFont(context, workload, i), nullptr, kOrigin, kSize,
+                                          gb::TextHorizontalAlign_Left, gb::TextVerticalAlign_Top));
+    }
+
+    // every glyph gets rasterized and every buffer grows to its largest size, twice over
+    // so the buffers for the glyphs being replaced grow as well.
+    for (uint32_t pass = 0; pass < 2; pass++)
+        for (uint32_t size = 0; size < numSizes; size++)
+            for (uint32_t line = 0; line < numLines; line++)
+                textVec[size]->SetString(workload.lineVec[line]);
+
+    bool ok = true;
+    Layout layout;
+    uint64_t numAllocations = 0;
+    std::chrono::duration<double> elapsed(0.0);
+    for (uint32_t i = 0; i < workload.numLayouts; i++)
+    {
+        const uint32_t size = i % numSizes;
+        const uint32_t line = (i * 7) % numLines;
+
+        const uint64_t count = allocator.GetCount();
+        auto start = std::chrono::steady_clock::now();
+        textVec[size]->SetString(workload.lineVec[line]);
+        elapsed += std::chrono::steady_clock::now() - start;
+        numAllocations += allocator.GetCount() - count;
+
+        GetLayout(*textVec[size], layout);
+        if (layout != s_referenceVec[size * numLines + line])
+        {
+            fprintf(stderr, "Error line %u at %u points differs from the reference\n",
+                    line, workload.pointSizeVec[size]);
+            ok = false;
+        }
+    }
+
+    printf("layouts/s  allocations/layout\n");
+    printf("%9.1f  %18.2f\n", workload.numLayouts / elapsed.count(), (double)numAllocations / workload.numLayouts);
+    if (numAllocations)
+    {
+        fprintf(stderr, "Error %llu allocations in %u rebuilds\n",
+                (unsigned long long)numAllocations, workload.numLayouts);
+        ok = false;
+    }
+    return ok;
+}
+
+int main(int argc, char* argv[])
+{
+    std::string mode = "separate";
+    uint32_t maxThreads = std::thread::hardware_concurrency();
+    uint32_t numSizes = 4;
+    uint32_t pointSize = 12;
+    Workload workload;
+    workload.numLayouts = 1000;
+    std::vector<std::string> args;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char* arg = argv[i];
+        if (arg[0] == '-' && arg[1] && !arg[2])
+        {
+            if (i + 1 >= argc)
+                Usage();
+            const char* value = argv[++i];
+            switch (arg[1])
+            {
+            case 'm': mode = value; break;
+            case 't': maxThreads = atoi(value); break;
+            case 'n': workload.numLayouts = atoi(value); break;
+            case 'p': pointSize = atoi(value); break;
+            case 's': numSizes = atoi(value); break;
+            default: Usage();
+            }
+        }
+        else
+        {
+            args.push_back(arg);
+        }
+    }
+
+    const Mode* featureMode = nullptr;
+    for (auto &entry : s_modeTable)
+    {
+        if (mode == entry.name)
+            featureMode = &entry;
+    }
+    const bool shared = mode == "shared";
+    const bool rebuild = mode == "rebuild";
+    if (!featureMode && !shared && !rebuild && mode != "separate")
+        Usage();
+    if (args.size() < 2 || workload.numLayouts == 0 || pointSize == 0 || numSizes == 0)
+        Usage();
+    if (maxThreads == 0)
+        maxThreads = 1;
+
+    const std::string& textFile = args.back();
+    std::string& string = workload.text;
+    if (!LoadFile(textFile.c_str(), string))
+    {
+        fprintf(stderr, "Error reading \"%s\"\n", textFile.c_str());
+        return 1;
+    }
+
+    workload.fontFileVec.assign(args.begin(), args.end() - 1);
+    size_t start = 0;
+    while (start < string.size())
+    {
+        size_t end = string.find('\n', start);
+        if (end == std::string::npos)
+            end = string.size();
+        if (end > start)
+            workload.lineVec.push_back(string.substr(start, end - start));
+        start = end + 1;
+    }
+    if (workload.lineVec.empty())
+    {
+        fprintf(stderr, "Error \"%s\" has no text\n", textFile.c_str());
+        return 1;
+    }
+    for (uint32_t i = 0; i < numSizes; i++)
+        workload.pointSizeVec.push_back(pointSize + i * 2);
+
+    if (featureMode)
+        return featureMode->func(workload) ? 0 : 1;
+
+    // reference layouts, from a single thread.
+    {
+        gb::Context context(1024, 1, gb::TextureFormat_Alpha, gb::ContextOptionFlags_NoGL);
+        for (uint32_t i = 0; i < numSizes; i++)
+        {
+            auto font = CreateFont(context, workload, i);
+            for (auto &line : workload.lineVec)
+            {
+                s_referenceVec.push_back(Layout());
+                LayOut(line, font, s_referenceVec.back());
+            }
+        }
+    }
+
+    if (rebuild)
+    {
+        printf("rebuilt texts, %u lines at %u sizes\n", (uint32_t)workload.lineVec.size(), numSizes);
+        return Rebuild(workload) ? 0 : 1;
+    }
+
+    printf("%s contexts, %u lines at %u sizes\n", shared ? "shared" : "separate",
+           (uint32_t)workload.lineVec.size(), numSizes);
+    printf("threads  layouts/s  speedup\n");
+    bool ok = true;
+    double base = 0.0;
+    for (uint32_t numThreads = 1; numThreads <= maxThreads;
+         numThreads = (numThreads < maxThreads && numThreads * 2 > maxThreads) ? maxThreads : numThreads * 2)
+    {
+        // a new shared context each time, so the glyph cache is filled by all the threads at once.
+        std::unique_ptr<gb::Context> context;
+        std::vector<std::shared_ptr<gb::Font>> fontVec;
+        if (shared)
+        {
+            context.reset(new gb::Context(1024, 1, gb::TextureFormat_Alpha,
+                                          gb::ContextOptionFlags_NoGL | gb::ContextOptionFlags_ThreadSafe));
+            for (uint32_t i = 0; i < numSizes; i++)
+                fontVec.push_back(CreateFont(*context, workload, i));
+        }
+
+        std::vector<std::thread> threadVec;
+        std::unique_ptr<bool[]> okVec(new bool[numThreads]);
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < numThreads; i++)
+            threadVec.emplace_back(Worker, std::cref(workload), shared ? &fontVec : nullptr, i, &okVec[i]);
+        for (auto &thread : threadVec)
+            thread.join();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        for (uint32_t i = 0; i < numThreads; i++)
+            ok = ok && okVec[i];
+
+        double rate = numThreads * workload.numLayouts / elapsed.count();
+        if (numThreads == 1)
+            base = rate;
+        printf("%7u  %9.1f  %7.2f\n", numThreads, rate, rate / base);
+    }
+
+    return ok ? 0 : 1;
+}
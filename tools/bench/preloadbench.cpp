@@ -0,0 +1,57 @@
+// -m preload, lays out every line of text as a Text of its own with the first font at the first size,
+// once as they come and once after Font::Preload of the whole text.
+//
+// Reports the time and the packing efficiency of the atlas both ways, preloading packs a whole batch
+// sorted by height.  The texts must lay out the same both ways.
+
+#include <stdio.h>
+
+#include "bench.h"
+#include "../../src/cache.h"
+
+static double LayOutLines(const Workload& workload, bool preload, std::vector<Layout>& layoutVecOut, float& efficiencyOut)
+{
+    gb::Context context(1024, 1, gb::TextureFormat_Alpha, gb::ContextOptionFlags_NoGL);
+    auto font = CreateFont(context, workload, 0);
+    std::vector<std::unique_ptr<gb::Text>> textVec;
+
+    auto start = std::chrono::steady_clock::now();
+    if (preload)
+        font->Preload(workload.text, true);
+    for (auto &line : workload.lineVec)
+    {
+        textVec.emplace_back(new gb::Text(line, font, nullptr, kOrigin, kSize, gb::TextHorizontalAlign_Left,
+                                          gb::TextVerticalAlign_Top));
+    }
+    const double ms = GetMilliseconds(start);
+
+    layoutVecOut.resize(textVec.size());
+    for (size_t i = 0; i < textVec.size(); i++)
+        GetLayout(*textVec[i], layoutVecOut[i]);
+    efficiencyOut = context.GetCache().GetPackingEfficiency();
+    return ms;
+}
+
+bool BenchPreload(const Workload& workload)
+{
+    printf("%u lines at %u points\n", (uint32_t)workload.lineVec.size(), workload.pointSizeVec[0]);
+    printf("glyphs    ms       packing efficiency\n");
+
+    std::vector<Layout> referenceVec, layoutVec;
+    float efficiency;
+    double ms = LayOutLines(workload, false, referenceVec, efficiency);
+    printf("per text  %7.2f  %18.3f\n", ms, efficiency);
+    ms = LayOutLines(workload, true, layoutVec, efficiency);
+    printf("preload   %7.2f  %18.3f\n", ms, efficiency);
+
+    bool ok = true;
+    for (size_t i = 0; i < layoutVec.size(); i++)
+    {
+        if (layoutVec[i] != referenceVec[i])
+        {
+            fprintf(stderr, "Error line %u differs after a preload\n", (uint32_t)i);
+            ok = false;
+        }
+    }
+    return ok;
+}
@@ -0,0 +1,266 @@
+// -m utf8, decodes the text repeated to 64 MB, with gb::DecodeUTF8 and with a byte at a time reference decoder.
+//
+// Reports the throughput of each.  Checks that both decode the repeated text the same, then that they
+// agree on edge cases and on random byte strings full of malformed sequences: one kReplacementCodePoint
+// for each maximal invalid subpart, and the same cluster offsets.
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <random>
+
+#include "bench.h"
+#include "../../src/utf8.h"
+
+static const size_t kDecodeSize = 64 << 20;
+static const uint32_t kNumRounds = 3;
+static const uint32_t kNumRandomStrings = 100000;
+
+// the range of code points of length bytes, surrogates aside.
+static const uint32_t s_minCodePointTable[] = {0, 0, 0x80, 0x800, 0x10000};
+static const uint32_t s_maxCodePointTable[] = {0, 0x7f, 0x7ff, 0xffff, 0x10ffff};
+
+// the length of the sequence a lead byte begins, 0 for a continuation byte or 0xf8 and up.
+static int GetSequenceLength(uint8_t c)
+{
+    if (c < 0x80)
+        return 1;
+    else if ((c & 0xe0) == 0xc0)
+        return 2;
+    else if ((c & 0xf0) == 0xe0)
+        return 3;
+    else if ((c & 0xf8) == 0xf0)
+        return 4;
+    return 0;
+}
+
+// the payload bits of a lead byte.
+static uint32_t GetLeadBits(uint8_t c, int length)
+{
+    return c & (length == 1 ? 0x7f : 0x7f >> length);
+}
+
+// true if the first n bytes at p can begin a well-formed sequence of length bytes, that is if some scalar value
+// between the one with every missing bit clear and the one with every missing bit set encodes with length bytes.
+static bool IsWellFormedPrefix(const uint8_t* p, int n, int length)
+{
+    uint32_t lo = GetLeadBits(p[0], length);
+    uint32_t hi = lo;
+    for (int i = 1; i < length; i++)
+    {
+        if (i < n)
+        {
+            if ((p[i] & 0xc0) != 0x80)
+                return false;
+            lo = (lo << 6) | (p[i] & 0x3f);
+            hi = (hi << 6) | (p[i] & 0x3f);
+        }
+        else
+        {
+            lo = lo << 6;
+            hi = (hi << 6) | 0x3f;
+        }
+    }
+    lo = std::max(lo, s_minCodePointTable[length]);
+    hi = std::min(hi, s_maxCodePointTable[length]);
+    return lo <= hi && !(lo >= 0xd800 && hi <= 0xdfff);
+}
+
+static void ReferenceDecode(const char* str, size_t size, std::vector<uint32_t>& codePointVecOut,
+                            std::vector<uint32_t>& clusterVecOut)
+{
+    const uint8_t* p = (const uint8_t*)str;
+    size_t i = 0;
+    while (i < size)
+    {
+        const int length = GetSequenceLength(p[i]);
+        int n = 0;
+        if (length > 0)
+        {
+            const int available = (int)std::min<size_t>(length, size - i);
+            while (n < available && IsWellFormedPrefix(p + i, n + 1, length))
+                n++;
+        }
+        clusterVecOut.push_back((uint32_t)i);
+        if (length > 0 && n == length)
+        {
+            uint32_t codePoint = GetLeadBits(p[i], length);
+            for (int j = 1; j < length; j++)
+                codePoint = (codePoint << 6) | (p[i + j] & 0x3f);
+            codePointVecOut.push_back(codePoint);
+        }
+        else
+            codePointVecOut.push_back(gb::kReplacementCodePoint);
+        i += std::max(n, 1);
+    }
+}
+
+// returns false and prints the first difference if DecodeUTF8 and the reference disagree on str.
+static bool CheckDecode(const std::string& str)
+{
+    gb::Vector<uint32_t> codePointVec, clusterVec;
+    std::vector<uint32_t> referenceCodePointVec, referenceClusterVec;
+    gb::DecodeUTF8(str.data(), str.size(), codePointVec, clusterVec);
+    ReferenceDecode(str.data(), str.size(), referenceCodePointVec, referenceClusterVec);
+
+    const size_t size = std::max(codePointVec.size(), referenceCodePointVec.size());
+    for (size_t i = 0; i < size; i++)
+    {
+        if (i >= codePointVec.size() || i >= referenceCodePointVec.size() ||
+            codePointVec[i] != referenceCodePointVec[i] || clusterVec[i] != referenceClusterVec[i])
+        {
+            fprintf(stderr, "Error decoding %u bytes, character %u differs:", (uint32_t)str.size(), (uint32_t)i);
+            for (size_t j = 0; j < std::min<size_t>(str.size(), 64); j++)
+                fprintf(stderr, " %02x", (uint8_t)str[j]);
+            fprintf(stderr, "\n");
+            return false;
+        }
+    }
+    return true;
+}
+
+// the example of maximal subparts from chapter 3 of the unicode standard.
+static bool CheckReference()
+{
+    const char* str = "\x61\xf1\x80\x80\xe1\x80\xc2\x62\x80\x63\x80\xbf\x64";
+    const uint32_t expected[] = {0x61, 0xfffd, 0xfffd, 0xfffd, 0x62, 0xfffd, 0x63, 0xfffd, 0xfffd, 0x64};
+    std::vector<uint32_t> codePointVec, clusterVec;
+    ReferenceDecode(str, strlen(str), codePointVec, clusterVec);
+    return codePointVec == std::vector<uint32_t>(expected, expected + sizeof(expected) / sizeof(expected[0]));
+}
+
+static void AppendUTF8(uint32_t codePoint, std::string& strOut)
+{
+    if (codePoint < 0x80)
+        strOut += (char)codePoint;
+    else if (codePoint < 0x800)
+    {
+        strOut += (char)(0xc0 | (codePoint >> 6));
+        strOut += (char)(0x80 | (codePoint & 0x3f));
+    }
+    else if (codePoint < 0x10000)
+    {
+        strOut += (char)(0xe0 | (codePoint >> 12));
+        strOut += (char)(0x80 | ((codePoint >> 6) & 0x3f));
+        strOut += (char)(0x80 | (codePoint & 0x3f));
+    }
+    else
+    {
+        strOut += (char)(0xf0 | (codePoint >> 18));
+        strOut += (char)(0x80 | ((codePoint >> 12) & 0x3f));
+        strOut += (char)(0x80 | ((codePoint >> 6) & 0x3f));
+        strOut += (char)(0x80 | (codePoint & 0x3f));
+    }
+}
+
+// runs of ascii long enough for the 16 byte blocks, well-formed characters, bytes at the edges of table 3-7 and noise.
+static void MakeRandomString(std::mt19937& rng, std::string& strOut)
+{
+    static const uint8_t s_edgeByteTable[] = {0x00, 0x7f, 0x80, 0x8f, 0x90, 0x9f, 0xa0, 0xbf, 0xc0, 0xc1, 0xc2,
+                                              0xdf, 0xe0, 0xe1, 0xec, 0xed, 0xee, 0xef, 0xf0, 0xf3, 0xf4, 0xf5,
+                                              0xf7, 0xf8, 0xfe, 0xff};
+    strOut.clear();
+    const uint32_t numPieces = rng() % 12;
+    for (uint32_t i = 0; i < numPieces; i++)
+    {
+        switch (rng() % 4)
+        {
+        case 0:
+            strOut.append(1 + rng() % 40, (char)('a' + rng() % 26));
+            break;
+        case 1:
+        {
+            uint32_t codePoint = rng() % 0x110000;
+            if (codePoint >= 0xd800 && codePoint <= 0xdfff)
+                codePoint -= 0x800;
+            AppendUTF8(codePoint, strOut);
+            break;
+        }
+        case 2:
+            strOut += (char)s_edgeByteTable[rng() % sizeof(s_edgeByteTable)];
+            break;
+        default:
+            strOut += (char)(rng() % 256);
+            break;
+        }
+    }
+}
+
+bool BenchUTF8(const Workload& workload)
+{
+    if (!CheckReference())
+    {
+        fprintf(stderr, "Error the reference decoder is wrong\n");
+        return false;
+    }
+    if (workload.text.empty())
+        return true;
+
+    std::string str;
+    str.reserve(kDecodeSize);
+    while (str.size() + workload.text.size() <= kDecodeSize)
+        str += workload.text;
+    if (str.empty())
+        str = workload.text;
+
+    gb::Vector<uint32_t> codePointVec, clusterVec;
+    std::vector<uint32_t> referenceCodePointVec, referenceClusterVec;
+    double bestMs = 0.0, bestReferenceMs = 0.0;
+    for (uint32_t round = 0; round < kNumRounds; round++)
+    {
+        codePointVec.clear();
+        clusterVec.clear();
+        auto start = std::chrono::steady_clock::now();
+        gb::DecodeUTF8(str.data(), str.size(), codePointVec, clusterVec);
+        const double ms = GetMilliseconds(start);
+
+        referenceCodePointVec.clear();
+        referenceClusterVec.clear();
+        start = std::chrono::steady_clock::now();
+        ReferenceDecode(str.data(), str.size(), referenceCodePointVec, referenceClusterVec);
+        const double referenceMs = GetMilliseconds(start);
+
+        bestMs = round == 0 ? ms : std::min(bestMs, ms);
+        bestReferenceMs = round == 0 ? referenceMs : std::min(bestReferenceMs, referenceMs);
+    }
+
+    printf("%u MB, %u code points, best of %u rounds\n", (uint32_t)(str.size() >> 20),
+           (uint32_t)codePointVec.size(), kNumRounds);
+    printf("decoder     GB/s\n");
+    printf("DecodeUTF8  %5.2f\n", str.size() / bestMs / 1e6);
+    printf("reference   %5.2f\n", str.size() / bestReferenceMs / 1e6);
+
+    bool ok = true;
+    if (!std::equal(codePointVec.begin(), codePointVec.end(), referenceCodePointVec.begin()) ||
+        !std::equal(clusterVec.begin(), clusterVec.end(), referenceClusterVec.begin()) ||
+        codePointVec.size() != referenceCodePointVec.size())
+    {
+        fprintf(stderr, "Error DecodeUTF8 and the reference decode the text differently\n");
+        ok = false;
+    }
+
+    // every sequence cut short, and every lead byte followed by every second byte.
+    uint32_t numChecked = 0;
+    for (uint32_t lead = 0x80; lead < 0x100 && ok; lead++)
+    {
+        for (uint32_t second = 0; second < 0x100 && ok; second++)
+        {
+            std::string edge = "abc";
+            edge += (char)lead;
+            edge += (char)second;
+            edge += "\x80\x80 0123456789abcdef";
+            for (size_t size = 3; size <= edge.size() && ok; size++, numChecked++)
+                ok = CheckDecode(edge.substr(0, size));
+        }
+    }
+
+    std::mt19937 rng(34);
+    std::string random;
+    for (uint32_t i = 0; i < kNumRandomStrings && ok; i++, numChecked++)
+    {
+        MakeRandomString(rng, random);
+        ok = CheckDecode(random);
+    }
+    printf("%u malformed and random strings checked\n", numChecked);
+    return ok;
+}
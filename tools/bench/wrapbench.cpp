@@ -0,0 +1,136 @@
+// -m wrap, word wraps long words and runs of short words into narrow boxes, down to boxes narrower than
+// a single glyph, with the first font at the first size.
+//
+// Reports the time of each case, the best of a few layouts with the glyphs cached.  Checks that every
+// non-space character is drawn, in order, and that every line fits the width, unless it holds a single
+// glyph that is wider than the box by itself.
+
+#include <stdio.h>
+#include <limits.h>
+#include <algorithm>
+
+#include "bench.h"
+
+static const uint32_t kNumRounds = 5;
+static const int32_t kWrapHeight = 1 << 20;
+
+struct GlyphMetrics
+{
+    int32_t advance;
+    gb::IntPoint size;
+};
+
+// the metrics of every printable ascii character, from a Text of that character alone.
+static void GetGlyphMetrics(std::shared_ptr<gb::Font> font, std::vector<GlyphMetrics>& metricsVecOut)
+{
+    metricsVecOut.assign(128, GlyphMetrics{0, {0, 0}});
+    for (int c = ' '; c < 127; c++)
+    {
+        gb::Text text(std::string(1, (char)c), font, nullptr, kOrigin, kSize, gb::TextHorizontalAlign_Left,
+                      gb::TextVerticalAlign_Top);
+        if (text.GetQuadVec().size() == 1)
+        {
+            const gb::Quad& quad = text.GetQuadVec()[0];
+            metricsVecOut[c] = GlyphMetrics{text.GetCaretPosition(1).x - quad.pen.x, quad.size};
+        }
+    }
+}
+
+// the strings are ascii without kerning, so the quads with ink match the non-space characters one for one.
+static bool CheckWrap(const char* name, const std::string& string, int32_t width, const gb::Text& text,
+                      const std::vector<GlyphMetrics>& metricsVec)
+{
+    size_t c = 0;
+    int32_t lineY = INT_MIN, lineRight = 0;
+    uint32_t numLineGlyphs = 0;
+    const gb::QuadVec& quadVec = text.GetQuadVec();
+    for (size_t i = 0; i <= quadVec.size(); i++)
+    {
+        if (i == quadVec.size() || quadVec[i].pen.y != lineY)
+        {
+            if (numLineGlyphs > 1 && lineRight > width)
+            {
+                fprintf(stderr, "Error %s: the line at y %d is %d pixels wide\n", name, lineY, lineRight);
+                return false;
+            }
+            if (i == quadVec.size())
+                break;
+            lineY = quadVec[i].pen.y;
+            lineRight = 0;
+            numLineGlyphs = 0;
+        }
+        const gb::Quad& quad = quadVec[i];
+        if (quad.size.x == 0)
+            continue;
+
+        while (c < string.size() && string[c] == ' ')
+            c++;
+        const GlyphMetrics* metrics = c < string.size() ? &metricsVec[string[c] & 0x7f] : nullptr;
+        if (!metrics || quad.size.x != metrics->size.x || quad.size.y != metrics->size.y)
+        {
+            fprintf(stderr, "Error %s: glyph %u is not character %u\n", name, (uint32_t)i, (uint32_t)c);
+            return false;
+        }
+        lineRight = std::max(lineRight, quad.pen.x - kOrigin.x + metrics->advance);
+        numLineGlyphs++;
+        c++;
+    }
+
+    while (c < string.size() && string[c] == ' ')
+        c++;
+    if (c != string.size())
+    {
+        fprintf(stderr, "Error %s: only %u of %u characters are drawn\n", name, (uint32_t)c, (uint32_t)string.size());
+        return false;
+    }
+    return true;
+}
+
+bool BenchWrap(const Workload& workload)
+{
+    gb::Context context(1024, 1, gb::TextureFormat_Alpha, gb::ContextOptionFlags_NoGL);
+    auto font = CreateFont(context, workload, 0);
+    std::vector<GlyphMetrics> metricsVec;
+    GetGlyphMetrics(font, metricsVec);
+
+    const std::string longWord(20000, 'm');
+    std::string shortWords, longWords;
+    for (int i = 0; i < 4000; i++)
+        shortWords += "word ";
+    for (int i = 0; i < 200; i++)
+        longWords += std::string(60, 'x') + " ab cd ";
+
+    struct Case { const char* name; const std::string& string; int32_t width; } caseVec[] = {
+        {"long word, 200px", longWord, 200},
+        {"long word, 20px", longWord, 20},
+        {"long word, 5px", longWord, 5},
+        {"short words, 200px", shortWords, 200},
+        {"short words, 40px", shortWords, 40},
+        {"short words, 1px", shortWords, 1},
+        {"60-char words, 300px", longWords, 300},
+        {"60-char words, 30px", longWords, 30},
+    };
+
+    printf("%u points, best of %u layouts\n", workload.pointSizeVec[0], kNumRounds);
+    printf("case                  chars   lines  ms\n");
+    bool ok = true;
+    for (auto &wrapCase : caseVec)
+    {
+        const gb::IntPoint size = {wrapCase.width, kWrapHeight};
+        gb::Text text(wrapCase.string, font, nullptr, kOrigin, size, gb::TextHorizontalAlign_Left,
+                      gb::TextVerticalAlign_Top);
+        ok = CheckWrap(wrapCase.name, wrapCase.string, wrapCase.width, text, metricsVec) && ok;
+
+        double bestMs = 0.0;
+        for (uint32_t round = 0; round < kNumRounds; round++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            gb::Text timed(wrapCase.string, font, nullptr, kOrigin, size, gb::TextHorizontalAlign_Left,
+                           gb::TextVerticalAlign_Top);
+            const double ms = GetMilliseconds(start);
+            bestMs = round == 0 ? ms : std::min(bestMs, ms);
+        }
+        printf("%-20s  %5u  %6d  %6.3f\n", wrapCase.name, (uint32_t)wrapCase.string.size(), text.GetNumLines(), bestMs);
+    }
+    return ok;
+}